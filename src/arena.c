@@ -0,0 +1,184 @@
+#include "arena.h"
+#include <stdint.h>
+#include <errno.h>
+
+#define ARENA_ALIGN 16
+
+/*
+ * Block Layout
+ * Every block starts with this header; free blocks also use the start of
+ * their payload for the free-list links. 'prev_size' (the size of the block
+ * just before, 0 for the first) lets free() find its left neighbour.
+ * A zero-size, in-use sentinel block terminates the region.
+ */
+struct arena_block
+{
+    size_t size;      /* Whole block including header; multiple of ARENA_ALIGN */
+    size_t prev_size;
+    int used;
+    arena_block_t *next_free, *prev_free;
+} __attribute__((aligned(ARENA_ALIGN)));
+
+#define HEADER_SIZE ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define MIN_BLOCK (HEADER_SIZE + ARENA_ALIGN)
+
+static arena_block_t *next_block(arena_block_t *b) { return (arena_block_t *)((char *)b + b->size); }
+static arena_block_t *prev_block(arena_block_t *b) { return (arena_block_t *)((char *)b - b->prev_size); }
+
+/* Free-list helpers (caller holds the arena lock) */
+static void list_remove(arena_t *a, arena_block_t *b)
+{
+    if (b->prev_free) b->prev_free->next_free = b->next_free; else a->free_list = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+}
+
+static void list_push(arena_t *a, arena_block_t *b)
+{
+    b->prev_free = NULL;
+    b->next_free = a->free_list;
+    if (a->free_list) a->free_list->prev_free = b;
+    a->free_list = b;
+}
+
+/*
+ * Lock Arena
+ * Purpose: Takes the arena lock. An owner that died holding it may have
+ * left the block lists inconsistent, so the arena is marked broken instead
+ * of being used.
+ * Return: 0 with the lock held, -1 (lock not held) if the arena is broken.
+ */
+static int arena_lock(arena_t *a)
+{
+    int rc = pthread_mutex_lock(&a->lock);
+    if (rc == EOWNERDEAD) {
+        __atomic_store_n(&a->broken, 1, __ATOMIC_RELAXED);
+        pthread_mutex_consistent(&a->lock);
+        pthread_mutex_unlock(&a->lock);
+        return -1;
+    }
+    if (rc != 0) return -1;
+    if (__atomic_load_n(&a->broken, __ATOMIC_RELAXED)) {
+        pthread_mutex_unlock(&a->lock);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Create Arena
+ * Purpose: Lays out an arena over 'mem': the arena_t itself, one free block
+ * spanning the rest, and the end sentinel. Called again on the same region,
+ * it discards everything allocated there (used to reset a broken arena).
+ *
+ * Parameters:
+ * - mem: Start of the region (e.g., a MAP_SHARED mapping).
+ * - len: Size of the region in bytes.
+ *
+ * Return:
+ * - The arena (at the start of 'mem'), or NULL if the region is too small.
+ */
+arena_t *arena_create(void *mem, size_t len)
+{
+    uintptr_t start = ((uintptr_t)mem + sizeof(arena_t) + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+    uintptr_t end = ((uintptr_t)mem + len) & ~(uintptr_t)(ARENA_ALIGN - 1);
+    if (end < start + MIN_BLOCK + HEADER_SIZE)
+        return NULL;
+
+    arena_t *a = (arena_t *)mem;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&a->lock, &attr) != 0) {
+        pthread_mutexattr_destroy(&attr);
+        return NULL;
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    arena_block_t *first = (arena_block_t *)start;
+    first->size = (end - start) - HEADER_SIZE;
+    first->prev_size = 0;
+    first->used = 0;
+
+    arena_block_t *sentinel = next_block(first);
+    sentinel->size = 0;
+    sentinel->prev_size = first->size;
+    sentinel->used = 1;
+
+    a->free_list = NULL;
+    list_push(a, first);
+    a->capacity = first->size;
+    a->in_use = 0;
+    a->broken = 0;
+    return a;
+}
+
+/*
+ * Allocate
+ * Purpose: First-fit allocation; the chosen block is split when the rest is
+ * large enough to be useful.
+ *
+ * Return: Pointer aligned to ARENA_ALIGN, or NULL if no free block fits.
+ */
+void *arena_alloc(arena_t *a, size_t size)
+{
+    size_t need = HEADER_SIZE + ((size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+    if (need < MIN_BLOCK) need = MIN_BLOCK;
+
+    if (arena_lock(a) != 0) return NULL;
+    arena_block_t *b = a->free_list;
+    while (b && b->size < need)
+        b = b->next_free;
+    if (!b) {
+        pthread_mutex_unlock(&a->lock);
+        return NULL;
+    }
+    list_remove(a, b);
+
+    if (b->size - need >= MIN_BLOCK) {
+        arena_block_t *rest = (arena_block_t *)((char *)b + need);
+        rest->size = b->size - need;
+        rest->prev_size = need;
+        rest->used = 0;
+        next_block(rest)->prev_size = rest->size;
+        b->size = need;
+        list_push(a, rest);
+    }
+    b->used = 1;
+    a->in_use += b->size;
+    pthread_mutex_unlock(&a->lock);
+
+    return (char *)b + HEADER_SIZE;
+}
+
+/*
+ * Free
+ * Purpose: Returns a block, merging it with free neighbours on both sides
+ * so the region does not fragment into unusable slivers.
+ */
+void arena_free(arena_t *a, void *ptr)
+{
+    if (!ptr) return;
+    arena_block_t *b = (arena_block_t *)((char *)ptr - HEADER_SIZE);
+
+    if (arena_lock(a) != 0) return; /* Broken: the block is lost until reset */
+    a->in_use -= b->size;
+    b->used = 0;
+
+    arena_block_t *next = next_block(b);
+    if (!next->used) {
+        list_remove(a, next);
+        b->size += next->size;
+    }
+    if (b->prev_size != 0) {
+        arena_block_t *prev = prev_block(b);
+        if (!prev->used) {
+            list_remove(a, prev);
+            prev->size += b->size;
+            b = prev;
+        }
+    }
+    next_block(b)->prev_size = b->size;
+    list_push(a, b);
+    pthread_mutex_unlock(&a->lock);
+}
@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Shared Memory Arena
+ * A first-fit allocator with boundary tags that manages a fixed region,
+ * typically a MAP_SHARED mapping created before fork(). The region is
+ * inherited at the same address by every worker, so plain pointers into it
+ * stay valid across processes. A process-shared mutex serializes alloc/free.
+ * The mutex is robust: if a process dies holding it, the next caller marks
+ * the arena 'broken' (its lists may be half-updated) and from then on
+ * allocations fail and frees are ignored until arena_create() lays the
+ * region out again.
+ */
+typedef struct arena_block arena_block_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    arena_block_t *free_list;
+    size_t capacity; /* Bytes managed, including block headers */
+    size_t in_use;   /* Bytes in allocated blocks, including headers */
+    int broken;      /* A holder of 'lock' died mid-update */
+} arena_t;
+
+arena_t *arena_create(void *mem, size_t len);
+void *arena_alloc(arena_t *arena, size_t size);
+void arena_free(arena_t *arena, void *ptr);
+
+#endif
@@ -3,20 +3,106 @@
 #include <string.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
+#define CACHE_BUCKETS 4096
+#define CACHE_SHARDS 16 /* Independently locked slices of the hash table */
+#define CACHE_MAX_ENTRY (1 * 1024 * 1024) /* Hard limit for a single file */
+#define CACHE_REF_BYTES 256 /* One entry slot per this many bytes of cache size */
+#define CACHE_MAX_CLIENTS 1024 /* Threads tracked by the shared cache */
 
 /* * Global Cache State
- * Protected by cache_lock for thread safety.
- * Implements an LRU (Least Recently Used) policy using a doubly-linked list
- * combined with a hash table for O(1) lookups.
+ * A hash table for O(1) lookups, split into CACHE_SHARDS shards: bucket b
+ * belongs to shard b % CACHE_SHARDS, whose rwlock guards its chains. Hits
+ * only take their shard's read lock.
+ *
+ * Replacement uses CLOCK (second chance) instead of strict LRU: all entries
+ * sit on a circular list swept by a hand. A hit just sets the entry's
+ * 'referenced' bit; when space is needed, the hand clears set bits and
+ * evicts the first entry whose bit is already clear. The ring, the hand and
+ * current_size are guarded by clock_lock.
+ *
+ * Lock order: clock_lock, then a shard lock. Lookups take a shard lock only.
+ *
+ * Each entry's mutable state (reference count, CLOCK bit) is a slot in the
+ * 'refs' array rather than part of the entry's own allocation. A hit then
+ * writes only to that dense array, never to the pages holding headers and
+ * bodies: a private cache preloaded by the Master stays shared copy-on-write
+ * with the workers, except for the slots (8 bytes per entry) and the ring
+ * and chain links of entries next to ones a worker inserts or evicts. A
+ * slot is free while its count is zero; there are max_size /
+ * CACHE_REF_BYTES + CACHE_BUCKETS of them, and an insert that finds none
+ * free evicts like one that finds no memory.
+ *
+ * 'generation' counts invalidations (changed files). A miss records it
+ * before reading the file and inserts only if it is unchanged, so bytes read
+ * just before a change can never be cached after its invalidation.
+ *
+ * The state lives either in process-private memory (one cache per worker)
+ * or, for the shared cache, at the start of a MAP_SHARED region created by
+ * the Master before fork(): every worker then sees the same table, ring and
+ * entries at the same addresses, and the locks are process-shared.
+ *
+ * A worker can die at any point of a shared cache call, or while it holds
+ * entries. Its locks are therefore robust mutexes (a shard uses one instead
+ * of an rwlock, which cannot be robust): the next thread to lock one left
+ * by a dead owner gets EOWNERDEAD instead of hanging. What the lock guarded
+ * may be half-updated, so the cache is then 'poisoned': every call treats it
+ * as empty and requests are served from disk. Each thread also publishes in
+ * a client slot whether it is inside a cache call and how many entries it
+ * has borrowed; the Master's cache_recover_shared() poisons the cache when a
+ * dead process left either behind (its references would never be dropped),
+ * and lays the region out afresh once no live thread is inside or holds an
+ * entry.
  */
-static cache_node_t **htable = NULL;    /* Hash table buckets */
-static size_t hsize = 0;                /* Number of buckets */
-static cache_node_t *head = NULL;       /* MRU (Most Recently Used) end of list */
-static cache_node_t *tail = NULL;       /* LRU (Least Recently Used) end of list */
-static size_t current_size = 0;         /* Current total size of cached data in bytes */
-static size_t max_size = 0;             /* Max allowed cache size in bytes */
-static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+typedef struct {
+    union {
+        pthread_rwlock_t rw; /* Private cache */
+        pthread_mutex_t mx;  /* Shared cache: robust */
+    } lock;
+} __attribute__((aligned(64))) cache_shard_t; /* One cache line per lock */
+
+typedef struct cache_ref {
+    int refcount;   /* Cache's reference (while indexed) + borrowed handles */
+    int referenced; /* CLOCK bit: set by hits, cleared by the hand */
+} cache_ref_t;
+
+/* One thread using the shared cache (see cache_enter) */
+typedef struct {
+    pid_t pid;     /* Process of the thread (0: slot released) */
+    int inside;    /* Cache calls in progress */
+    long borrowed; /* Entries acquired and not yet released */
+} __attribute__((aligned(64))) cache_client_t;
+
+typedef struct {
+    cache_shard_t shards[CACHE_SHARDS];
+    pthread_mutex_t clock_lock;
+    cache_node_t **htable;  /* Hash table buckets */
+    size_t hsize;           /* Number of buckets (multiple of CACHE_SHARDS) */
+    cache_node_t *hand;     /* Next CLOCK candidate (NULL when empty) */
+    size_t current_size;    /* Current total size of cached data in bytes */
+    size_t max_size;        /* Max allowed cache size in bytes */
+    unsigned long generation; /* Bumped by every invalidation */
+    cache_ref_t *refs;      /* Entry slots, apart from the entries themselves */
+    size_t nrefs;           /* Number of slots */
+    size_t ref_hint;        /* Where the next free-slot search starts */
+    arena_t *arena;         /* Allocator for the shared region (NULL: private) */
+    cache_client_t *clients; /* Shared cache: one slot per thread */
+    int clients_claimed;
+    int poisoned;           /* Shared cache unusable until the Master resets it */
+    size_t region_len;      /* Size of the shared mapping */
+    pid_t owner;            /* Process allowed to tear the shared cache down */
+} cache_state_t;
+
+static cache_state_t *cache = NULL;
+
+/* The calling thread's client slot, valid while it matches 'cache_instance' */
+static __thread cache_client_t *my_client = NULL;
+static __thread unsigned long my_client_instance = 0;
+static unsigned long cache_instance = 0; /* New shared cache, or new process */
 
 /*
  * Hash function (djb2 algorithm)
@@ -34,264 +120,882 @@ static unsigned long hash_str(const char *s)
 }
 
 /*
- * Helper to allocate the internal hash table.
- * Purpose: Ensures the hash table memory is allocated if not already present.
- * Parameters:
- * - size: Number of buckets to allocate.
- * Return: 0 on success, -1 on allocation failure.
+ * Lock setup helper.
+ * Purpose: Initializes the shard locks and clock_lock: rwlocks and a plain
+ * mutex for a private cache, robust process-shared mutexes for the shared
+ * cache.
+ * Return: 0 on success, -1 on failure.
  */
-static int ensure_table(size_t size)
+static int init_locks(cache_state_t *st, int pshared)
+{
+    pthread_rwlockattr_t rw_attr;
+    pthread_mutexattr_t mx_attr;
+    int rc = 0;
+
+    pthread_mutexattr_init(&mx_attr);
+    if (pshared) {
+        pthread_mutexattr_setpshared(&mx_attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mx_attr, PTHREAD_MUTEX_ROBUST);
+        for (int i = 0; i < CACHE_SHARDS && rc == 0; i++) {
+            rc = pthread_mutex_init(&st->shards[i].lock.mx, &mx_attr);
+        }
+    } else {
+        pthread_rwlockattr_init(&rw_attr);
+        for (int i = 0; i < CACHE_SHARDS && rc == 0; i++) {
+            rc = pthread_rwlock_init(&st->shards[i].lock.rw, &rw_attr);
+        }
+        pthread_rwlockattr_destroy(&rw_attr);
+    }
+    if (rc == 0) rc = pthread_mutex_init(&st->clock_lock, &mx_attr);
+    pthread_mutexattr_destroy(&mx_attr);
+
+    return rc == 0 ? 0 : -1;
+}
+
+/* Private cache only: shared locks go away with the region */
+static void destroy_locks(cache_state_t *st)
+{
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        pthread_rwlock_destroy(&st->shards[i].lock.rw);
+    }
+    pthread_mutex_destroy(&st->clock_lock);
+}
+
+/* Marks the shared cache unusable until cache_recover_shared() resets it */
+static void poison(void)
+{
+    __atomic_store_n(&cache->poisoned, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Mutex helper.
+ * Purpose: Locks clock_lock or a shared shard lock. If the owner died
+ * holding it, the mutex is made consistent and released again, and the
+ * cache poisoned, since the owner may have left what it guards half
+ * updated. Threads that were waiting on the lock then see the poison too.
+ * Return: 0 with the lock held, -1 (nothing held) otherwise.
+ */
+static int lock_mutex(pthread_mutex_t *m)
+{
+    int rc = pthread_mutex_lock(m);
+    if (rc == EOWNERDEAD) {
+        poison();
+        pthread_mutex_consistent(m);
+        pthread_mutex_unlock(m);
+        return -1;
+    }
+    if (rc != 0) return -1;
+    if (cache->arena && __atomic_load_n(&cache->poisoned, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_unlock(m);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Shard lock helpers.
+ * Purpose: Lock the shard holding 'hash' for reading or writing: the rwlock
+ * of a private cache, the robust mutex of the shared cache.
+ * Return: 0 with the lock held, -1 otherwise.
+ */
+static cache_shard_t *shard_of(unsigned long hash)
+{
+    return &cache->shards[(hash % cache->hsize) % CACHE_SHARDS];
+}
+
+static int shard_lock(unsigned long hash, int write)
+{
+    cache_shard_t *sh = shard_of(hash);
+    if (cache->arena) return lock_mutex(&sh->lock.mx);
+    int rc = write ? pthread_rwlock_wrlock(&sh->lock.rw) : pthread_rwlock_rdlock(&sh->lock.rw);
+    return rc == 0 ? 0 : -1;
+}
+
+static void shard_unlock(unsigned long hash)
+{
+    cache_shard_t *sh = shard_of(hash);
+    if (cache->arena) pthread_mutex_unlock(&sh->lock.mx);
+    else pthread_rwlock_unlock(&sh->lock.rw);
+}
+
+/*
+ * Client slot.
+ * Purpose: Returns the calling thread's slot in the shared cache, claiming
+ * one on first use. Past CACHE_MAX_CLIENTS threads share the last slot
+ * (its counters are atomic). A new shared cache or a fork() bumps
+ * 'cache_instance', so a thread never reuses a slot from before either.
+ */
+static cache_client_t *client_slot(void)
+{
+    if (my_client && my_client_instance == cache_instance) return my_client;
+    int i = __atomic_fetch_add(&cache->clients_claimed, 1, __ATOMIC_RELAXED);
+    my_client = &cache->clients[i < CACHE_MAX_CLIENTS ? i : CACHE_MAX_CLIENTS - 1];
+    my_client_instance = cache_instance;
+    __atomic_store_n(&my_client->pid, getpid(), __ATOMIC_RELAXED);
+    return my_client;
+}
+
+static void new_process(void)
+{
+    cache_instance++;
+}
+
+static void register_fork_hook(void)
+{
+    pthread_atfork(NULL, NULL, new_process);
+}
+
+/*
+ * Call guards.
+ * Purpose: Bracket every operation on the cache. For the shared cache,
+ * cache_enter() publishes that the thread is inside before it checks
+ * 'poisoned'; the Master sets 'poisoned' before it checks that no thread is
+ * inside. Both sides being sequentially consistent, either the thread sees
+ * the poison and backs out, or the Master sees the thread and waits.
+ * Return: 0 if the cache may be used, -1 if there is none or it is poisoned.
+ */
+static int cache_enter(void)
+{
+    if (!cache) return -1;
+    if (!cache->arena) return 0;
+    cache_client_t *cl = client_slot();
+    __atomic_add_fetch(&cl->inside, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cache->poisoned, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&cl->inside, 1, __ATOMIC_RELEASE);
+        return -1;
+    }
+    return 0;
+}
+
+static void cache_leave(void)
+{
+    if (cache->arena) __atomic_sub_fetch(&my_client->inside, 1, __ATOMIC_RELEASE);
+}
+
+/* Number of entry slots for a cache of 'max_size_bytes' */
+static size_t ref_slots(size_t max_size_bytes)
 {
-    if (htable) return 0;
-    hsize = size;
-    htable = calloc(hsize, sizeof(cache_node_t *));
-    return htable ? 0 : -1;
+    return max_size_bytes / CACHE_REF_BYTES + CACHE_BUCKETS;
 }
 
 /*
  * Initialize the cache system.
- * Purpose: Sets up the hash table, locks, and size limits.
+ * Purpose: Sets up a process-private cache: hash table, lock and size limit.
+ * Does nothing if a cache already exists (e.g. the shared cache the Master
+ * created before forking this worker).
  * Parameters:
  * - max_size_bytes: The maximum total size (in bytes) the cache can hold.
  * Return: 0 on success, -1 on failure.
  */
 int cache_init(size_t max_size_bytes)
 {
-    max_size = max_size_bytes;
-    current_size = 0;
-    head = tail = NULL;
-    if (pthread_rwlock_init(&cache_lock, NULL) != 0) return -1;
-    return ensure_table(4096);
+    if (cache) return 0;
+
+    cache_state_t *st = calloc(1, sizeof(cache_state_t));
+    if (!st) return -1;
+    st->max_size = max_size_bytes;
+    st->hsize = CACHE_BUCKETS;
+    st->htable = calloc(st->hsize, sizeof(cache_node_t *));
+
+    /* Own pages, never mixed with the heap blocks holding entries */
+    st->nrefs = ref_slots(max_size_bytes);
+    st->refs = mmap(NULL, st->nrefs * sizeof(cache_ref_t), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (st->refs == MAP_FAILED) st->refs = NULL;
+
+    if (!st->htable || !st->refs || init_locks(st, 0) != 0) {
+        if (st->refs) munmap(st->refs, st->nrefs * sizeof(cache_ref_t));
+        free(st->htable);
+        free(st);
+        return -1;
+    }
+    st->owner = getpid();
+    cache = st;
+    return 0;
+}
+
+/*
+ * Shared region layout.
+ * Purpose: Builds an empty shared cache in the region after the state and
+ * the client slots: a fresh arena, the bucket array, the entry slots and
+ * the locks. Used at creation and to reset a poisoned cache, discarding
+ * whatever the region held.
+ * Return: 0 on success, -1 on failure.
+ */
+static int layout_shared(cache_state_t *st)
+{
+    char *base = (char *)(st->clients + CACHE_MAX_CLIENTS);
+    st->arena = arena_create(base, (size_t)((char *)st + st->region_len - base));
+    if (!st->arena) return -1;
+
+    st->htable = arena_alloc(st->arena, st->hsize * sizeof(cache_node_t *));
+    st->refs = arena_alloc(st->arena, st->nrefs * sizeof(cache_ref_t));
+    if (!st->htable || !st->refs) return -1;
+    memset(st->htable, 0, st->hsize * sizeof(cache_node_t *));
+    memset(st->refs, 0, st->nrefs * sizeof(cache_ref_t));
+
+    st->hand = NULL;
+    st->current_size = 0;
+    st->ref_hint = 0;
+    return init_locks(st, 1);
+}
+
+/*
+ * Initialize the shared cache.
+ * Purpose: Creates one cache for all workers in an anonymous shared mapping.
+ * Must be called in the Master before the workers are forked.
+ * Parameters:
+ * - max_size_bytes: The maximum total size (in bytes) of cached data.
+ * Return: 0 on success, -1 on failure.
+ * Logic:
+ * 1. Maps a region sized for the data plus headroom for entry headers,
+ *    the bucket array, the entry slots and entries that are evicted but
+ *    still being sent.
+ * 2. Places the cache state and the client slots at its start and an
+ *    arena over the rest.
+ * 3. Initializes robust, PTHREAD_PROCESS_SHARED shard and clock locks.
+ */
+int cache_init_shared(size_t max_size_bytes)
+{
+    static pthread_once_t fork_hook = PTHREAD_ONCE_INIT;
+    if (cache) return -1;
+
+    size_t state_len = (sizeof(cache_state_t) + 63) & ~(size_t)63;
+    size_t nrefs = ref_slots(max_size_bytes);
+    size_t region_len = state_len + CACHE_MAX_CLIENTS * sizeof(cache_client_t) +
+                        CACHE_BUCKETS * sizeof(cache_node_t *) + nrefs * sizeof(cache_ref_t) +
+                        max_size_bytes + max_size_bytes / 4 + 2 * CACHE_MAX_ENTRY;
+    void *mem = mmap(NULL, region_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return -1;
+
+    /* Anonymous mappings are zero-filled: no client slot is claimed yet */
+    cache_state_t *st = (cache_state_t *)mem;
+    st->clients = (cache_client_t *)((char *)mem + state_len);
+    st->hsize = CACHE_BUCKETS;
+    st->nrefs = nrefs;
+    st->max_size = max_size_bytes;
+    st->region_len = region_len;
+    if (layout_shared(st) != 0) {
+        munmap(mem, region_len);
+        return -1;
+    }
+
+    pthread_once(&fork_hook, register_fork_hook);
+    cache_instance++;
+    st->owner = getpid();
+    cache = st;
+    return 0;
+}
+
+/*
+ * Reference helpers.
+ * Purpose: Entries are shared between the cache and the threads sending
+ * them, so their lifetime is managed with an atomic reference count rather
+ * than by the cache lock: dropping the last reference frees the entry,
+ * whether that is the cache (eviction) or the last reader (release). The
+ * count reaching zero also frees the entry's slot.
+ */
+static void node_free(cache_node_t *n)
+{
+    if (n->arena) arena_free(n->arena, n);
+    else free(n);
+}
+
+static void node_unref(cache_node_t *n)
+{
+    if (__atomic_sub_fetch(&n->ref->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+        node_free(n);
+}
+
+/*
+ * Slot allocator.
+ * Purpose: Claims a free slot (count zero) for a new entry, holding the
+ * cache's reference. Searches round-robin from the last claim.
+ * Return: The slot, or NULL if every slot is in use.
+ */
+static cache_ref_t *ref_alloc(void)
+{
+    size_t start = __atomic_load_n(&cache->ref_hint, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < cache->nrefs; i++) {
+        size_t k = (start + i) % cache->nrefs;
+        cache_ref_t *r = &cache->refs[k];
+        int zero = 0;
+        if (__atomic_load_n(&r->refcount, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&r->refcount, &zero, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&cache->ref_hint, k + 1, __ATOMIC_RELAXED);
+            r->referenced = 0; /* Must be hit once to earn a second chance */
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/* Representation helpers for node_create() */
+static size_t rep_size(const cache_rep_t *r)
+{
+    return r ? r->hdr_len + r->len : 0;
+}
+
+/* Copies one representation to 'p'; returns the end of the copy */
+static char *rep_copy(char *p, const cache_rep_t *r, char **hdr, size_t *hdr_len,
+                      char **data, size_t *len)
+{
+    *hdr = NULL;
+    *hdr_len = 0;
+    *data = NULL;
+    *len = 0;
+    if (!r) return p;
+    if (r->hdr_len) {
+        *hdr = p;
+        *hdr_len = r->hdr_len;
+        memcpy(p, r->hdr, r->hdr_len);
+        p += r->hdr_len;
+    }
+    *data = p;
+    *len = r->len;
+    memcpy(p, r->data, r->len);
+    return p + r->len;
+}
+
+/*
+ * Entry constructor.
+ * Purpose: Allocates node, path and representations as one block (from the
+ * shared arena or the heap), claims a slot for it and fills it in. The
+ * entry is not linked anywhere yet.
+ * Return: The new entry holding one reference, or NULL if out of memory
+ * or slots.
+ */
+static cache_node_t *node_create(const char *path, const cache_rep_t *identity, const cache_rep_t *gzip)
+{
+    size_t path_len = strlen(path) + 1;
+    size_t total = sizeof(cache_node_t) + path_len + rep_size(identity) + rep_size(gzip);
+    cache_node_t *n = cache->arena ? arena_alloc(cache->arena, total) : malloc(total);
+    if (!n) return NULL;
+    n->ref = ref_alloc(); /* The cache's own reference */
+    if (!n->ref) {
+        node_free(n);
+        return NULL;
+    }
+
+    n->path = (char *)(n + 1);
+    memcpy(n->path, path, path_len);
+    char *p = n->path + path_len;
+    p = rep_copy(p, identity, &n->hdr, &n->hdr_len, &n->data, &n->len);
+    rep_copy(p, gzip, &n->gz_hdr, &n->gz_hdr_len, &n->gz_data, &n->gz_len);
+    n->hash = hash_str(path);
+    n->arena = cache->arena;
+    n->prev = n->next = n->hnext = NULL;
+    return n;
+}
+
+/* Bytes an entry counts against max_size (both representations) */
+static size_t node_size(const cache_node_t *n)
+{
+    return n->hdr_len + n->len + n->gz_hdr_len + n->gz_len;
 }
 
 /*
  * Destroy the cache system.
- * Purpose: Frees all memory associated with cache nodes, data buffers, 
- * and the hash table itself. Destroys the lock.
- * Synchronization: Acquires write lock to ensure no other thread accesses memory while freeing.
+ * Purpose: Frees all memory associated with cache nodes, data buffers,
+ * and the hash table itself. Destroys the lock. Entries still borrowed are
+ * freed by their last cache_release(), so the slot array is only unmapped
+ * when none are left.
+ * For the shared cache only the creating process (the Master) releases the
+ * region; workers just detach from it.
+ * Synchronization: Must not race with other cache calls (called at shutdown).
  */
 void cache_destroy()
 {
-    if (!htable) return;
-    pthread_rwlock_wrlock(&cache_lock);
-    for (size_t i = 0; i < hsize; i++) {
-        cache_node_t *n = htable[i];
+    if (!cache) return;
+    cache_state_t *st = cache;
+    cache = NULL;
+
+    if (st->arena) {
+        if (st->owner == getpid()) munmap(st, st->region_len);
+        return;
+    }
+
+    for (size_t i = 0; i < st->hsize; i++) {
+        cache_node_t *n = st->htable[i];
         while (n) {
             cache_node_t *next = n->hnext;
-            free(n->path);
-            free(n->data);
-            free(n);
+            node_unref(n); /* Outstanding handles keep their entry alive */
             n = next;
         }
-        htable[i] = NULL;
+        st->htable[i] = NULL;
+    }
+    size_t in_use = 0;
+    for (size_t i = 0; i < st->nrefs; i++) {
+        in_use += __atomic_load_n(&st->refs[i].refcount, __ATOMIC_RELAXED) != 0;
     }
-    free(htable);
-    htable = NULL;
-    head = tail = NULL;
-    current_size = 0;
-    pthread_rwlock_unlock(&cache_lock);
-    pthread_rwlock_destroy(&cache_lock);
+    if (in_use == 0) munmap(st->refs, st->nrefs * sizeof(cache_ref_t));
+    free(st->htable);
+    destroy_locks(st);
+    free(st);
 }
 
 /*
- * Internal list helper.
- * Purpose: Unlinks a node from the doubly-linked LRU list.
- * Note: Caller must hold the write lock.
+ * CLOCK ring helpers.
+ * Purpose: Insert behind the hand (so a new entry is examined last) and
+ * remove, moving the hand along if it pointed at the removed entry.
+ * Note: Caller must hold clock_lock.
  */
-static void remove_from_list(cache_node_t *n)
+static void ring_insert(cache_node_t *n)
+{
+    cache_node_t *hand = cache->hand;
+    if (!hand) {
+        n->prev = n->next = n;
+        cache->hand = n;
+        return;
+    }
+    n->next = hand;
+    n->prev = hand->prev;
+    hand->prev->next = n;
+    hand->prev = n;
+}
+
+static void ring_remove(cache_node_t *n)
 {
-    if (!n) return;
-    if (n->prev) n->prev->next = n->next; else head = n->next;
-    if (n->next) n->next->prev = n->prev; else tail = n->prev;
+    if (n->next == n) {
+        cache->hand = NULL;
+    } else {
+        n->prev->next = n->next;
+        n->next->prev = n->prev;
+        if (cache->hand == n) cache->hand = n->next;
+    }
     n->prev = n->next = NULL;
 }
 
 /*
- * Internal list helper.
- * Purpose: Inserts a node at the front (Head) of the list, making it the MRU node.
- * Note: Caller must hold the write lock.
+ * Internal lookup helper.
+ * Purpose: Finds the entry for a path in its hash chain.
+ * Note: Caller must hold the entry's shard lock (read or write).
  */
-static void insert_at_head(cache_node_t *n)
+static cache_node_t *find_node(const char *path, unsigned long hash)
 {
-    n->prev = NULL;
-    n->next = head;
-    if (head) head->prev = n;
-    head = n;
-    if (!tail) tail = n;
+    cache_node_t *n = cache->htable[hash % cache->hsize];
+    while (n) {
+        if (n->hash == hash && strcmp(n->path, path) == 0) break;
+        n = n->hnext;
+    }
+    return n;
 }
 
 /*
- * LRU Eviction Logic.
- * Purpose: Removes nodes from the tail (Least Recently Used) until the total cache size 
- * is within limits.
- * Note: Caller must hold the write lock.
+ * Internal chain helper.
+ * Purpose: Unlinks a node from its hash chain.
+ * Note: Caller must hold the entry's shard write lock.
  */
-static void evict_if_needed()
+static void unlink_chain(cache_node_t *n)
 {
-    while (current_size > max_size && tail) {
-        cache_node_t *n = tail;
-        
-        /* Find and remove from hash chain */
-        unsigned long h = hash_str(n->path) % hsize;
-        cache_node_t *prev = NULL;
-        cache_node_t *iter = htable[h];
-        while (iter) {
-            if (iter == n) {
-                if (prev) prev->hnext = iter->hnext; else htable[h] = iter->hnext;
-                break;
-            }
-            prev = iter; iter = iter->hnext;
+    cache_node_t **link = &cache->htable[n->hash % cache->hsize];
+    while (*link) {
+        if (*link == n) {
+            *link = n->hnext;
+            break;
         }
+        link = &(*link)->hnext;
+    }
+}
+
+/*
+ * Detach an entry.
+ * Purpose: Removes a node from its hash chain and the CLOCK ring and drops
+ * the cache's reference. Readers still holding the entry keep it alive; its
+ * memory is released by whichever side lets go last.
+ * Return: 0 on success, -1 if the shard could not be locked (poisoned).
+ * Note: Caller must hold clock_lock (and not the entry's shard lock).
+ */
+static int detach_node(cache_node_t *n)
+{
+    if (shard_lock(n->hash, 1) != 0) return -1;
+    unlink_chain(n);
+    shard_unlock(n->hash);
+
+    ring_remove(n);
+    cache->current_size -= node_size(n);
+    node_unref(n);
+    return 0;
+}
 
-        remove_from_list(n);
-        current_size -= n->len;
-        
-        free(n->path);
-        free(n->data);
-        free(n);
+/*
+ * CLOCK Eviction.
+ * Purpose: Advances the hand, giving referenced entries a second chance
+ * (clearing their bit), and evicts the first unreferenced one.
+ * Return: 1 if an entry was evicted, 0 if the cache is empty (or poisoned).
+ * Note: Caller must hold clock_lock.
+ */
+static int evict_one()
+{
+    while (cache->hand) {
+        cache_node_t *n = cache->hand;
+        if (__atomic_exchange_n(&n->ref->referenced, 0, __ATOMIC_RELAXED)) {
+            cache->hand = n->next;
+            continue;
+        }
+        return detach_node(n) == 0;
     }
+    return 0;
+}
+
+/*
+ * Eviction Logic.
+ * Purpose: Evicts entries until the total cache size is within limits.
+ * Note: Caller must hold clock_lock.
+ */
+static void evict_if_needed()
+{
+    while (cache->current_size > cache->max_size && evict_one())
+        ;
 }
 
 /*
- * Retrieve data from the cache.
- * Purpose: Looks up a file by path. If found, returns a copy of the data and promotes the 
- * node to the head of the list (MRU).
+ * Borrow a cache entry.
+ * Purpose: Looks up a file by path and, on a hit, returns the entry itself
+ * with a reference held and its CLOCK bit set. The caller sends straight
+ * from entry->data and must call cache_release().
  * Parameters:
  * - path: The file path key.
- * - out_buf: Pointer to store the address of the allocated data copy.
- * - out_len: Pointer to store the size of the data.
- * Return: 0 on success (hit), -1 on failure (miss).
- * Synchronization: 
- * 1. Acquires Read Lock to check existence.
- * 2. If found, upgrades to Write Lock to update LRU position (move to head).
+ * Return: The entry on a hit, NULL on a miss.
+ * Synchronization: Only the shard's read lock (for the shared cache, its
+ * mutex) is taken, so hits in different shards proceed in parallel. The
+ * bit and the reference count are updated atomically in the entry's slot;
+ * an entry cannot be unlinked (which needs the shard's write lock) while
+ * the shard is locked.
  */
-int cache_get(const char *path, char **out_buf, size_t *out_len)
+const cache_node_t *cache_acquire(const char *path)
 {
-    if (!htable) return -1;
-    unsigned long h = hash_str(path) % hsize;
+    if (cache_enter() != 0) return NULL;
+    unsigned long h = hash_str(path);
 
-    /* Optimistic read: acquire read lock first */
-    if (pthread_rwlock_rdlock(&cache_lock) != 0) return -1;
-    cache_node_t *n = htable[h];
-    while (n) {
-        if (strcmp(n->path, path) == 0) break;
-        n = n->hnext;
+    if (shard_lock(h, 0) != 0) {
+        cache_leave();
+        return NULL;
     }
-    if (!n) {
-        pthread_rwlock_unlock(&cache_lock);
-        return -1; /* Cache miss */
+    cache_node_t *n = find_node(path, h);
+    if (n) {
+        /* Second chance; skip the store when already set to keep the line shared */
+        if (!__atomic_load_n(&n->ref->referenced, __ATOMIC_RELAXED))
+            __atomic_store_n(&n->ref->referenced, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&n->ref->refcount, 1, __ATOMIC_RELAXED);
+        if (cache->arena) __atomic_add_fetch(&my_client->borrowed, 1, __ATOMIC_RELAXED);
     }
+    shard_unlock(h);
 
-    /* * Cache hit: We need to modify the list order (promote to head).
-     * We must release the read lock and acquire the write lock.
-     */
-    pthread_rwlock_unlock(&cache_lock);
-
-    if (pthread_rwlock_wrlock(&cache_lock) != 0) return -1;
+    cache_leave();
+    return n;
+}
 
-    /* Re-verify availability after re-locking (race condition check) */
-    cache_node_t *n2 = htable[h];
-    while (n2) {
-        if (strcmp(n2->path, path) == 0) break;
-        n2 = n2->hnext;
+/*
+ * Return a borrowed entry.
+ * Purpose: Drops the reference taken by cache_acquire(). If the entry was
+ * evicted or replaced in the meantime, this frees it. An entry of a
+ * poisoned shared cache is left alone: the reset reclaims its memory.
+ */
+void cache_release(const cache_node_t *entry)
+{
+    if (!entry) return;
+    cache_node_t *n = (cache_node_t *)entry;
+    if (!n->arena) {
+        node_unref(n);
+        return;
     }
-    if (!n2) {
-        pthread_rwlock_unlock(&cache_lock);
-        return -1;
+    if (cache_enter() == 0) {
+        node_unref(n);
+        cache_leave();
     }
+    if (my_client) __atomic_sub_fetch(&my_client->borrowed, 1, __ATOMIC_RELAXED);
+}
 
-    /* Move to MRU position */
-    remove_from_list(n2);
-    insert_at_head(n2);
+/*
+ * Retrieve a copy of cached data.
+ * Purpose: Convenience wrapper over cache_acquire() for callers that want
+ * to own the bytes.
+ * Parameters:
+ * - path: The file path key.
+ * - out_buf: Pointer to store the address of the allocated data copy.
+ * - out_len: Pointer to store the size of the data.
+ * Return: 0 on success (hit), -1 on failure (miss).
+ */
+int cache_get(const char *path, char **out_buf, size_t *out_len)
+{
+    const cache_node_t *n = cache_acquire(path);
+    if (!n) return -1;
 
-    /* Return a deep copy so the caller owns the memory */
-    char *buf = malloc(n2->len);
+    char *buf = malloc(n->len);
     if (!buf) {
-        pthread_rwlock_unlock(&cache_lock);
+        cache_release(n);
         return -1;
     }
-    memcpy(buf, n2->data, n2->len);
+    memcpy(buf, n->data, n->len);
     *out_buf = buf;
-    *out_len = n2->len;
-    
-    pthread_rwlock_unlock(&cache_lock);
+    *out_len = n->len;
+
+    cache_release(n);
     return 0;
 }
 
 /*
  * Insert or update data in the cache.
- * Purpose: Adds new data or updates existing data for a path. Handles LRU eviction
- * if the cache exceeds the size limit.
+ * Purpose: Adds new data or replaces the existing entry for a path. Runs
+ * CLOCK eviction if the cache exceeds the size limit.
  * Parameters:
  * - path: The file path key.
  * - buf: Data to cache.
  * - len: Length of the data.
  * Return: 0 on success, -1 on failure.
- * Synchronization: Acquires Write Lock immediately since this modifies the structure.
  */
 int cache_put(const char *path, const char *buf, size_t len)
 {
-    if (!htable) return -1;
-    if (len == 0 || !buf) return -1;
-    
+    cache_rep_t identity = { NULL, 0, buf, len };
+    return cache_put_entry(path, &identity, NULL);
+}
+
+/*
+ * Insert an entry with its response headers.
+ * Purpose: Like cache_put(), but also stores the serialized header block
+ * to send with the data, so hits need no formatting, and optionally a
+ * gzip-encoded variant. Header and variant bytes count towards the cache
+ * size.
+ * Parameters:
+ * - identity: Raw body and its header block (hdr may be NULL/0).
+ * - gzip: Compressed variant, or NULL.
+ * Return: 0 on success, -1 on failure.
+ * Synchronization: Copies the data first, then takes clock_lock and the
+ * shard's write lock only to link the entry in. If there is no memory (the
+ * shared arena is full or fragmented) or no free slot, entries are evicted
+ * until the new one fits.
+ */
+int cache_put_entry(const char *path, const cache_rep_t *identity, const cache_rep_t *gzip)
+{
+    return cache_put_current(path, identity, gzip, cache_generation());
+}
+
+/*
+ * Insert an entry read at a known generation.
+ * Purpose: cache_put_entry() for data read from disk: 'generation' is the
+ * value of cache_generation() taken before the file was read. If anything
+ * was invalidated since, the data may predate a change and is not inserted.
+ * Return: 0 on success, -1 on failure (or stale data).
+ */
+int cache_put_current(const char *path, const cache_rep_t *identity, const cache_rep_t *gzip,
+                      unsigned long generation)
+{
+    if (!identity || identity->len == 0 || !identity->data) return -1;
+
     /* Enforce hard limit for single file size (1MB) */
-    if (len > (1 * 1024 * 1024)) return -1;
+    if (identity->len > CACHE_MAX_ENTRY) return -1;
+    if (cache_enter() != 0) return -1;
 
-    if (pthread_rwlock_wrlock(&cache_lock) != 0) return -1;
-    unsigned long h = hash_str(path) % hsize;
+    /* Build the new (immutable) entry before taking any lock */
+    cache_node_t *node = node_create(path, identity, gzip);
 
-    /* Check if node already exists */
-    cache_node_t *n = htable[h];
-    while (n) {
-        if (strcmp(n->path, path) == 0) break;
-        n = n->hnext;
+    if (lock_mutex(&cache->clock_lock) != 0) {
+        if (node) node_unref(node);
+        cache_leave();
+        return -1;
+    }
+    while (!node && evict_one()) {
+        node = node_create(path, identity, gzip);
+    }
+    if (!node && cache->arena && __atomic_load_n(&cache->arena->broken, __ATOMIC_RELAXED))
+        poison(); /* Evicting frees nothing any more: wait for the reset */
+    if (!node || cache->generation != generation || shard_lock(node->hash, 1) != 0) {
+        pthread_mutex_unlock(&cache->clock_lock);
+        if (node) node_unref(node);
+        cache_leave();
+        return -1;
     }
 
-    if (n) {
-        /* Node exists: Update data and promote to head */
-        current_size -= n->len;
-        free(n->data);
-        n->data = malloc(len);
-        if (!n->data) {
-            pthread_rwlock_unlock(&cache_lock);
-            return -1;
-        }
-        memcpy(n->data, buf, len);
-        n->len = len;
-        current_size += len;
-        
-        remove_from_list(n);
-        insert_at_head(n);
-        evict_if_needed();
-        
-        pthread_rwlock_unlock(&cache_lock);
-        return 0;
+    /* An existing version is replaced, never modified: readers keep the old bytes */
+    cache_node_t *old = find_node(path, node->hash);
+    if (old) {
+        unlink_chain(old);
     }
+    unsigned long h = node->hash % cache->hsize;
+    node->hnext = cache->htable[h];
+    cache->htable[h] = node;
+    shard_unlock(node->hash);
 
-    /* Create new node */
-    cache_node_t *node = malloc(sizeof(cache_node_t));
-    if (!node) { pthread_rwlock_unlock(&cache_lock); return -1; }
-    
-    node->path = strdup(path);
-    node->data = malloc(len);
-    if (!node->path || !node->data) {
-        free(node->path); free(node->data); free(node);
-        pthread_rwlock_unlock(&cache_lock);
-        return -1;
+    if (old) {
+        ring_remove(old);
+        cache->current_size -= node_size(old);
+        node_unref(old);
     }
-    
-    memcpy(node->data, buf, len);
-    node->len = len;
-    
-    /* Setup links */
-    node->prev = node->next = NULL;
-    node->hnext = htable[h];
-    htable[h] = node;
-    
-    insert_at_head(node);
-    current_size += len;
+
+    ring_insert(node);
+    cache->current_size += node_size(node);
     evict_if_needed();
-    
-    pthread_rwlock_unlock(&cache_lock);
+
+    pthread_mutex_unlock(&cache->clock_lock);
+    cache_leave();
     return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * Current invalidation generation.
+ * Purpose: Read before loading a file from disk; see cache_put_current().
+ */
+unsigned long cache_generation(void)
+{
+    if (!cache) return 0;
+    return __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+}
+
+/* Subtree predicate for cache_invalidate(): 'path' lies below directory 'arg' */
+static int under_dir(const char *path, void *arg)
+{
+    const char *dir = arg;
+    size_t len = strlen(dir);
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+/*
+ * Internal invalidation helper.
+ * Purpose: Detaches every entry whose path matches. Chains are only
+ * relinked by holders of clock_lock, so they can be walked without the
+ * shard locks here.
+ * Note: Caller must hold clock_lock.
+ */
+static int drop_matching(int (*match)(const char *path, void *arg), void *arg)
+{
+    int dropped = 0;
+    for (size_t b = 0; b < cache->hsize; b++) {
+        cache_node_t *n = cache->htable[b];
+        while (n) {
+            cache_node_t *next = n->hnext;
+            if (match(n->path, arg) && detach_node(n) == 0) {
+                dropped++;
+            }
+            n = next;
+        }
+    }
+    return dropped;
+}
+
+/*
+ * Invalidate cached files.
+ * Purpose: Drops the entry for 'path' after the file changed on disk. With
+ * 'subtree' set, 'path' is a directory and every entry below it is dropped
+ * (directory removed or renamed). Readers holding an entry keep its bytes
+ * until they release it; the next request misses and reads the new file.
+ * Parameters:
+ * - path: Cache key (file path) or directory path, without trailing '/'.
+ * - subtree: 0 for one file, 1 for a whole directory.
+ * Return: The number of entries dropped.
+ * Synchronization: Takes clock_lock, then each affected shard's write lock.
+ * The generation is bumped first, even when nothing was cached (or the
+ * cache is poisoned), which makes concurrent misses for the old file
+ * discard what they read.
+ */
+int cache_invalidate(const char *path, int subtree)
+{
+    if (!cache) return 0;
+    __atomic_add_fetch(&cache->generation, 1, __ATOMIC_RELEASE);
+    if (cache_enter() != 0) return 0;
+    if (lock_mutex(&cache->clock_lock) != 0) {
+        cache_leave();
+        return 0;
+    }
+
+    int dropped = 0;
+    if (!subtree) {
+        unsigned long h = hash_str(path);
+        cache_node_t *n = NULL;
+        if (shard_lock(h, 0) == 0) {
+            n = find_node(path, h);
+            shard_unlock(h);
+        }
+        /* Still linked: only clock_lock holders unlink, and we hold it */
+        if (n && detach_node(n) == 0) {
+            dropped = 1;
+        }
+    } else {
+        dropped = drop_matching(under_dir, (void *)path);
+    }
+
+    pthread_mutex_unlock(&cache->clock_lock);
+    cache_leave();
+    return dropped;
+}
+
+/*
+ * Invalidate entries by predicate.
+ * Purpose: Drops every entry whose path 'stale' accepts, e.g. files that
+ * changed while no watcher was running yet.
+ * Return: The number of entries dropped.
+ * Synchronization: As cache_invalidate(); 'stale' runs under clock_lock,
+ * so inserts wait for the whole pass.
+ */
+int cache_invalidate_if(int (*stale)(const char *path, void *arg), void *arg)
+{
+    if (!cache) return 0;
+    __atomic_add_fetch(&cache->generation, 1, __ATOMIC_RELEASE);
+    if (cache_enter() != 0) return 0;
+    if (lock_mutex(&cache->clock_lock) != 0) {
+        cache_leave();
+        return 0;
+    }
+    int dropped = drop_matching(stale, arg);
+    pthread_mutex_unlock(&cache->clock_lock);
+    cache_leave();
+    return dropped;
+}
+
+/*
+ * Recover the shared cache.
+ * Purpose: Called periodically by the Master. Poisons the cache when a dead
+ * process left a call in progress or entries borrowed (or killed the arena
+ * lock's owner), and resets a poisoned cache to empty once no live thread
+ * is inside it or holds one of its entries.
+ * Parameters:
+ * - alive: Tells whether a process (worker or Master) is still running.
+ * Return: 1 if the cache was reset, 0 otherwise.
+ * Synchronization: Runs concurrently with the workers' calls; see
+ * cache_enter() for why none of them touches the region during the reset.
+ */
+int cache_recover_shared(int (*alive)(pid_t pid))
+{
+    if (!cache || !cache->arena) return 0;
+    int claimed = __atomic_load_n(&cache->clients_claimed, __ATOMIC_RELAXED);
+    if (claimed > CACHE_MAX_CLIENTS) claimed = CACHE_MAX_CLIENTS;
+
+    /* 1. Anything a dead process left behind poisons the cache */
+    for (int i = 0; i < claimed; i++) {
+        cache_client_t *cl = &cache->clients[i];
+        pid_t pid = __atomic_load_n(&cl->pid, __ATOMIC_RELAXED);
+        if (pid == 0 || alive(pid)) continue;
+        if (__atomic_load_n(&cl->inside, __ATOMIC_RELAXED) != 0 ||
+            __atomic_load_n(&cl->borrowed, __ATOMIC_RELAXED) != 0)
+            poison();
+    }
+    if (__atomic_load_n(&cache->arena->broken, __ATOMIC_RELAXED)) poison();
+    if (!__atomic_load_n(&cache->poisoned, __ATOMIC_SEQ_CST)) return 0;
+
+    /* 2. Wait until the live threads are outside and have returned their entries */
+    long borrowed = 0;
+    for (int i = 0; i < claimed; i++) {
+        cache_client_t *cl = &cache->clients[i];
+        pid_t pid = __atomic_load_n(&cl->pid, __ATOMIC_RELAXED);
+        if (pid == 0 || !alive(pid)) continue;
+        if (__atomic_load_n(&cl->inside, __ATOMIC_SEQ_CST) != 0) return 0;
+        borrowed += __atomic_load_n(&cl->borrowed, __ATOMIC_RELAXED);
+    }
+    if (borrowed != 0) return 0;
+
+    /* 3. Start over with an empty cache; the dead processes' slots are released */
+    if (layout_shared(cache) != 0) return 0;
+    for (int i = 0; i < claimed; i++) {
+        cache_client_t *cl = &cache->clients[i];
+        pid_t pid = __atomic_load_n(&cl->pid, __ATOMIC_RELAXED);
+        if (pid != 0 && !alive(pid)) {
+            cl->inside = 0;
+            cl->borrowed = 0;
+            __atomic_store_n(&cl->pid, 0, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_add_fetch(&cache->generation, 1, __ATOMIC_RELEASE); /* Misses in flight are stale */
+    __atomic_store_n(&cache->poisoned, 0, __ATOMIC_SEQ_CST);
+    return 1;
+}
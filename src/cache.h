@@ -2,20 +2,61 @@
 #define CACHE_H
 
 #include <stddef.h>
+#include <sys/types.h>
+#include "arena.h"
 
+/*
+ * Cache Entry
+ * Immutable once inserted: a newer version of a file replaces the entry
+ * instead of overwriting it. Node, path and both representations share one
+ * allocation. What hits do change, the reference count and the CLOCK bit,
+ * lives in a separate slot ('ref', see cache.c), so serving an entry never
+ * writes to its pages. 'hdr' optionally holds the response header block for the
+ * entry, serialized when it was inserted (see http_format_entity_header).
+ * A gzip-encoded variant of the body, with its own header block, may be
+ * stored next to the identity bytes.
+ */
 typedef struct cache_node {
     char *path;
     char *data;
     size_t len;
-    struct cache_node *prev, *next;
+    char *hdr;            /* Pre-built header block (NULL if none) */
+    size_t hdr_len;
+    char *gz_data;        /* Gzip variant of 'data' (NULL if none) */
+    size_t gz_len;
+    char *gz_hdr;         /* Header block for the gzip variant */
+    size_t gz_hdr_len;
+    unsigned long hash;
+    struct cache_ref *ref; /* Reference count and CLOCK bit */
+    arena_t *arena;       /* Shared arena the entry lives in (NULL: malloc) */
+    struct cache_node *prev, *next; /* CLOCK ring */
     struct cache_node *hnext; 
 } cache_node_t;
 
+/* One representation of a file to store: header block + body */
+typedef struct {
+    const char *hdr;
+    size_t hdr_len;
+    const char *data;
+    size_t len;
+} cache_rep_t;
+
 int cache_init(size_t max_size_bytes);
+int cache_init_shared(size_t max_size_bytes);
 void cache_destroy();
 
 int cache_get(const char *path, char **out_buf, size_t *out_len);
+const cache_node_t *cache_acquire(const char *path);
+void cache_release(const cache_node_t *entry);
 
 int cache_put(const char *path, const char *buf, size_t len);
+int cache_put_entry(const char *path, const cache_rep_t *identity, const cache_rep_t *gzip);
+int cache_put_current(const char *path, const cache_rep_t *identity, const cache_rep_t *gzip,
+                      unsigned long generation);
+
+unsigned long cache_generation(void);
+int cache_invalidate(const char *path, int subtree);
+int cache_invalidate_if(int (*stale)(const char *path, void *arg), void *arg);
+int cache_recover_shared(int (*alive)(pid_t pid));
 
 #endif
@@ -0,0 +1,74 @@
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/*
+ * Compressibility Check
+ * Purpose: Decides whether a body is worth storing/sending gzip-encoded.
+ * Text formats compress well; images and archives are already compressed.
+ *
+ * Parameters:
+ * - content_type: MIME type of the body.
+ * - len: Body size in bytes.
+ *
+ * Return:
+ * - 1 if a gzip variant should be offered, 0 otherwise.
+ */
+int gzip_compressible(const char *content_type, size_t len)
+{
+    if (len < GZIP_MIN_SIZE)
+        return 0;
+    return strncmp(content_type, "text/", 5) == 0 ||
+           strcmp(content_type, "application/javascript") == 0 ||
+           strcmp(content_type, "application/json") == 0 ||
+           strcmp(content_type, "image/svg+xml") == 0;
+}
+
+/*
+ * Gzip Compression
+ * Purpose: Compresses a buffer into a gzip stream (RFC 1952), as sent with
+ * "Content-Encoding: gzip".
+ *
+ * Parameters:
+ * - in/in_len: Data to compress.
+ * - level: zlib level (1 fastest .. 9 smallest).
+ * - out/out_len: Receive a heap buffer with the result (caller frees it).
+ *
+ * Return:
+ * - 0 on success.
+ * - -1 on failure, or if the result would not be smaller than the input
+ *   (the variant would only waste cache space).
+ */
+int gzip_compress(const char *in, size_t in_len, int level, char **out, size_t *out_len)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    /* windowBits 15 + 16: zlib writes a gzip header and trailer */
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    size_t cap = deflateBound(&zs, in_len);
+    char *buf = malloc(cap);
+    if (!buf) {
+        deflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)in_len;
+    zs.next_out = (Bytef *)buf;
+    zs.avail_out = (uInt)cap;
+    int rc = deflate(&zs, Z_FINISH);
+    size_t produced = zs.total_out;
+    deflateEnd(&zs);
+
+    if (rc != Z_STREAM_END || produced >= in_len) {
+        free(buf);
+        return -1;
+    }
+    *out = buf;
+    *out_len = produced;
+    return 0;
+}
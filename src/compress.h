@@ -0,0 +1,12 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+/* Bodies smaller than this are not worth a compressed variant */
+#define GZIP_MIN_SIZE 256
+
+int gzip_compressible(const char *content_type, size_t len);
+int gzip_compress(const char *in, size_t in_len, int level, char **out, size_t *out_len);
+
+#endif
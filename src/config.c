@@ -3,6 +3,32 @@
 #include <string.h>
 #include <stdlib.h>
 
+/*
+ * Parse Cache-Control Rule
+ * Purpose: Adds one CACHE_CONTROL rule, "<ext>[,<ext>...]:<directives>",
+ * e.g. "css,js,png:public,max-age=604800" or "*:no-cache". Directives are
+ * sent verbatim; a max-age also produces a matching Expires header.
+ */
+static void parse_cache_rule(server_config_t *config, const char *value)
+{
+    const char *colon = strchr(value, ':');
+    if (!colon || colon == value || colon[1] == '\0') {
+        fprintf(stderr, "Invalid CACHE_CONTROL '%s', expected <ext,...>:<directives>.\n", value);
+        return;
+    }
+    if (config->cache_rule_count >= MAX_CACHE_RULES) {
+        fprintf(stderr, "Too many CACHE_CONTROL rules, ignoring '%s'.\n", value);
+        return;
+    }
+
+    cache_rule_t *rule = &config->cache_rules[config->cache_rule_count++];
+    snprintf(rule->extensions, sizeof(rule->extensions), "%.*s", (int)(colon - value), value);
+    snprintf(rule->directives, sizeof(rule->directives), "%s", colon + 1);
+
+    const char *max_age = strstr(rule->directives, "max-age=");
+    rule->max_age = max_age ? atoi(max_age + 8) : -1;
+}
+
 /*
  * Load Server Configuration
  * Purpose: Parses a configuration file (key=value format) and populates the
@@ -22,6 +48,22 @@ int load_config(const char *filename, server_config_t *config)
     if (!fp)
         return -1;
 
+    /* Defaults for optional tuning keys (may be omitted from the file) */
+    config->accept_batch = 16;
+    config->keepalive_timeout = 5;
+    config->keepalive_max_requests = 100;
+    config->gzip_level = 6;
+    config->cache_watch = 1;
+    config->preload_threads = 4;
+    strcpy(config->preload_globs, "*");
+    config->meta_cache_entries = 4096;
+    config->meta_cache_ttl = 5;
+    config->meta_negative_ttl = 1;
+    config->open_file_cache_size = 64;
+    config->open_file_cache_ttl = 10;
+    config->log_max_size = 10L * 1024 * 1024;
+    config->log_rotate_keep = 5;
+
     char line[512], key[128], value[256];
     
     /* Iterate through the file line by line */
@@ -52,10 +94,97 @@ int load_config(const char *filename, server_config_t *config)
                 config->max_queue_size = atoi(value);
             else if (strcmp(key, "LOG_FILE") == 0)
                 strncpy(config->log_file, value, sizeof(config->log_file));
+            else if (strcmp(key, "LOG_FORMAT") == 0)
+            {
+                if (strcmp(value, "text") == 0)
+                    config->log_format = LOG_FORMAT_TEXT;
+                else if (strcmp(value, "binary") == 0)
+                    config->log_format = LOG_FORMAT_BINARY;
+                else
+                    fprintf(stderr, "Unknown LOG_FORMAT '%s', using 'text'.\n", value);
+            }
+            else if (strcmp(key, "LOG_MAX_SIZE_MB") == 0)
+                config->log_max_size = atol(value) * 1024 * 1024;
+            else if (strcmp(key, "LOG_ROTATE_KEEP") == 0)
+                config->log_rotate_keep = atoi(value);
+            else if (strcmp(key, "LOG_COMPRESS") == 0)
+                config->log_compress = atoi(value);
             else if (strcmp(key, "CACHE_SIZE_MB") == 0)
                 config->cache_size_mb = atoi(value);
             else if (strcmp(key, "TIMEOUT_SECONDS") == 0)
                 config->timeout_seconds = atoi(value);
+            else if (strcmp(key, "ACCEPT_MODE") == 0)
+            {
+                if (strcmp(value, "master") == 0)
+                    config->accept_mode = ACCEPT_MODE_MASTER;
+                else if (strcmp(value, "reuseport") == 0)
+                    config->accept_mode = ACCEPT_MODE_REUSEPORT;
+                else if (strcmp(value, "shared") == 0)
+                    config->accept_mode = ACCEPT_MODE_SHARED;
+                else
+                    fprintf(stderr, "Unknown ACCEPT_MODE '%s', using 'master'.\n", value);
+            }
+            else if (strcmp(key, "ACCEPT_BATCH") == 0)
+                config->accept_batch = atoi(value);
+            else if (strcmp(key, "DISPATCH_POLICY") == 0)
+            {
+                if (strcmp(value, "least_loaded") == 0)
+                    config->dispatch_policy = DISPATCH_LEAST_LOADED;
+                else if (strcmp(value, "p2c") == 0)
+                    config->dispatch_policy = DISPATCH_P2C;
+                else if (strcmp(value, "round_robin") == 0)
+                    config->dispatch_policy = DISPATCH_ROUND_ROBIN;
+                else
+                    fprintf(stderr, "Unknown DISPATCH_POLICY '%s', using 'least_loaded'.\n", value);
+            }
+            else if (strcmp(key, "WORKER_RECV_MODE") == 0)
+            {
+                if (strcmp(value, "queue") == 0)
+                    config->worker_recv_mode = RECV_MODE_QUEUE;
+                else if (strcmp(value, "direct") == 0)
+                    config->worker_recv_mode = RECV_MODE_DIRECT;
+                else
+                    fprintf(stderr, "Unknown WORKER_RECV_MODE '%s', using 'queue'.\n", value);
+            }
+            else if (strcmp(key, "WORKER_ENGINE") == 0)
+            {
+                if (strcmp(value, "threads") == 0)
+                    config->worker_engine = ENGINE_THREADS;
+                else if (strcmp(value, "epoll") == 0)
+                    config->worker_engine = ENGINE_EPOLL;
+                else
+                    fprintf(stderr, "Unknown WORKER_ENGINE '%s', using 'threads'.\n", value);
+            }
+            else if (strcmp(key, "KEEPALIVE_TIMEOUT") == 0)
+                config->keepalive_timeout = atoi(value);
+            else if (strcmp(key, "KEEPALIVE_MAX_REQUESTS") == 0)
+                config->keepalive_max_requests = atoi(value);
+            else if (strcmp(key, "CACHE_SHARED") == 0)
+                config->cache_shared = atoi(value);
+            else if (strcmp(key, "GZIP_LEVEL") == 0)
+                config->gzip_level = atoi(value);
+            else if (strcmp(key, "CACHE_WATCH") == 0)
+                config->cache_watch = atoi(value);
+            else if (strcmp(key, "CACHE_PRELOAD") == 0)
+                config->cache_preload = atoi(value);
+            else if (strcmp(key, "PRELOAD_THREADS") == 0)
+                config->preload_threads = atoi(value);
+            else if (strcmp(key, "PRELOAD_BUDGET_MB") == 0)
+                config->preload_budget_mb = atoi(value);
+            else if (strcmp(key, "PRELOAD_GLOBS") == 0)
+                strncpy(config->preload_globs, value, sizeof(config->preload_globs) - 1);
+            else if (strcmp(key, "META_CACHE_ENTRIES") == 0)
+                config->meta_cache_entries = atoi(value);
+            else if (strcmp(key, "META_CACHE_TTL") == 0)
+                config->meta_cache_ttl = atoi(value);
+            else if (strcmp(key, "META_NEGATIVE_TTL") == 0)
+                config->meta_negative_ttl = atoi(value);
+            else if (strcmp(key, "OPEN_FILE_CACHE_SIZE") == 0)
+                config->open_file_cache_size = atoi(value);
+            else if (strcmp(key, "OPEN_FILE_CACHE_TTL") == 0)
+                config->open_file_cache_ttl = atoi(value);
+            else if (strcmp(key, "CACHE_CONTROL") == 0)
+                parse_cache_rule(config, value);
         }
     }
     fclose(fp);
@@ -4,6 +4,38 @@
 
 #define MAX_PATH_LEN 256
 
+/* Accept strategies (ACCEPT_MODE in server.conf) */
+#define ACCEPT_MODE_MASTER    0 /* Master accepts and relays FDs to workers */
+#define ACCEPT_MODE_REUSEPORT 1 /* Each worker owns a SO_REUSEPORT listener */
+#define ACCEPT_MODE_SHARED    2 /* Workers share the inherited listener (EPOLLEXCLUSIVE) */
+
+/* Master dispatch policies (DISPATCH_POLICY in server.conf) */
+#define DISPATCH_LEAST_LOADED 0 /* Worker with the fewest owned connections */
+#define DISPATCH_P2C          1 /* Power of two random choices */
+#define DISPATCH_ROUND_ROBIN  2 /* Strict rotation, ignores load */
+
+/* How pool threads get connections in master-dispatch mode (WORKER_RECV_MODE) */
+#define RECV_MODE_QUEUE  0 /* Main thread receives, pool threads use the local queue */
+#define RECV_MODE_DIRECT 1 /* Pool threads block in recvmsg() on the IPC socket */
+
+/* How a worker serves its connections (WORKER_ENGINE in server.conf) */
+#define ENGINE_THREADS 0 /* One blocking thread per connection */
+#define ENGINE_EPOLL   1 /* Non-blocking event loops, many connections per thread */
+
+/* Access log encodings (LOG_FORMAT in server.conf) */
+#define LOG_FORMAT_TEXT   0 /* Common Log Format lines */
+#define LOG_FORMAT_BINARY 1 /* Fixed-width records with interned paths (see log_format.h) */
+
+/* Cache-Control rules (CACHE_CONTROL=<ext>[,<ext>...]:<directives>) */
+#define MAX_CACHE_RULES 16
+
+typedef struct
+{
+    char extensions[128];       /* Comma-separated, without dots; "*" matches any file */
+    char directives[128];       /* Cache-Control value, e.g. "public,max-age=86400" */
+    int max_age;                /* From "max-age=N" (drives Expires), -1 if absent */
+} cache_rule_t;
+
 typedef struct
 {
     int port;
@@ -12,8 +44,33 @@ typedef struct
     int max_queue_size;
     char document_root[MAX_PATH_LEN];
     char log_file[MAX_PATH_LEN];
+    int log_format;             /* LOG_FORMAT_TEXT or LOG_FORMAT_BINARY */
+    long log_max_size;          /* Rotate the log at this many bytes (LOG_MAX_SIZE_MB; 0 = never) */
+    int log_rotate_keep;        /* Rotated generations kept (LOG_FILE.1 ... .N) */
+    int log_compress;           /* 1: gzip rotated generations in the background */
     int cache_size_mb;
     int timeout_seconds;
+    int accept_mode;
+    int accept_batch;
+    int dispatch_policy;
+    int worker_recv_mode;
+    int worker_engine;
+    int keepalive_timeout;      /* Idle seconds between requests (0 = no keep-alive) */
+    int keepalive_max_requests; /* Requests served per connection before closing */
+    int cache_shared;           /* One cache in shared memory for all workers */
+    int gzip_level;             /* zlib level for cached gzip variants (0 = precompressed .gz only) */
+    int cache_watch;            /* Invalidate cached files changed under DOCUMENT_ROOT (inotify) */
+    int cache_preload;          /* Fill the cache in the Master before forking workers */
+    int preload_threads;        /* Loader threads for the preload */
+    int preload_budget_mb;      /* Max bytes to preload (0 = CACHE_SIZE_MB) */
+    char preload_globs[MAX_PATH_LEN]; /* Comma-separated patterns of files to preload */
+    int meta_cache_entries;     /* Path lookups remembered per worker (0 = off) */
+    int meta_cache_ttl;         /* Seconds a found path is trusted */
+    int meta_negative_ttl;      /* Seconds a missing path (404) is trusted */
+    int open_file_cache_size;   /* Large files kept open per worker (0 = off) */
+    int open_file_cache_ttl;    /* Seconds before an open file is re-checked against its path */
+    cache_rule_t cache_rules[MAX_CACHE_RULES];
+    int cache_rule_count;
 } server_config_t;
 
 int load_config(const char *filename, server_config_t *config);
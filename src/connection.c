@@ -0,0 +1,1092 @@
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "connection.h"
+#include "config.h"
+#include "shared_mem.h"
+#include "stats.h"
+#include "logger.h"
+#include "worker.h"
+#include "cache.h"
+#include "compress.h"
+#include "meta_cache.h"
+#include "fd_cache.h"
+
+/* Access global config and shared structures */
+extern server_config_t config;
+
+/*
+ * Initialize Connection
+ * Purpose: Prepares a connection received from the acceptor for its first
+ * request and accounts for it in the shared stats.
+ *
+ * Parameters:
+ * - c: Connection to initialize (caller-owned storage).
+ * - info: FD and acceptor metadata.
+ */
+void conn_init(conn_t *c, const conn_info_t *info)
+{
+    memset(c, 0, sizeof(*c));
+    c->info = *info;
+    c->state = CONN_READING;
+    c->file_fd = -1;
+    c->expires_in = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &c->start_time);
+
+    /* Queueing delay: acceptor's accept() until a thread picked it up */
+    long queue_delay_us = -1;
+    if (info->accepted_at.tv_sec != 0 || info->accepted_at.tv_nsec != 0) {
+        queue_delay_us = (c->start_time.tv_sec - info->accepted_at.tv_sec) * 1000000L +
+                         (c->start_time.tv_nsec - info->accepted_at.tv_nsec) / 1000;
+    }
+
+    /* Increment Active Connections (this thread's stats slot, no lock) */
+    stats_connection_opened(queue_delay_us);
+
+    /* The acceptor already knows the peer; only ask the kernel if it didn't */
+    if (info->peer.sin_family == AF_INET) {
+        inet_ntop(AF_INET, &info->peer.sin_addr, c->client_ip, sizeof(c->client_ip));
+    } else {
+        get_client_ip(info->fd, c->client_ip, sizeof(c->client_ip));
+    }
+}
+
+/*
+ * Add Response Segment
+ * Purpose: Appends a slice to the response: memory bytes, or (data NULL)
+ * bytes of c->file_fd from 'offset'. Empty slices are skipped.
+ */
+static void conn_add_segment(conn_t *c, const char *data, off_t offset, size_t len)
+{
+    if (len == 0 || c->seg_count >= CONN_MAX_SEGMENTS)
+        return;
+    conn_segment_t *seg = &c->segs[c->seg_count++];
+    seg->data = data;
+    seg->offset = offset;
+    seg->len = len;
+}
+
+/*
+ * Set Prebuilt Response
+ * Purpose: Starts a response from an entity header block built earlier (a
+ * cache entry's or a canned error's): the block is copied, only its Date
+ * (and Expires) values are refreshed, and the connection tail is appended.
+ * The header becomes the first segment, the body (if any) the second; in-
+ * memory segments go out together in one sendmsg().
+ *
+ * Parameters:
+ * - status: Status code recorded for stats and logs.
+ * - hdr/hdr_len: Entity header block (see http_format_entity_header); at
+ *   most CONN_HEADER_SIZE - HTTP_CONN_TAIL_MAX bytes, like every block built
+ *   here.
+ * - body: Body bytes to send (NULL for none, e.g. HEAD).
+ * - content_length: Value of the block's Content-Length header.
+ * - body_owned: Heap buffer to free once the response is done (may be NULL).
+ */
+static void conn_set_prebuilt(conn_t *c, int status, const char *hdr, size_t hdr_len,
+                              const char *body, size_t content_length, char *body_owned)
+{
+    c->status_code = status;
+    memcpy(c->header, hdr, hdr_len);
+    http_patch_date(c->header, hdr_len);
+    http_patch_expires(c->header, hdr_len, c->expires_in);
+    c->header_len = hdr_len + http_format_conn_tail(c->header + hdr_len,
+                                                    c->keep_alive ? config.keepalive_timeout : 0,
+                                                    config.keepalive_max_requests - c->requests - 1);
+    c->body_len = body ? content_length : 0;
+    c->body_owned = body_owned;
+    c->bytes_sent = (long)c->body_len;
+    c->sent = 0;
+    c->state = CONN_SENDING;
+
+    c->seg_count = 0;
+    c->seg_idx = 0;
+    c->seg_off = 0;
+    conn_add_segment(c, c->header, 0, c->header_len);
+    if (body)
+        conn_add_segment(c, body, 0, content_length);
+}
+
+/*
+ * Set Response
+ * Purpose: Formats the entity header and records which body bytes to send.
+ *
+ * Parameters:
+ * - status/status_msg/content_type: Status line and Content-Type.
+ * - body: Body bytes to send (NULL for none, e.g. HEAD).
+ * - content_length: Value of the Content-Length header.
+ * - body_owned: Heap buffer to free once the response is done (may be NULL).
+ * - extra_headers: Additional header lines (e.g. Content-Encoding), or NULL.
+ */
+static void conn_set_response(conn_t *c, int status, const char *status_msg,
+                              const char *content_type, const char *body,
+                              size_t content_length, char *body_owned,
+                              const char *extra_headers)
+{
+    char hdr[CONN_HEADER_SIZE - HTTP_CONN_TAIL_MAX];
+    size_t hdr_len = http_format_entity_header(hdr, sizeof(hdr), status, status_msg,
+                                               content_type, content_length, extra_headers);
+    conn_set_prebuilt(c, status, hdr, hdr_len, body, content_length, body_owned);
+}
+
+/*
+ * Set File Response
+ * Purpose: Like conn_set_response, but the body is streamed from an open
+ * file with sendfile() instead of being held in memory.
+ *
+ * Parameters:
+ * - file_fd: Open file, owned (and closed) by the connection from now on,
+ *   unless it belongs to c->open_file.
+ * - offset: Where the body starts in the file (non-zero for a range).
+ * - len: Bytes to send (the Content-Length).
+ */
+static void conn_set_file_response(conn_t *c, int status, const char *status_msg,
+                                   const char *content_type, int file_fd, off_t offset,
+                                   size_t len, const char *extra_headers)
+{
+    conn_set_response(c, status, status_msg, content_type, NULL, len, NULL, extra_headers);
+    c->file_fd = file_fd;
+    c->body_len = len;
+    c->bytes_sent = (long)len;
+    conn_add_segment(c, NULL, offset, len);
+}
+
+/*
+ * Set Error Response
+ * Purpose: Sends one of the pre-rendered HTML error pages (see http_canned).
+ */
+static void conn_set_error(conn_t *c, int status)
+{
+    const http_canned_t *r = http_canned(status);
+    conn_set_prebuilt(c, r->status, r->hdr, r->hdr_len, r->body, r->body_len, NULL);
+}
+
+/* Room for the lines built by file_headers() */
+#define FILE_HEADERS_SIZE 512
+
+/*
+ * Find Cache-Control Rule
+ * Purpose: Picks the CACHE_CONTROL rule for a file by its extension. A rule
+ * for "*" applies to files that no other rule names.
+ *
+ * Return:
+ * - The rule, or NULL if none applies.
+ */
+static const cache_rule_t *find_cache_rule(const char *path)
+{
+    if (config.cache_rule_count == 0)
+        return NULL;
+
+    const char *ext = strrchr(path, '.');
+    if (ext && strchr(ext, '/'))
+        ext = NULL; /* The dot belongs to a directory name */
+    if (ext)
+        ext++;
+    size_t ext_len = ext ? strlen(ext) : 0;
+
+    const cache_rule_t *fallback = NULL;
+    for (int i = 0; i < config.cache_rule_count; i++) {
+        const cache_rule_t *rule = &config.cache_rules[i];
+        const char *p = rule->extensions;
+        while (*p) {
+            size_t n = strcspn(p, ",");
+            if (n == 1 && *p == '*') {
+                if (!fallback) fallback = rule;
+            } else if (ext && n == ext_len && strncasecmp(p, ext, n) == 0) {
+                return rule;
+            }
+            p += n;
+            if (*p == ',') p++;
+        }
+    }
+    return fallback;
+}
+
+/*
+ * Entity Tag
+ * Purpose: Derives a file's ETag from its stat data (mtime and size, in
+ * hex), so it needs no hashing and changes whenever the file does. The
+ * gzip representation gets its own tag.
+ */
+static void format_etag(char *out, size_t cap, const struct stat *st, int gz)
+{
+    snprintf(out, cap, "\"%lx-%lx%s\"", (unsigned long)st->st_mtime,
+             (unsigned long)st->st_size, gz ? "-gz" : "");
+}
+
+/*
+ * Build File Headers
+ * Purpose: Formats the header lines a file response adds to the entity
+ * block: ETag and Last-Modified, Accept-Ranges (identity only: ranges are
+ * never served from the gzip variant), Content-Encoding for the gzip
+ * variant, Vary for compressible types, and the Cache-Control rule. A rule with a
+ * max-age also gets an Expires line, placed last so prebuilt blocks can
+ * refresh it (http_patch_expires).
+ *
+ * Parameters:
+ * - out: Destination (FILE_HEADERS_SIZE bytes).
+ * - st: stat of the file (the original one for the gzip variant).
+ * - rule: Cache-Control rule, or NULL.
+ * - compressible: The type has a gzip representation (adds Vary).
+ * - gz: Headers for the gzip representation.
+ * - not_modified: For a 304, which carries no Content-Encoding.
+ */
+static void file_headers(char *out, const struct stat *st, const cache_rule_t *rule,
+                         int compressible, int gz, int not_modified)
+{
+    char etag[64], modified[HTTP_DATE_LEN + 1], expires[HTTP_DATE_LEN + 1];
+    format_etag(etag, sizeof(etag), st, gz);
+    http_format_date(st->st_mtime, modified);
+    if (rule && rule->max_age >= 0)
+        http_format_date(time(NULL) + rule->max_age, expires);
+
+    snprintf(out, FILE_HEADERS_SIZE,
+             "ETag: %s\r\nLast-Modified: %s\r\n%s%s%s%s%s%s%s%s%s",
+             etag, modified,
+             (!gz && !not_modified) ? "Accept-Ranges: bytes\r\n" : "",
+             (gz && !not_modified) ? "Content-Encoding: gzip\r\n" : "",
+             compressible ? "Vary: Accept-Encoding\r\n" : "",
+             rule ? "Cache-Control: " : "", rule ? rule->directives : "", rule ? "\r\n" : "",
+             (rule && rule->max_age >= 0) ? "Expires: " : "",
+             (rule && rule->max_age >= 0) ? expires : "",
+             (rule && rule->max_age >= 0) ? "\r\n" : "");
+}
+
+/*
+ * Conditional Request Check
+ * Purpose: Decides whether the client's copy of a file is still current.
+ * If-None-Match is compared with the tags of both representations; only
+ * when it is absent is If-Modified-Since compared with the mtime.
+ *
+ * Parameters:
+ * - prefer_gz: Representation the client would get (for If-Modified-Since).
+ *
+ * Return:
+ * - 0 if a full response is needed, otherwise 1 (identity) or 2 (gzip):
+ *   the representation whose validators the 304 should carry.
+ */
+static int conn_not_modified(const http_request_t *req, const struct stat *st, int prefer_gz)
+{
+    if (req->if_none_match.ptr) {
+        char etag[64];
+        format_etag(etag, sizeof(etag), st, 0);
+        if (http_etag_matches(req->if_none_match, etag))
+            return 1;
+        format_etag(etag, sizeof(etag), st, 1);
+        return http_etag_matches(req->if_none_match, etag) ? 2 : 0;
+    }
+
+    time_t since;
+    if (http_parse_date(req->if_modified_since, &since) == 0 && st->st_mtime <= since)
+        return prefer_gz ? 2 : 1;
+    return 0;
+}
+
+/*
+ * Build File Path
+ * Purpose: Joins the document root and a canonical request path (see
+ * http_canonical_path) into the key used for the file: the metadata cache
+ * and the cache watcher know a file by this path. A trailing '/' on the
+ * root or the path is left out.
+ *
+ * Return: The length of the path written to 'out'.
+ */
+static size_t conn_build_path(char *out, size_t cap, const char *canonical)
+{
+    size_t len = snprintf(out, cap, "%s", config.document_root);
+    if (len >= cap) len = cap - 1;
+    while (len > 0 && out[len - 1] == '/')
+        len--;
+    len += snprintf(out + len, cap - len, "%s", canonical);
+    if (len >= cap) len = cap - 1;
+    while (len > 0 && out[len - 1] == '/')
+        len--;
+    out[len] = '\0';
+    return len;
+}
+
+/*
+ * Look Up File
+ * Purpose: Finds the file a request path names: the path itself, or its
+ * index.html for a directory. The answer, including "nothing there", comes
+ * from the metadata cache when possible; otherwise it costs one or two
+ * stat() calls and is remembered.
+ *
+ * Parameters:
+ * - key: Path built by conn_build_path().
+ * - info: Receives the resolved path and attributes.
+ *
+ * Return: 1 if found, 0 if not.
+ */
+static int conn_lookup_file(const char *key, meta_info_t *info)
+{
+    if (meta_cache_get(key, info) == 0)
+        return info->found;
+
+    snprintf(info->path, sizeof(info->path), "%s", key);
+    info->found = (stat(info->path, &info->st) == 0);
+    if (info->found && S_ISDIR(info->st.st_mode)) {
+        strncat(info->path, "/index.html", sizeof(info->path) - strlen(info->path) - 1);
+        info->found = (stat(info->path, &info->st) == 0);
+    }
+    meta_cache_put(key, info);
+    return info->found;
+}
+
+/*
+ * If-Range Check
+ * Purpose: A Range request with If-Range is only honoured if the validator
+ * still matches the file: an entity tag must match the identity tag
+ * exactly (weak tags never do), a date must equal the mtime. Otherwise the
+ * client's partial copy is stale and gets the full file instead.
+ */
+static int conn_if_range_ok(const http_request_t *req, const struct stat *st)
+{
+    http_slice_t v = req->if_range;
+    if (!v.ptr)
+        return 1;
+    if (v.len > 0 && v.ptr[0] == '"') {
+        char etag[64];
+        format_etag(etag, sizeof(etag), st, 0);
+        return v.len == strlen(etag) && memcmp(v.ptr, etag, v.len) == 0;
+    }
+    time_t when;
+    return http_parse_date(v, &when) == 0 && when == st->st_mtime;
+}
+
+/*
+ * Set Range Response
+ * Purpose: Answers a Range request on the identity representation with
+ * 206 Partial Content, without copying: each range is a segment pointing
+ * into the in-memory body (cache entry or read buffer) or an offset in the
+ * file, sent with sendfile(). Several ranges become a multipart/byteranges
+ * body whose part headers are interleaved as extra segments.
+ *
+ * Parameters:
+ * - mime/st/rule/compressible: Describe the file (headers as for a 200).
+ * - data: The body in memory, or NULL to send from 'file_fd'.
+ * - size: Size of the body.
+ * - data_owned: Heap buffer backing 'data' to free afterwards (or NULL).
+ * - file_fd: Open file (data NULL), owned by the connection once handled.
+ *
+ * Return:
+ * - 1 if a response (206, or 416 when no range is satisfiable) was set.
+ * - 0 if the Range header is to be ignored: send the full response.
+ */
+static int conn_set_ranges(conn_t *c, const char *mime, const struct stat *st,
+                           const cache_rule_t *rule, int compressible,
+                           const char *data, size_t size, char *data_owned, int file_fd)
+{
+    http_range_t ranges[HTTP_MAX_RANGES];
+    int count = http_parse_range(c->req.range, size, ranges, HTTP_MAX_RANGES);
+    if (count == 0)
+        return 0;
+
+    if (count < 0) {
+        static const char body[] = "<h1>416 Range Not Satisfiable</h1>";
+        char extra[64];
+        snprintf(extra, sizeof(extra), "Content-Range: bytes */%zu\r\n", size);
+        conn_set_response(c, 416, "Range Not Satisfiable", "text/html", body, sizeof(body) - 1,
+                          data_owned, extra);
+        if (file_fd >= 0) c->file_fd = file_fd;
+        return 1;
+    }
+
+    char file_hdrs[FILE_HEADERS_SIZE];
+    file_headers(file_hdrs, st, rule, compressible, 0, 0);
+
+    if (count == 1) {
+        size_t first = ranges[0].first, len = ranges[0].last - first + 1;
+        char extra[FILE_HEADERS_SIZE + 80];
+        snprintf(extra, sizeof(extra), "Content-Range: bytes %zu-%zu/%zu\r\n%s",
+                 first, ranges[0].last, size, file_hdrs);
+        if (data)
+            conn_set_response(c, 206, "Partial Content", mime, data + first, len, data_owned, extra);
+        else
+            conn_set_file_response(c, 206, "Partial Content", mime, file_fd, (off_t)first, len, extra);
+        return 1;
+    }
+
+    /* Multipart: part headers live in one heap block, in send order */
+    char boundary[32];
+    snprintf(boundary, sizeof(boundary), "%016lx%08x",
+             c->info.conn_id ^ (unsigned long)st->st_mtime, (unsigned)c->requests);
+    size_t cap = (size_t)count * (strlen(mime) + 160) + 64;
+    char *parts = malloc(cap);
+    if (!parts)
+        return 0;
+
+    size_t offs[HTTP_MAX_RANGES + 1], used = 0, content_length = 0;
+    for (int i = 0; i < count; i++) {
+        offs[i] = used;
+        used += snprintf(parts + used, cap - used,
+                         "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                         boundary, mime, ranges[i].first, ranges[i].last, size);
+        content_length += ranges[i].last - ranges[i].first + 1;
+    }
+    offs[count] = used;
+    used += snprintf(parts + used, cap - used, "\r\n--%s--\r\n", boundary);
+    content_length += used;
+
+    char content_type[64];
+    snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", boundary);
+    conn_set_response(c, 206, "Partial Content", content_type, NULL, content_length,
+                      data_owned, file_hdrs);
+    c->body_len = content_length;
+    c->bytes_sent = (long)content_length;
+    c->parts_owned = parts;
+    if (file_fd >= 0) c->file_fd = file_fd;
+
+    for (int i = 0; i < count; i++) {
+        size_t len = ranges[i].last - ranges[i].first + 1;
+        conn_add_segment(c, parts + offs[i], 0, offs[i + 1] - offs[i]);
+        if (data)
+            conn_add_segment(c, data + ranges[i].first, 0, len);
+        else
+            conn_add_segment(c, NULL, (off_t)ranges[i].first, len);
+    }
+    conn_add_segment(c, parts + offs[count], 0, used - offs[count]);
+    return 1;
+}
+
+/*
+ * Open Precompressed Sibling
+ * Purpose: Looks for "<path>.gz" next to a file. It is only used if it is
+ * a regular file at least as new as the original, so a stale sibling left
+ * behind after an edit is ignored.
+ *
+ * Parameters:
+ * - full_path: Path of the original file.
+ * - orig: stat of the original file.
+ * - gz_st: Receives the stat of the sibling.
+ *
+ * Return:
+ * - Open descriptor of the sibling, or -1 if there is no usable one.
+ */
+static int open_gz_sibling(const char *full_path, const struct stat *orig, struct stat *gz_st)
+{
+    char gz_path[1024 + 3];
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", full_path);
+
+    int fd = open(gz_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, gz_st) != 0 || !S_ISREG(gz_st->st_mode) || gz_st->st_size <= 0 ||
+        gz_st->st_mtime < orig->st_mtime) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Build Gzip Variant
+ * Purpose: Produces the gzip-encoded body stored next to a cacheable file:
+ * a fresh precompressed sibling if there is one, otherwise the data
+ * compressed at GZIP_LEVEL (0 disables on-the-fly compression).
+ *
+ * Return:
+ * - Heap buffer with the encoded body (caller frees), or NULL if none.
+ */
+static char *load_gzip_variant(const char *full_path, const struct stat *st,
+                               const char *data, size_t len, size_t *out_len)
+{
+    struct stat gz_st;
+    int fd = open_gz_sibling(full_path, st, &gz_st);
+    if (fd >= 0) {
+        char *gz = NULL;
+        if ((size_t)gz_st.st_size < len) {
+            gz = malloc(gz_st.st_size);
+            if (gz && read(fd, gz, gz_st.st_size) != gz_st.st_size) {
+                free(gz);
+                gz = NULL;
+            }
+        }
+        close(fd);
+        if (gz) {
+            *out_len = gz_st.st_size;
+            return gz;
+        }
+    }
+
+    char *gz = NULL;
+    if (config.gzip_level > 0 && gzip_compress(data, len, config.gzip_level, &gz, out_len) == 0)
+        return gz;
+    return NULL;
+}
+
+/* Both representations of a file, as stored in the cache */
+typedef struct {
+    char hdr[CONN_HEADER_SIZE - HTTP_CONN_TAIL_MAX];
+    char gz_hdr[CONN_HEADER_SIZE - HTTP_CONN_TAIL_MAX];
+    cache_rep_t identity;
+    cache_rep_t gzip;     /* data NULL if there is no gzip variant (else heap, caller frees) */
+} file_entry_t;
+
+/*
+ * Build Cache Entry
+ * Purpose: Prepares what the cache stores for a file read into memory: the
+ * identity bytes with their header block and, for compressible types, the
+ * gzip variant with its own header block.
+ */
+static void conn_build_entry(file_entry_t *fe, const char *full_path, const struct stat *st,
+                             const cache_rule_t *rule, const char *buf, size_t len)
+{
+    const char *mime = get_mime_type(full_path);
+    int compressible = gzip_compressible(mime, len);
+    size_t gz_len = 0;
+    char *gz = compressible ? load_gzip_variant(full_path, st, buf, len, &gz_len) : NULL;
+
+    char extra[FILE_HEADERS_SIZE];
+    file_headers(extra, st, rule, compressible, 0, 0);
+    size_t hdr_len = http_format_entity_header(fe->hdr, sizeof(fe->hdr), 200, "OK", mime, len, extra);
+    fe->identity = (cache_rep_t){ fe->hdr, hdr_len, buf, len };
+
+    fe->gzip = (cache_rep_t){ fe->gz_hdr, 0, gz, gz_len };
+    if (gz) {
+        file_headers(extra, st, rule, 1, 1, 0);
+        fe->gzip.hdr_len = http_format_entity_header(fe->gz_hdr, sizeof(fe->gz_hdr), 200, "OK",
+                                                     mime, gz_len, extra);
+    }
+}
+
+/*
+ * Keep-Alive Decision
+ * Purpose: Decides whether the connection stays open after the current
+ * response: the client must want it, the per-connection request limit must
+ * not be reached, and the request must have no body (bodies are never read,
+ * so their bytes would be taken as the next request). A pool thread also
+ * gives the connection up when other connections are waiting for the worker
+ * (queued, or sent by the Master and not yet received), since an idle
+ * keep-alive client would otherwise hold the thread while they starve.
+ */
+static int conn_keep_alive(const conn_t *c)
+{
+    if (config.keepalive_timeout <= 0 || c->requests + 1 >= config.keepalive_max_requests)
+        return 0;
+    if (http_has_body(&c->req))
+        return 0;
+    if (c->pooled && local_load && worker_load_waiting(local_load) > 0)
+        return 0;
+    return http_wants_keep_alive(&c->req);
+}
+
+/*
+ * Resolve Request (Core Logic)
+ * Purpose: Turns the parsed request into a response.
+ *
+ * Workflow:
+ * 1. Validates method (GET/HEAD only) and the path, reduced to its
+ *    canonical form (no ".." segments).
+ * 2. Resolves the physical file path (handling index.html) through the
+ *    metadata cache: known files and known 404s need no syscall.
+ * 3. Checks the In-Memory Cache (for small files): a hit is sent with the
+ *    header block stored in the entry, gzip-encoded if the entry has that
+ *    variant and the client's Accept-Encoding allows it.
+ * 4. If not cached, reads from disk and populates the cache with the data,
+ *    its gzip variant (compressible types) and their serialized headers.
+ *    A HEAD miss is answered from the file's attributes alone.
+ * Large files are streamed; a precompressed ".gz" sibling is streamed
+ * instead when the client accepts gzip.
+ *
+ * Parameters:
+ * - retried: 1 on the second pass made when the file stopped being
+ *   cacheable between its stat and its read; there is no third.
+ *
+ * Synchronization:
+ * - Uses cache_acquire/cache_put which handle their own Read-Write locks. A
+ *   hit borrows the entry until the response is finished.
+ */
+static void conn_resolve(conn_t *c, int retried)
+{
+    http_request_t *req = &c->req;
+
+    c->keep_alive = conn_keep_alive(c);
+
+    /* Validate Method (Only GET and HEAD supported) */
+    int is_head = (strcmp(req->method, "HEAD") == 0);
+    if (strcmp(req->method, "GET") != 0 && !is_head)
+    {
+        conn_set_error(c, 405);
+        return;
+    }
+
+    /* Security: Prevent Directory Traversal (after decoding %2e%2e too) */
+    char canonical[sizeof(req->path)];
+    int rc = http_canonical_path(req->path, canonical, sizeof(canonical));
+    if (rc != 0)
+    {
+        conn_set_error(c, rc == -2 ? 403 : 400);
+        return;
+    }
+
+    /* Resolve Path. The cache generation is taken before the file is
+     * looked at (see cache_put_current).
+     */
+    unsigned long generation = cache_generation();
+    char key[META_PATH_MAX];
+    size_t key_len = conn_build_path(key, sizeof(key), canonical);
+
+    /* File Existence Check ("dir/" must be a directory, served by its index) */
+    meta_info_t info;
+    int is_index = 0;
+    if (conn_lookup_file(key, &info))
+        is_index = (strlen(info.path) != key_len);
+    size_t canon_len = strlen(canonical);
+    if (!info.found || (canon_len > 1 && canonical[canon_len - 1] == '/' && !is_index)) {
+        conn_set_error(c, 404);
+        return;
+    }
+    const char *full_path = info.path;
+    struct stat st = info.st;
+
+    long fsize = st.st_size;
+    int wants_gzip = http_accepts_encoding(req->accept_encoding, "gzip");
+    const cache_rule_t *rule = find_cache_rule(full_path);
+    c->expires_in = rule ? rule->max_age : -1;
+    int ranged = !is_head && req->range.ptr && conn_if_range_ok(req, &st);
+
+    /* Conditional GET: the client's copy is current, send headers only */
+    if (req->if_none_match.ptr || req->if_modified_since.ptr) {
+        int compressible = gzip_compressible(get_mime_type(full_path), fsize);
+        int match = conn_not_modified(req, &st, compressible && wants_gzip);
+        if (match) {
+            char extra[FILE_HEADERS_SIZE], hdr[CONN_HEADER_SIZE - HTTP_CONN_TAIL_MAX];
+            file_headers(extra, &st, rule, compressible, match == 2, 1);
+            size_t hdr_len = http_format_not_modified(hdr, sizeof(hdr), extra);
+            conn_set_prebuilt(c, 304, hdr, hdr_len, NULL, 0, NULL);
+            return;
+        }
+    }
+
+    /* * CACHING LOGIC
+     * Only cache files smaller than 1MB to preserve memory.
+     */
+    int cacheable = (fsize > 0 && fsize < (1 * 1024 * 1024));
+    if (!cacheable) {
+        const char *mime = get_mime_type(full_path);
+        int compressible = gzip_compressible(mime, fsize);
+        char extra[FILE_HEADERS_SIZE];
+        /* Large (or empty) file: streamed from the page cache with sendfile(),
+         * so memory per transfer stays constant whatever the file size.
+         */
+        struct stat gz_st;
+        int gz_fd = (compressible && wants_gzip && !ranged) ? open_gz_sibling(full_path, &st, &gz_st) : -1;
+        if (gz_fd >= 0) {
+            file_headers(extra, &st, rule, 1, 1, 0);
+            if (is_head) {
+                close(gz_fd);
+                conn_set_response(c, 200, "OK", mime, NULL, gz_st.st_size, NULL, extra);
+            } else {
+                conn_set_file_response(c, 200, "OK", mime, gz_fd, 0, gz_st.st_size, extra);
+            }
+            return;
+        }
+        file_headers(extra, &st, rule, compressible, 0, 0);
+        if (is_head) {
+            conn_set_response(c, 200, "OK", mime, NULL, fsize, NULL, extra);
+            return;
+        }
+        /* Popular large files stay open between requests (see fd_cache) */
+        const fd_cache_entry_t *open_file = fd_cache_open(full_path);
+        if (!open_file) {
+            meta_cache_invalidate(key, 0);
+            conn_set_error(c, 404);
+            return;
+        }
+        /* Attributes of the file actually opened (it may have changed since stat) */
+        c->open_file = open_file;
+        st = open_file->st;
+        int fd = open_file->fd;
+        if (ranged && conn_set_ranges(c, mime, &st, rule, compressible, NULL, st.st_size, NULL, fd))
+            return;
+        file_headers(extra, &st, rule, compressible, 0, 0);
+        conn_set_file_response(c, 200, "OK", mime, fd, 0, st.st_size, extra);
+        return;
+    }
+
+    /* HIT: send straight from the shared entry (no copy), released once sent */
+    const cache_node_t *entry = cache_acquire(full_path);
+    if (entry) {
+        c->cache_ref = entry;
+        if (ranged && conn_set_ranges(c, get_mime_type(full_path), &st, rule,
+                                      gzip_compressible(get_mime_type(full_path), entry->len),
+                                      entry->data, entry->len, NULL, -1))
+            return;
+        if (wants_gzip && entry->gz_data) {
+            conn_set_prebuilt(c, 200, entry->gz_hdr, entry->gz_hdr_len,
+                              is_head ? NULL : entry->gz_data, entry->gz_len, NULL);
+        } else if (entry->hdr) {
+            conn_set_prebuilt(c, 200, entry->hdr, entry->hdr_len,
+                              is_head ? NULL : entry->data, entry->len, NULL);
+        } else {
+            conn_set_response(c, 200, "OK", get_mime_type(full_path),
+                              is_head ? NULL : entry->data, entry->len, NULL, NULL);
+        }
+        return;
+    }
+
+    /* HEAD on a miss: the attributes say all there is to say */
+    if (is_head) {
+        const char *mime = get_mime_type(full_path);
+        char extra[FILE_HEADERS_SIZE];
+        file_headers(extra, &st, rule, gzip_compressible(mime, fsize), 0, 0);
+        conn_set_response(c, 200, "OK", mime, NULL, fsize, NULL, extra);
+        return;
+    }
+
+    /* MISS: Read from disk */
+    FILE *fp = fopen(full_path, "rb");
+    if (!fp) {
+        meta_cache_invalidate(key, 0);
+        conn_set_error(c, 404);
+        return;
+    }
+    /* The attributes may come from the metadata cache: read what is there now */
+    struct stat now;
+    if (fstat(fileno(fp), &now) == 0 && (now.st_size != st.st_size || now.st_mtime != st.st_mtime)) {
+        meta_cache_invalidate(key, 0);
+        st = now;
+        fsize = st.st_size;
+        if (fsize <= 0 || fsize >= 1 * 1024 * 1024) {
+            /* No longer a cacheable file: resolve again from a fresh stat(),
+             * once; a file that keeps changing is not chased further */
+            fclose(fp);
+            if (retried)
+                conn_set_error(c, 500);
+            else
+                conn_resolve(c, 1);
+            return;
+        }
+    }
+    char *buf = malloc(fsize);
+    if (!buf) {
+        fclose(fp);
+        conn_set_error(c, 500);
+        return;
+    }
+    size_t rb = fread(buf, 1, fsize, fp);
+    fclose(fp);
+
+    if (rb != (size_t)fsize) {
+        free(buf);
+        conn_set_error(c, 500);
+        return;
+    }
+    /* Update Cache (Best Effort), along with the header blocks for later hits */
+    const char *mime = get_mime_type(full_path);
+    int compressible = gzip_compressible(mime, rb);
+    file_entry_t fe;
+    conn_build_entry(&fe, full_path, &st, rule, buf, rb);
+    cache_put_current(full_path, &fe.identity, fe.gzip.data ? &fe.gzip : NULL, generation);
+    char *gz = (char *)fe.gzip.data;
+
+    if (ranged && conn_set_ranges(c, mime, &st, rule, compressible, buf, rb, buf, -1)) {
+        free(gz);
+        return;
+    }
+
+    /* HEAD advertises the length but sends no body */
+    if (gz && wants_gzip) {
+        free(buf);
+        conn_set_prebuilt(c, 200, fe.gz_hdr, fe.gzip.hdr_len, is_head ? NULL : gz, fe.gzip.len, gz);
+    } else {
+        free(gz);
+        conn_set_prebuilt(c, 200, fe.hdr, fe.identity.hdr_len, is_head ? NULL : buf, fsize, buf);
+    }
+}
+
+/*
+ * Preload File
+ * Purpose: Reads a file and stores it in the cache exactly as a miss in
+ * conn_resolve() would (header blocks and gzip variant included), so the
+ * first request for it is already a hit. Used to warm the cache at startup.
+ *
+ * Parameters:
+ * - full_path: Cache key, built like conn_build_path() does.
+ * - st: The file's attributes.
+ *
+ * Return: The bytes cached (both representations), 0 if nothing was.
+ */
+size_t conn_preload_file(const char *full_path, const struct stat *st)
+{
+    if (st->st_size <= 0 || st->st_size >= 1 * 1024 * 1024)
+        return 0;
+    unsigned long generation = cache_generation();
+
+    FILE *fp = fopen(full_path, "rb");
+    if (!fp)
+        return 0;
+    char *buf = malloc(st->st_size);
+    size_t rb = buf ? fread(buf, 1, st->st_size, fp) : 0;
+    fclose(fp);
+    if (rb != (size_t)st->st_size) {
+        free(buf);
+        return 0;
+    }
+
+    file_entry_t fe;
+    conn_build_entry(&fe, full_path, st, find_cache_rule(full_path), buf, rb);
+    int rc = cache_put_current(full_path, &fe.identity, fe.gzip.data ? &fe.gzip : NULL, generation);
+    size_t cached = (rc == 0) ? rb + fe.gzip.len : 0;
+
+    free((char *)fe.gzip.data);
+    free(buf);
+    return cached;
+}
+
+/*
+ * Finish Request
+ * Purpose: Updates shared stats and writes the access log entry once the
+ * response has been fully sent (or abandoned).
+ */
+static void conn_finish_request(conn_t *c)
+{
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    long elapsed_ns = (end_time.tv_sec - c->start_time.tv_sec) * 1000000000L +
+                      (end_time.tv_nsec - c->start_time.tv_nsec);
+
+    /* Update Shared Stats (this thread's slot and worker histogram, no lock) */
+    stats_request_done(c->status_code, c->bytes_sent, elapsed_ns);
+
+    /* Log Request (Common Log Format or binary, see LOG_FORMAT) */
+    const char *log_method = (c->req.method[0] != '\0') ? c->req.method : "-";
+    const char *log_path = (c->req.path[0] != '\0') ? c->req.path : "-";
+
+    log_request(c->client_ip, log_method, log_path, c->status_code, c->bytes_sent, elapsed_ns / 1000);
+
+    free(c->body_owned);
+    c->body_owned = NULL;
+    free(c->parts_owned);
+    c->parts_owned = NULL;
+    if (c->open_file) {
+        fd_cache_release(c->open_file); /* The cache owns the fd */
+        c->open_file = NULL;
+    } else if (c->file_fd >= 0) {
+        close(c->file_fd);
+    }
+    c->file_fd = -1;
+    cache_release(c->cache_ref);
+    c->cache_ref = NULL;
+    c->status_code = 0;
+}
+
+/*
+ * Try Resolve
+ * Purpose: Feeds the buffered bytes to the incremental parser and resolves
+ * the request once its header block is complete. A header block that does
+ * not fit in the buffer is answered with 431.
+ *
+ * Return: CONN_WANT_WRITE if a response is ready, CONN_WANT_READ otherwise.
+ */
+static int conn_try_resolve(conn_t *c)
+{
+    int rc = http_parse_request(&c->parser, c->rbuf, c->rlen, &c->req);
+    if (rc == HTTP_PARSE_INCOMPLETE)
+    {
+        if (c->rlen < CONN_BUF_SIZE - 1)
+            return CONN_WANT_READ;
+        c->keep_alive = 0;
+        conn_set_error(c, 431);
+        return CONN_WANT_WRITE;
+    }
+    if (rc == HTTP_PARSE_ERROR)
+    {
+        c->keep_alive = 0;
+        conn_set_error(c, 400);
+        return CONN_WANT_WRITE;
+    }
+
+    c->req_len = (size_t)rc;
+    conn_resolve(c, 0);
+    return CONN_WANT_WRITE;
+}
+
+/*
+ * Next Request
+ * Purpose: Resets a kept-alive connection for its next request. Bytes the
+ * client already sent past the current request (pipelining) are kept and
+ * resolved right away if they hold a complete request.
+ *
+ * Return: CONN_WANT_WRITE or CONN_WANT_READ; CONN_CLOSE if the request had
+ * a body, since bodies are not read and the next request's start is unknown.
+ */
+static int conn_next_request(conn_t *c)
+{
+    if (http_has_body(&c->req))
+        return CONN_CLOSE;
+
+    size_t leftover = c->rlen - c->req_len;
+    memmove(c->rbuf, c->rbuf + c->req_len, leftover);
+    c->rlen = leftover;
+    c->rbuf[c->rlen] = '\0';
+    c->req_len = 0;
+    memset(&c->req, 0, sizeof(c->req));
+    http_parser_reset(&c->parser);
+
+    c->requests++;
+    c->state = CONN_READING;
+    c->header_len = 0;
+    c->body_len = 0;
+    c->seg_count = 0;
+    c->seg_idx = 0;
+    c->seg_off = 0;
+    c->sent = 0;
+    c->bytes_sent = 0;
+
+    if (c->rlen == 0)
+        return CONN_WANT_READ;
+
+    clock_gettime(CLOCK_MONOTONIC, &c->start_time);
+    return conn_try_resolve(c);
+}
+
+/*
+ * Handle Readable Socket
+ * Purpose: Reads whatever request bytes are available. Once the header is
+ * complete (blank line) or the buffer is full, resolves the request and
+ * moves to the sending state.
+ *
+ * Return: CONN_WANT_READ, CONN_WANT_WRITE or CONN_CLOSE.
+ */
+int conn_on_readable(conn_t *c)
+{
+    if (c->state == CONN_SENDING)
+        return CONN_WANT_WRITE;
+
+    ssize_t bytes = recv(c->info.fd, c->rbuf + c->rlen, CONN_BUF_SIZE - 1 - c->rlen, 0);
+    if (bytes < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return CONN_WANT_READ;
+        return CONN_CLOSE;
+    }
+    if (bytes == 0) {
+        return CONN_CLOSE; /* Connection closed by the client */
+    }
+
+    /* On a kept-alive connection the request timer starts at its first byte */
+    if (c->rlen == 0 && c->requests > 0)
+        clock_gettime(CLOCK_MONOTONIC, &c->start_time);
+
+    c->rlen += bytes;
+    c->rbuf[c->rlen] = '\0';
+
+    return conn_try_resolve(c);
+}
+
+/*
+ * Handle Writable Socket
+ * Purpose: Writes as much of the pending header + body as the socket takes:
+ * header and in-memory body in one sendmsg(), file bodies with sendfile().
+ * Partial writes resume on the next call.
+ *
+ * Return: CONN_WANT_WRITE while bytes remain. Once the response is complete:
+ * CONN_CLOSE, or for a kept-alive connection whatever the next request
+ * needs (CONN_WANT_READ, or CONN_WANT_WRITE if it was already pipelined).
+ */
+int conn_on_writable(conn_t *c)
+{
+    if (c->state != CONN_SENDING)
+        return CONN_WANT_READ;
+
+    while (c->seg_idx < c->seg_count) {
+        conn_segment_t *seg = &c->segs[c->seg_idx];
+        ssize_t n;
+
+        if (!seg->data) {
+            /* File slice: the kernel copies page cache -> socket */
+            off_t offset = seg->offset + (off_t)c->seg_off;
+            n = sendfile(c->info.fd, c->file_fd, &offset, seg->len - c->seg_off);
+            if (n == 0) {
+                /* File shrank under us: the promised length can't be met */
+                errno = EIO;
+                n = -1;
+            }
+        } else {
+            /* Gather the run of in-memory segments into one sendmsg() */
+            struct iovec iov[CONN_MAX_SEGMENTS];
+            int iovcnt = 0, i = c->seg_idx;
+            for (; i < c->seg_count && c->segs[i].data; i++, iovcnt++) {
+                size_t skip = (i == c->seg_idx) ? c->seg_off : 0;
+                iov[iovcnt].iov_base = (char *)c->segs[i].data + skip;
+                iov[iovcnt].iov_len = c->segs[i].len - skip;
+            }
+
+            struct msghdr msg = {0};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            /* MSG_MORE: let the memory run share a segment with the file data */
+            int flags = MSG_NOSIGNAL | (i < c->seg_count ? MSG_MORE : 0);
+            n = sendmsg(c->info.fd, &msg, flags);
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return CONN_WANT_WRITE;
+            /* Client went away: report what was actually delivered */
+            c->bytes_sent = (c->sent > c->header_len) ? (long)(c->sent - c->header_len) : 0;
+            conn_finish_request(c);
+            return CONN_CLOSE;
+        }
+        c->sent += n;
+
+        /* Advance the cursor over what was written */
+        size_t left = (size_t)n;
+        while (left > 0 && c->seg_idx < c->seg_count) {
+            size_t rest = c->segs[c->seg_idx].len - c->seg_off;
+            if (left < rest) {
+                c->seg_off += left;
+                break;
+            }
+            left -= rest;
+            c->seg_idx++;
+            c->seg_off = 0;
+        }
+    }
+
+    conn_finish_request(c);
+    if (!c->keep_alive)
+        return CONN_CLOSE;
+    return conn_next_request(c);
+}
+
+/*
+ * Close Connection
+ * Purpose: Releases everything the connection holds. A request that was
+ * resolved but never finished (e.g. shutdown mid-send) is still logged.
+ */
+void conn_close(conn_t *c)
+{
+    if (c->state == CONN_SENDING && c->status_code != 0) {
+        c->bytes_sent = (c->sent > c->header_len) ? (long)(c->sent - c->header_len) : 0;
+        conn_finish_request(c);
+    }
+
+    close(c->info.fd);
+
+    stats_connection_closed();
+}
+
+/*
+ * Idle Check
+ * Purpose: Tells whether a kept-alive connection is waiting between
+ * requests (nothing buffered, nothing to send), i.e. safe to drop.
+ */
+int conn_is_idle(const conn_t *c)
+{
+    return c->state == CONN_READING && c->rlen == 0 && c->requests > 0;
+}
@@ -0,0 +1,97 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include "ipc.h"
+#include "http.h"
+#include "cache.h"
+#include "fd_cache.h"
+
+#define CONN_BUF_SIZE 2048
+#define CONN_HEADER_SIZE 1024
+
+/* Header + one part header and data slice per range + closing boundary */
+#define CONN_MAX_SEGMENTS (2 + 2 * HTTP_MAX_RANGES)
+
+/* What the connection needs next (returned by conn_on_readable/writable) */
+#define CONN_CLOSE      0 /* Done or failed: the caller must conn_close() it */
+#define CONN_WANT_READ  1 /* Waiting for more request bytes */
+#define CONN_WANT_WRITE 2 /* Response pending: socket must become writable */
+
+/*
+ * Response Segment
+ * A slice of the response: bytes in memory, or (data NULL) 'len' bytes of
+ * the connection's file starting at 'offset', sent with sendfile().
+ */
+typedef struct {
+    const char *data;
+    off_t offset;
+    size_t len;
+} conn_segment_t;
+
+typedef enum {
+    CONN_READING, /* Accumulating the request */
+    CONN_SENDING  /* Writing header + body */
+} conn_state_t;
+
+/*
+ * Client Connection
+ * A resumable request/response state machine: read -> parse -> resolve ->
+ * send, then back to read for the next request when the connection is kept
+ * alive. Blocking threads drive it to completion in one go; the event loop
+ * drives it with non-blocking sockets, one readiness event at a time.
+ */
+typedef struct conn {
+    conn_info_t info;
+    conn_state_t state;
+    char client_ip[INET_ADDRSTRLEN];
+    struct timespec start_time;
+
+    /* Request */
+    char rbuf[CONN_BUF_SIZE];
+    size_t rlen;
+    size_t req_len;       /* Bytes of rbuf taken by the current request */
+    http_parser_t parser;
+    http_request_t req;
+
+    /* Keep-alive */
+    int keep_alive;       /* Keep the connection open after this response */
+    int requests;         /* Responses completed on this connection */
+    int pooled;           /* Served by a pool thread: yield when others queue */
+
+    /* Response: the header, then body segments, sent in order */
+    char header[CONN_HEADER_SIZE];
+    size_t header_len;
+    conn_segment_t segs[CONN_MAX_SEGMENTS];
+    int seg_count;
+    int seg_idx;          /* Send cursor: current segment ... */
+    size_t seg_off;       /* ... and bytes of it already written */
+    size_t body_len;      /* Body bytes (all segments after the header) */
+    char *body_owned;     /* Heap buffer backing a body segment, freed on completion */
+    char *parts_owned;    /* Multipart range headers, freed on completion */
+    int file_fd;          /* File backing file segments (-1 if none) */
+    const cache_node_t *cache_ref; /* Cache entry backing a body segment, released on completion */
+    const fd_cache_entry_t *open_file; /* Open file cache entry owning file_fd, released on completion */
+    size_t sent;          /* Header + body bytes written so far */
+    int status_code;
+    int expires_in;       /* max-age of the Cache-Control rule (-1: no Expires) */
+    long bytes_sent;      /* Body bytes reported in stats and logs */
+
+    /* Event loop bookkeeping */
+    unsigned int events;  /* Current epoll interest set */
+    time_t last_active;   /* Monotonic seconds of the last I/O event */
+    struct conn *prev, *next;
+} conn_t;
+
+void conn_init(conn_t *c, const conn_info_t *info);
+int conn_on_readable(conn_t *c);
+int conn_on_writable(conn_t *c);
+void conn_close(conn_t *c);
+int conn_is_idle(const conn_t *c);
+size_t conn_preload_file(const char *full_path, const struct stat *st);
+
+#endif
@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "event_loop.h"
+#include "connection.h"
+#include "shared_mem.h"
+#include "ipc.h"
+#include "config.h"
+
+extern server_config_t config;
+
+/* EPOLLEXCLUSIVE (Linux 4.5+) may be missing from older libc headers */
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+#define EVENT_BATCH 64                /* Events handled per epoll_wait() */
+#define SOURCE_DRAIN_LIMIT 16         /* IPC messages taken per wake-up */
+#define SHUTDOWN_GRACE_MS 5000        /* Time given to unfinished responses */
+#define SEND_STALL_TIMEOUT 60         /* Seconds a response may make no progress */
+
+/*
+ * Sentinel tags stored in epoll_event.data.ptr to tell the two special
+ * descriptors apart from connections (whose data.ptr is the conn_t).
+ */
+static char source_tag;
+static char stop_tag;
+
+/*
+ * Per-Thread Loop State
+ * Each loop owns its connections exclusively: no locking is needed.
+ */
+typedef struct {
+    int epfd;
+    const event_loop_args_t *args;
+    conn_t *conns;     /* Open connections, most recently active first */
+    conn_t *tail;      /* Least recently active connection */
+    int open_conns;
+    unsigned long conn_seq;
+    time_t now;        /* Monotonic seconds, refreshed once per epoll_wait() */
+    time_t last_sweep;
+    int stopping;      /* Shutdown started: no new connections or requests */
+} loop_t;
+
+/*
+ * Connection List Helpers
+ * The list is kept in activity order (LRU) so the idle sweep only has to
+ * look at the tail.
+ */
+static void loop_unlink(loop_t *L, conn_t *c)
+{
+    if (c->prev) c->prev->next = c->next; else L->conns = c->next;
+    if (c->next) c->next->prev = c->prev; else L->tail = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void loop_link_front(loop_t *L, conn_t *c)
+{
+    c->prev = NULL;
+    c->next = L->conns;
+    if (L->conns) L->conns->prev = c; else L->tail = c;
+    L->conns = c;
+}
+
+static void loop_touch(loop_t *L, conn_t *c)
+{
+    c->last_active = L->now;
+    if (L->conns != c) {
+        loop_unlink(L, c);
+        loop_link_front(L, c);
+    }
+}
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/*
+ * Set Interest
+ * Purpose: Switches the epoll interest of a connection between reading and
+ * writing, skipping the syscall when nothing changes.
+ */
+static void loop_set_interest(loop_t *L, conn_t *c, unsigned int events)
+{
+    if (c->events == events) return;
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(L->epfd, EPOLL_CTL_MOD, c->info.fd, &ev);
+    c->events = events;
+}
+
+/*
+ * Release Connection
+ * Purpose: Closes the connection, unlinks it from the loop and frees it.
+ * The FD is removed from the epoll set explicitly: close() alone does not
+ * do it while another process (the Master, until it finishes its send)
+ * still holds a descriptor for the same socket.
+ */
+static void loop_release(loop_t *L, conn_t *c)
+{
+    epoll_ctl(L->epfd, EPOLL_CTL_DEL, c->info.fd, NULL);
+
+    loop_unlink(L, c);
+    L->open_conns--;
+
+    conn_close(c);
+    free(c);
+
+    if (local_load) __atomic_fetch_sub(&local_load->in_flight, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Drive Connection
+ * Purpose: Advances the state machine as far as the socket allows.
+ * A completed read is followed by an optimistic write straight away, since
+ * a fresh socket is almost always writable; epoll is only asked for
+ * EPOLLOUT when the send buffer is actually full.
+ *
+ * Parameters:
+ * - next: What the connection asked for after the last step.
+ */
+static void loop_drive(loop_t *L, conn_t *c, int next)
+{
+    while (next == CONN_WANT_WRITE) {
+        next = conn_on_writable(c);
+        if (next == CONN_WANT_WRITE) {
+            loop_set_interest(L, c, EPOLLOUT);
+            return;
+        }
+    }
+
+    if (next == CONN_WANT_READ && !(L->stopping && conn_is_idle(c))) {
+        loop_set_interest(L, c, EPOLLIN | EPOLLRDHUP);
+        return;
+    }
+
+    loop_release(L, c);
+}
+
+/*
+ * Adopt Connection
+ * Purpose: Takes ownership of a new client socket: makes it non-blocking,
+ * registers it and tries to read the request immediately (it has usually
+ * arrived by the time the connection reaches the loop).
+ *
+ * Parameters:
+ * - info: FD and acceptor metadata.
+ * - nonblocking: Non-zero if the FD is already O_NONBLOCK.
+ */
+static void loop_adopt(loop_t *L, const conn_info_t *info, int nonblocking)
+{
+    if (!nonblocking) {
+        fcntl(info->fd, F_SETFL, O_NONBLOCK);
+    }
+
+    conn_t *c = malloc(sizeof(conn_t));
+    if (!c) {
+        close(info->fd);
+        return;
+    }
+    conn_init(c, info);
+
+    c->events = EPOLLIN | EPOLLRDHUP;
+    struct epoll_event ev = { .events = c->events, .data.ptr = c };
+    if (epoll_ctl(L->epfd, EPOLL_CTL_ADD, info->fd, &ev) < 0) {
+        perror("epoll_ctl conn");
+        conn_close(c);
+        free(c);
+        return;
+    }
+
+    c->last_active = L->now;
+    loop_link_front(L, c);
+    L->open_conns++;
+    if (local_load) __atomic_fetch_add(&local_load->in_flight, 1, __ATOMIC_RELAXED);
+
+    loop_drive(L, c, conn_on_readable(c));
+}
+
+/*
+ * Drain Source
+ * Purpose: Takes new connections from the shared source. Several loops (and
+ * in shared/reuseport modes, several workers) watch the same source with
+ * EPOLLEXCLUSIVE, so losing the race (EAGAIN) is normal.
+ *
+ * Return: 0 normally, -1 if the source is gone (IPC channel closed).
+ */
+static int loop_drain_source(loop_t *L)
+{
+    const event_loop_args_t *args = L->args;
+
+    if (args->source_is_listener) {
+        while (1) {
+            conn_info_t info;
+            socklen_t peer_len = sizeof(info.peer);
+            info.fd = accept4(args->source_fd, (struct sockaddr *)&info.peer, &peer_len,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (info.fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+                return 0;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &info.accepted_at);
+            info.conn_id = ++L->conn_seq;
+            loop_adopt(L, &info, 1);
+        }
+    }
+
+    for (int m = 0; m < SOURCE_DRAIN_LIMIT; m++) {
+        conn_info_t conns[IPC_MAX_FDS];
+        int count = recv_conns(args->source_fd, conns, IPC_MAX_FDS);
+        if (count < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        if (local_load) __atomic_fetch_sub(&local_load->pending, count, __ATOMIC_RELAXED);
+        for (int i = 0; i < count; i++) {
+            loop_adopt(L, &conns[i], 0);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Idle Sweep
+ * Purpose: Closes connections that have been quiet for too long, walking
+ * from the least recently active end of the list:
+ * - Connections waiting for a request (idle keep-alive, or a client that
+ *   stopped mid-header) after KEEPALIVE_TIMEOUT seconds.
+ * - Responses that made no progress for SEND_STALL_TIMEOUT seconds.
+ */
+static void loop_sweep_idle(loop_t *L)
+{
+    int read_timeout = config.keepalive_timeout > 0 ? config.keepalive_timeout : SEND_STALL_TIMEOUT;
+
+    conn_t *c = L->tail;
+    while (c && L->now - c->last_active >= read_timeout) {
+        conn_t *prev = c->prev;
+        if (c->state == CONN_READING || L->now - c->last_active >= SEND_STALL_TIMEOUT) {
+            loop_release(L, c);
+        }
+        c = prev;
+    }
+}
+
+/*
+ * Begin Shutdown
+ * Purpose: Stops taking new connections and closes the ones still waiting
+ * for a request. Responses already being sent are allowed to finish.
+ */
+static void loop_begin_shutdown(loop_t *L)
+{
+    epoll_ctl(L->epfd, EPOLL_CTL_DEL, L->args->source_fd, NULL);
+
+    conn_t *c = L->conns;
+    while (c) {
+        conn_t *next = c->next;
+        if (c->state == CONN_READING) {
+            loop_release(L, c);
+        }
+        c = next;
+    }
+}
+
+/*
+ * Event Loop Thread Entry Point
+ * Purpose: Serves many non-blocking connections on one thread. A slow
+ * client only costs its conn_t, never a thread, so concurrency is bounded
+ * by memory rather than by THREADS_PER_WORKER.
+ *
+ * Logic:
+ * 1. The source (IPC socket or listener) is watched with EPOLLEXCLUSIVE so
+ *    each new connection wakes a single loop.
+ * 2. Connection events advance the state machine (see connection.c).
+ * 3. When stop_fd fires, the loop stops accepting, closes idle connections
+ *    and exits once in-flight responses finish (or the grace period ends).
+ */
+void *event_loop_thread(void *arg)
+{
+    loop_t L = {0};
+    L.args = (const event_loop_args_t *)arg;
+    L.now = L.last_sweep = monotonic_seconds();
+    L.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (L.epfd < 0) {
+        perror("epoll_create1");
+        return NULL;
+    }
+
+    /* Connection IDs: acceptor (worker index + 1) in the top bits, loop
+     * thread in the next byte, so they stay unique server-wide.
+     */
+    if (local_load) {
+        L.conn_seq = (unsigned long)(local_load - worker_loads + 1) << 48;
+    }
+    L.conn_seq |= ((unsigned long)pthread_self() & 0xff) << 40;
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &source_tag };
+    if (epoll_ctl(L.epfd, EPOLL_CTL_ADD, L.args->source_fd, &ev) < 0) {
+        perror("epoll_ctl source");
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &stop_tag;
+    epoll_ctl(L.epfd, EPOLL_CTL_ADD, L.args->stop_fd, &ev);
+
+    int stop_requested = 0;
+    struct timespec deadline = {0};
+
+    while (!L.stopping || L.open_conns > 0) {
+        struct epoll_event events[EVENT_BATCH];
+        /* Wake up at least once a second while connections are open, for the idle sweep */
+        int wait_ms = L.stopping ? 100 : (L.open_conns > 0 ? 1000 : -1);
+        int n = epoll_wait(L.epfd, events, EVENT_BATCH, wait_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        L.now = monotonic_seconds();
+
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+
+            if (ptr == &stop_tag) {
+                stop_requested = 1;
+                continue;
+            }
+
+            if (ptr == &source_tag) {
+                if (!L.stopping && loop_drain_source(&L) < 0) {
+                    /* Master closed the channel: stop polling it */
+                    epoll_ctl(L.epfd, EPOLL_CTL_DEL, L.args->source_fd, NULL);
+                }
+                continue;
+            }
+
+            conn_t *c = (conn_t *)ptr;
+            loop_touch(&L, c);
+            if (events[i].events & EPOLLOUT) {
+                loop_drive(&L, c, CONN_WANT_WRITE);
+            } else {
+                loop_drive(&L, c, conn_on_readable(c));
+            }
+        }
+
+        if (L.now != L.last_sweep) {
+            L.last_sweep = L.now;
+            loop_sweep_idle(&L);
+        }
+
+        /* Handled after the batch: later events may still refer to the
+         * connections that shutdown closes.
+         */
+        if (stop_requested && !L.stopping) {
+            L.stopping = 1;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += SHUTDOWN_GRACE_MS / 1000;
+            loop_begin_shutdown(&L);
+        }
+
+        if (L.stopping) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (now.tv_sec > deadline.tv_sec ||
+                (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+                break;
+            }
+        }
+    }
+
+    /* Grace period over: drop whatever is left */
+    while (L.conns) {
+        loop_release(&L, L.conns);
+    }
+
+    close(L.epfd);
+    return NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+/* Arguments shared by all event loop threads of a worker */
+typedef struct {
+    int source_fd;          /* Non-blocking IPC socket or listening socket */
+    int source_is_listener; /* 1: accept4() on source_fd, 0: recv_conns() */
+    int stop_fd;            /* eventfd written once to stop every loop */
+} event_loop_args_t;
+
+void *event_loop_thread(void *arg);
+
+#endif
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+
+#include "fd_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FD_CACHE_BUCKETS 1024
+
+/* * Open File Cache
+ * Keeps large files open between requests (like nginx's open_file_cache),
+ * so a popular download skips the path walk, open() and close(): a hit
+ * goes straight to sendfile(). Entries are found by path in a hash table
+ * and kept on an LRU list; past 'max_entries' the least recently used is
+ * dropped (its fd stays open until the last response using it is done).
+ *
+ * An entry is trusted for 'ttl' seconds, then re-validated with one stat():
+ * if the path now names another file (inode, size or mtime changed) it is
+ * replaced. The cache watcher drops changed paths right away.
+ *
+ * One mutex guards the table, the list and the reference counts; open()
+ * and stat() run outside it.
+ */
+static struct {
+    pthread_mutex_t lock;
+    fd_cache_entry_t *buckets[FD_CACHE_BUCKETS];
+    fd_cache_entry_t *head, *tail;   /* Most / least recently used */
+    size_t count;
+    size_t max_entries;
+    long ttl_ms;
+    int enabled;
+} fdc = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static unsigned long hash_str(const char *s)
+{
+    unsigned long h = 5381;
+    int c;
+    while ((c = *s++)) h = ((h << 5) + h) + (unsigned long)c;
+    return h;
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * Initialize the open file cache.
+ * Parameters:
+ * - max_entries: Files kept open (0 disables caching: fd_cache_open()
+ *   then opens the file for each call).
+ * - ttl: Seconds before an entry is re-validated against its path.
+ * Return: 0.
+ */
+int fd_cache_init(size_t max_entries, int ttl)
+{
+    fdc.max_entries = max_entries;
+    fdc.ttl_ms = ttl > 0 ? ttl * 1000L : 0;
+    fdc.enabled = (max_entries > 0);
+    return 0;
+}
+
+/* Drops one reference; the last one closes the file. Caller holds the lock. */
+static void entry_unref(fd_cache_entry_t *e)
+{
+    if (--e->refcount > 0) return;
+    close(e->fd);
+    free(e);
+}
+
+/*
+ * Internal removal helper.
+ * Purpose: Unlinks an entry from the table and the LRU list and drops the
+ * cache's reference.
+ * Note: Caller must hold the lock.
+ */
+static void detach_entry(fd_cache_entry_t *e)
+{
+    fd_cache_entry_t **link = &fdc.buckets[e->hash % FD_CACHE_BUCKETS];
+    while (*link && *link != e) link = &(*link)->hnext;
+    if (*link) *link = e->hnext;
+
+    if (e->prev) e->prev->next = e->next; else fdc.head = e->next;
+    if (e->next) e->next->prev = e->prev; else fdc.tail = e->prev;
+    fdc.count--;
+    entry_unref(e);
+}
+
+static void lru_push_front(fd_cache_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = fdc.head;
+    if (fdc.head) fdc.head->prev = e; else fdc.tail = e;
+    fdc.head = e;
+}
+
+static fd_cache_entry_t *find_entry(const char *path, unsigned long hash)
+{
+    fd_cache_entry_t *e = fdc.buckets[hash % FD_CACHE_BUCKETS];
+    while (e && (e->hash != hash || strcmp(e->path, path) != 0)) e = e->hnext;
+    return e;
+}
+
+void fd_cache_destroy(void)
+{
+    pthread_mutex_lock(&fdc.lock);
+    while (fdc.head) detach_entry(fdc.head);
+    fdc.enabled = 0;
+    pthread_mutex_unlock(&fdc.lock);
+}
+
+/* Same file as when the entry was opened? */
+static int same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_ino == b->st_ino && a->st_dev == b->st_dev &&
+           a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
+
+/*
+ * Open a File
+ * Purpose: Returns an open descriptor for 'path' with its attributes, from
+ * the cache when possible. The caller streams from entry->fd and must call
+ * fd_cache_release() when done (never close() the fd itself).
+ *
+ * Logic:
+ * 1. Hit within the TTL: move to the front of the LRU, take a reference.
+ * 2. Hit past the TTL: stat() the path; unchanged files are trusted for
+ *    another TTL, changed ones are dropped and reopened.
+ * 3. Miss: open() + fstat() outside the lock, then insert (replacing an
+ *    entry another thread inserted meanwhile), evicting the LRU entry if
+ *    the cache is full.
+ *
+ * Return: The entry (with a reference held), or NULL if the file cannot be
+ * opened (errno set).
+ */
+const fd_cache_entry_t *fd_cache_open(const char *path)
+{
+    unsigned long h = hash_str(path);
+
+    if (fdc.enabled) {
+        pthread_mutex_lock(&fdc.lock);
+        fd_cache_entry_t *e = find_entry(path, h);
+        if (e && now_ms() - e->validated_ms >= fdc.ttl_ms) {
+            /* Re-validate outside the lock; the reference keeps 'e' alive */
+            e->refcount++;
+            pthread_mutex_unlock(&fdc.lock);
+            struct stat st;
+            int same = (stat(path, &st) == 0 && same_file(&st, &e->st));
+            pthread_mutex_lock(&fdc.lock);
+            int indexed = (find_entry(path, h) == e); /* Not invalidated meanwhile */
+            if (same && indexed)
+                e->validated_ms = now_ms();
+            else if (indexed)
+                detach_entry(e);
+            entry_unref(e);
+            if (!same || !indexed) e = NULL;
+        }
+        if (e) {
+            e->refcount++;
+            if (fdc.head != e) {
+                if (e->prev) e->prev->next = e->next;
+                if (e->next) e->next->prev = e->prev; else fdc.tail = e->prev;
+                lru_push_front(e);
+            }
+            pthread_mutex_unlock(&fdc.lock);
+            return e;
+        }
+        pthread_mutex_unlock(&fdc.lock);
+    }
+
+    /* Miss: open outside the lock */
+    size_t path_len = strlen(path);
+    fd_cache_entry_t *n = malloc(sizeof(fd_cache_entry_t) + path_len + 1);
+    if (!n) return NULL;
+    n->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (n->fd < 0 || fstat(n->fd, &n->st) != 0) {
+        if (n->fd >= 0) close(n->fd);
+        free(n);
+        return NULL;
+    }
+    n->path = (char *)(n + 1);
+    memcpy(n->path, path, path_len + 1);
+    n->hash = h;
+    n->validated_ms = now_ms();
+    n->refcount = 1;                /* The caller's */
+    n->hnext = n->prev = n->next = NULL;
+
+    pthread_mutex_lock(&fdc.lock);
+    if (fdc.enabled && S_ISREG(n->st.st_mode)) {
+        fd_cache_entry_t *old = find_entry(path, h);
+        if (old) detach_entry(old); /* Ours is at least as fresh */
+        n->refcount++;              /* The cache's */
+        n->hnext = fdc.buckets[h % FD_CACHE_BUCKETS];
+        fdc.buckets[h % FD_CACHE_BUCKETS] = n;
+        lru_push_front(n);
+        fdc.count++;
+        if (fdc.count > fdc.max_entries) detach_entry(fdc.tail);
+    }
+    pthread_mutex_unlock(&fdc.lock);
+    return n;
+}
+
+/*
+ * Return a borrowed entry.
+ * Purpose: Drops the reference taken by fd_cache_open(). If the entry was
+ * evicted or invalidated in the meantime, this closes the file.
+ */
+void fd_cache_release(const fd_cache_entry_t *entry)
+{
+    if (!entry) return;
+    pthread_mutex_lock(&fdc.lock);
+    entry_unref((fd_cache_entry_t *)entry);
+    pthread_mutex_unlock(&fdc.lock);
+}
+
+/*
+ * Invalidate paths.
+ * Purpose: Drops the entry for a file that changed on disk or, with
+ * 'subtree' set, every entry below directory 'path'. Responses already
+ * streaming keep their descriptor until they finish.
+ */
+void fd_cache_invalidate(const char *path, int subtree)
+{
+    pthread_mutex_lock(&fdc.lock);
+    if (!subtree) {
+        fd_cache_entry_t *e = find_entry(path, hash_str(path));
+        if (e) detach_entry(e);
+    } else {
+        size_t len = strlen(path);
+        fd_cache_entry_t *e = fdc.head;
+        while (e) {
+            fd_cache_entry_t *next = e->next;
+            if (strncmp(e->path, path, len) == 0 && e->path[len] == '/') detach_entry(e);
+            e = next;
+        }
+    }
+    pthread_mutex_unlock(&fdc.lock);
+}
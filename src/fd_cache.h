@@ -0,0 +1,32 @@
+#ifndef FD_CACHE_H
+#define FD_CACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/*
+ * Open File
+ * A file descriptor shared by every response streaming the same file; it is
+ * only read with sendfile() at explicit offsets, so the shared file position
+ * is never used. 'refcount' counts the cache's own reference (while
+ * indexed) plus one per borrower; the fd is closed when it drops to zero.
+ */
+typedef struct fd_cache_entry {
+    int fd;
+    struct stat st;       /* fstat() of 'fd' */
+    char *path;
+    unsigned long hash;
+    int refcount;
+    long validated_ms;    /* Last time 'path' was checked to still be this file */
+    struct fd_cache_entry *hnext;
+    struct fd_cache_entry *prev, *next; /* LRU list (most recent first) */
+} fd_cache_entry_t;
+
+int fd_cache_init(size_t max_entries, int ttl);
+void fd_cache_destroy(void);
+const fd_cache_entry_t *fd_cache_open(const char *path);
+void fd_cache_release(const fd_cache_entry_t *entry);
+void fd_cache_invalidate(const char *path, int subtree);
+
+#endif
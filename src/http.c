@@ -1,98 +1,946 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>      
 #include <string.h>     
+#include <strings.h>
 #include <sys/socket.h> 
+#include <sys/uio.h>
 #include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "http.h"
 
 /*
- * Parse HTTP Request
- * Purpose: Extracts the Method (GET/POST), Path, and HTTP Version from the 
- * raw request buffer. It only parses the first line (Request Line) as that 
- * is sufficient for this server's static file serving needs.
+ * Delimiter Scanning
+ * Purpose: Finds the first byte of 'set' (1-3 delimiter characters) in
+ * [p, end), returning 'end' if there is none. Every parser step is built on
+ * this, so it has vectorized versions picked once at runtime:
+ * - AVX2: 32 bytes per step (one compare per delimiter, OR-ed together).
+ * - SSE4.2: 16 bytes per step with PCMPESTRI's "equal any" mode.
+ * - Scalar fallback for other CPUs and for the tail of the buffer.
+ * The vector loops only load whole blocks inside [p, end), never past it.
+ */
+typedef const char *(*scan_fn_t)(const char *p, const char *end, const char *set, int nset);
+
+static const char *scan_scalar(const char *p, const char *end, const char *set, int nset)
+{
+    for (; p < end; p++)
+    {
+        for (int i = 0; i < nset; i++)
+        {
+            if (*p == set[i])
+                return p;
+        }
+    }
+    return end;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static const char *scan_sse42(const char *p, const char *end, const char *set, int nset)
+{
+    char needle_buf[16] = {0};
+    memcpy(needle_buf, set, nset);
+    __m128i needles = _mm_loadu_si128((const __m128i *)needle_buf);
+
+    while (end - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(needles, nset, chunk, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return p + idx;
+        p += 16;
+    }
+    return scan_scalar(p, end, set, nset);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_avx2(const char *p, const char *end, const char *set, int nset)
+{
+    __m256i d0 = _mm256_set1_epi8(set[0]);
+    __m256i d1 = _mm256_set1_epi8(set[nset > 1 ? 1 : 0]);
+    __m256i d2 = _mm256_set1_epi8(set[nset > 2 ? 2 : 0]);
+
+    while (end - p >= 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, d0),
+                                                       _mm256_cmpeq_epi8(chunk, d1)),
+                                       _mm256_cmpeq_epi8(chunk, d2));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return scan_scalar(p, end, set, nset);
+}
+#endif
+
+static scan_fn_t scan_impl;
+
+static const char *scan_delims(const char *p, const char *end, const char *set, int nset)
+{
+    scan_fn_t fn = __atomic_load_n(&scan_impl, __ATOMIC_RELAXED);
+    if (!fn)
+    {
+        /* First use: pick the widest implementation the CPU supports (racing threads pick the same) */
+        fn = scan_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            fn = scan_avx2;
+        else if (__builtin_cpu_supports("sse4.2"))
+            fn = scan_sse42;
+#endif
+        __atomic_store_n(&scan_impl, fn, __ATOMIC_RELAXED);
+    }
+    return fn(p, end, set, nset);
+}
+
+/*
+ * Helper: Copy Token
+ * Purpose: Bounded copy of [s, e) into a NUL-terminated field.
+ * Return: 0 on success, -1 if the token is empty or does not fit.
+ */
+static int copy_token(char *dst, size_t cap, const char *s, const char *e)
+{
+    size_t len = e - s;
+    if (len == 0 || len >= cap)
+        return -1;
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+    return 0;
+}
+
+/*
+ * Helper: Match Known Header
+ * Purpose: Records the headers the server acts on. Dispatching on the name
+ * length first keeps this to at most one comparison per header line.
+ */
+static void match_known_header(http_request_t *req, http_slice_t name, http_slice_t value)
+{
+    http_slice_t *slot = NULL;
+    const char *expect = NULL;
+
+    switch (name.len)
+    {
+    case 4:  expect = "host";              slot = &req->host;              break;
+    case 5:  expect = "range";             slot = &req->range;             break;
+    case 8:  expect = "if-range";          slot = &req->if_range;          break;
+    case 10: expect = "connection";        slot = &req->connection;        break;
+    case 13: expect = "if-none-match";     slot = &req->if_none_match;     break;
+    case 14: expect = "content-length";    slot = &req->content_length;    break;
+    case 15: expect = "accept-encoding";   slot = &req->accept_encoding;   break;
+    case 17:
+        /* Two known names share this length */
+        if (name.ptr[0] == 't' || name.ptr[0] == 'T') {
+            expect = "transfer-encoding"; slot = &req->transfer_encoding;
+        } else {
+            expect = "if-modified-since"; slot = &req->if_modified_since;
+        }
+        break;
+    default: return;
+    }
+
+    if (strncasecmp(name.ptr, expect, name.len) == 0)
+        *slot = value;
+}
+
+/*
+ * Reset Parser
+ * Purpose: Prepares the parser for a new request (buffer starting at 0).
+ */
+void http_parser_reset(http_parser_t *parser)
+{
+    parser->scanned = 0;
+}
+
+/*
+ * Parse HTTP Request (Incremental)
+ * Purpose: Parses the request line and headers in place. Call it again
+ * after every read with the whole buffer so far; bytes already searched
+ * for the end of the header block are not searched again, so a request
+ * arriving in many small reads still costs one pass over its bytes.
  *
  * Parameters:
- * - buffer: The raw data received from the client socket.
- * - req: Pointer to the http_request_t struct to populate.
+ * - parser: Resumable state (reset with http_parser_reset per request).
+ * - buf/len: Received bytes; need not be NUL-terminated.
+ * - req: Filled in on success. Header slices point into 'buf' and stay
+ *   valid only as long as the buffer is not modified.
  *
  * Return:
- * - 0 on successful parsing.
- * - -1 if the request line is malformed or incomplete.
- */
-int parse_http_request(const char *buffer, http_request_t *req)
-{
-    /* Find the end of the request line (marked by CRLF) */
-    char *line_end = strstr(buffer, "\r\n");
-
-    if (!line_end)
-        return -1; /* Incomplete request */
-
-    /* Copy the first line to a temporary buffer for safe parsing */
-    char first_line[1024];
-    size_t len = line_end - buffer;
-    
-    /* Ensure we don't overflow the temp buffer */
-    if (len >= sizeof(first_line))
-        len = sizeof(first_line) - 1;
-        
-    strncpy(first_line, buffer, len);
-    first_line[len] = '\0';
-
-    /* * Extract the three standard components:
-     * 1. Method (e.g., "GET")
-     * 2. Path (e.g., "/index.html")
-     * 3. Version (e.g., "HTTP/1.1")
-     */
-    if (sscanf(first_line, "%s %s %s", req->method, req->path, req->version) != 3)
+ * - Length of the request header block (> 0) once complete. Any bytes after
+ *   it belong to the next (pipelined) request, unless the request has a body
+ *   (see http_has_body), which is not parsed.
+ * - HTTP_PARSE_INCOMPLETE if the blank line has not arrived yet.
+ * - HTTP_PARSE_ERROR if the request is malformed.
+ *
+ * Logic:
+ * 1. Find the blank line ending the header block (scan for LF, look back).
+ * 2. Split the request line into method, path and version (bounded copies).
+ * 3. Split each header line at ':' and trim the value.
+ */
+int http_parse_request(http_parser_t *parser, const char *buf, size_t len, http_request_t *req)
+{
+    const char *end = buf + len;
+
+    /* 1. Locate the end of the header block ("\n\n" or "\n\r\n") */
+    const char *hdr_end = NULL;
+    const char *s = buf + parser->scanned;
+    while ((s = scan_delims(s, end, "\n", 1)) < end)
+    {
+        size_t i = s - buf;
+        if ((i >= 1 && buf[i - 1] == '\n') || (i >= 2 && buf[i - 1] == '\r' && buf[i - 2] == '\n'))
+        {
+            hdr_end = s + 1;
+            break;
+        }
+        s++;
+    }
+    if (!hdr_end)
+    {
+        parser->scanned = len;
+        return HTTP_PARSE_INCOMPLETE;
+    }
+
+    memset(req, 0, sizeof(*req));
+
+    /* 2. Request line: METHOD SP PATH SP VERSION */
+    const char *eol = scan_delims(buf, hdr_end, "\n", 1);
+    const char *line_end = (eol > buf && eol[-1] == '\r') ? eol - 1 : eol;
+
+    const char *sp1 = scan_delims(buf, line_end, " ", 1);
+    if (sp1 == line_end || copy_token(req->method, sizeof(req->method), buf, sp1) != 0)
+        return HTTP_PARSE_ERROR;
+
+    const char *sp2 = scan_delims(sp1 + 1, line_end, " ", 1);
+    if (sp2 == line_end || copy_token(req->path, sizeof(req->path), sp1 + 1, sp2) != 0)
+        return HTTP_PARSE_ERROR;
+
+    if (copy_token(req->version, sizeof(req->version), sp2 + 1, line_end) != 0 ||
+        strncmp(req->version, "HTTP/", 5) != 0)
+        return HTTP_PARSE_ERROR;
+
+    /* 3. Header lines: NAME ":" OWS VALUE OWS */
+    const char *line = eol + 1;
+    while (line < hdr_end)
     {
+        const char *delim = scan_delims(line, hdr_end, ":\n", 2);
+        if (*delim == '\n')
+        {
+            if (delim == line || (delim == line + 1 && *line == '\r'))
+                break; /* Blank line: end of headers */
+            return HTTP_PARSE_ERROR; /* No colon */
+        }
+        if (delim == line)
+            return HTTP_PARSE_ERROR; /* Empty name */
+
+        const char *nl = scan_delims(delim + 1, hdr_end, "\n", 1);
+        const char *v = delim + 1;
+        const char *ve = (nl > v && nl[-1] == '\r') ? nl - 1 : nl;
+        while (v < ve && (*v == ' ' || *v == '\t'))
+            v++;
+        while (ve > v && (ve[-1] == ' ' || ve[-1] == '\t'))
+            ve--;
+
+        http_slice_t name = { line, (size_t)(delim - line) };
+        http_slice_t value = { v, (size_t)(ve - v) };
+        if (req->header_count < HTTP_MAX_HEADERS)
+        {
+            req->headers[req->header_count].name = name;
+            req->headers[req->header_count].value = value;
+            req->header_count++;
+        }
+        match_known_header(req, name, value);
+
+        line = nl + 1;
+    }
+
+    return (int)(hdr_end - buf);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Canonical Path
+ * Purpose: Reduces a request target to one spelling per resource, so that
+ * "/a//b", "/a/./b" and "/a/%62" all name the same file (and cache entry).
+ *
+ * Logic:
+ * - The query string and fragment are dropped, %XX escapes decoded.
+ * - Empty and "." segments are removed; a trailing '/' is kept.
+ *
+ * Return:
+ * - 0 on success ('out' starts with '/').
+ * - -1 if the target is malformed (no leading '/', bad escape, NUL byte, too long).
+ * - -2 if a segment is ".." (directory traversal).
+ */
+int http_canonical_path(const char *raw, char *out, size_t out_len)
+{
+    if (raw[0] != '/' || out_len < 2)
         return -1;
+
+    size_t len = 0;
+    const char *p = raw;
+    while (*p && *p != '?' && *p != '#')
+    {
+        /* One segment: decode into 'out' after a separating '/' */
+        while (*p == '/')
+            p++;
+        if (!*p || *p == '?' || *p == '#')
+            break;
+
+        size_t seg_start = len + 1;
+        if (seg_start >= out_len)
+            return -1;
+        out[len] = '/';
+        size_t seg_len = 0;
+        while (*p && *p != '/' && *p != '?' && *p != '#')
+        {
+            char ch = *p++;
+            if (ch == '%')
+            {
+                int hi = hex_value(p[0]), lo = hi < 0 ? -1 : hex_value(p[1]);
+                if (lo < 0)
+                    return -1;
+                ch = (char)(hi * 16 + lo);
+                p += 2;
+                if (ch == '\0')
+                    return -1;
+            }
+            if (ch == '/')
+                break; /* An encoded '/' still ends the segment */
+            if (seg_start + seg_len + 1 >= out_len)
+                return -1;
+            out[seg_start + seg_len++] = ch;
+        }
+
+        if (seg_len == 1 && out[seg_start] == '.')
+            continue; /* "." names the current directory */
+        if (seg_len == 2 && out[seg_start] == '.' && out[seg_start + 1] == '.')
+            return -2;
+        len = seg_start + seg_len;
+    }
+
+    /* Keep the directory marker ("/dir/"), and "/" itself */
+    if (len == 0 || (p > raw && p[-1] == '/'))
+    {
+        if (len + 1 >= out_len)
+            return -1;
+        out[len++] = '/';
+    }
+    out[len] = '\0';
+    return 0;
+}
+
+/*
+ * Header Token Match
+ * Purpose: Checks a comma-separated header value (e.g. Connection or
+ * Accept-Encoding) for a token, ignoring case, whitespace and parameters
+ * after ';'.
+ *
+ * Return:
+ * - 1 if the token is listed, 0 otherwise (or if the header is absent).
+ */
+int http_slice_has_token(http_slice_t slice, const char *token)
+{
+    size_t token_len = strlen(token);
+    const char *p = slice.ptr;
+    const char *end = slice.ptr ? slice.ptr + slice.len : NULL;
+
+    while (p && p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *item = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            p++;
+
+        if ((size_t)(p - item) == token_len && strncasecmp(item, token, token_len) == 0)
+            return 1;
+
+        /* Skip parameters up to the next list element */
+        while (p < end && *p != ',')
+            p++;
+    }
+    return 0;
+}
+
+/* True if [p, end) is a q-value of zero ("0", "0.", "0.000") */
+static int qvalue_is_zero(const char *p, const char *end)
+{
+    if (p >= end || *p != '0')
+        return 0;
+    p++;
+    if (p < end && *p == '.')
+        p++;
+    while (p < end && *p == '0')
+        p++;
+    return p == end;
+}
+
+/*
+ * Content-Coding Negotiation
+ * Purpose: Tells whether an Accept-Encoding value allows a content coding.
+ * The coding is acceptable if it is listed (also as "x-<coding>") with a
+ * non-zero q-value, or, when it is not listed at all, if "*" is listed with
+ * a non-zero q-value. A missing header allows nothing but identity here:
+ * compressed bodies are only sent to clients that ask for them.
+ *
+ * Parameters:
+ * - accept: The Accept-Encoding header value (ptr NULL if absent).
+ * - coding: Coding to test, e.g. "gzip".
+ *
+ * Return:
+ * - 1 if the client accepts the coding, 0 otherwise.
+ */
+int http_accepts_encoding(http_slice_t accept, const char *coding)
+{
+    size_t coding_len = strlen(coding);
+    const char *p = accept.ptr;
+    const char *end = accept.ptr ? accept.ptr + accept.len : NULL;
+    int named = -1; /* Verdict for the coding itself, -1 if not listed */
+    int star = 0;
+
+    while (p && p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *item = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            p++;
+        size_t item_len = (size_t)(p - item);
+        if (item_len >= 2 && strncasecmp(item, "x-", 2) == 0)
+        {
+            item += 2;
+            item_len -= 2;
+        }
+
+        /* Parameters: only "q" matters */
+        int accepted = 1;
+        while (p < end && *p != ',')
+        {
+            if (*p == ';')
+            {
+                p++;
+                while (p < end && (*p == ' ' || *p == '\t'))
+                    p++;
+                if (end - p >= 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=')
+                {
+                    const char *q = p + 2;
+                    p = q;
+                    while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+                        p++;
+                    accepted = !qvalue_is_zero(q, p);
+                    continue;
+                }
+            }
+            p++;
+        }
+
+        if (item_len == coding_len && strncasecmp(item, coding, coding_len) == 0)
+            named = accepted;
+        else if (item_len == 1 && *item == '*')
+            star = accepted;
     }
+    return named >= 0 ? named : star;
+}
 
+/* Reads a decimal number from [*p, end); returns -1 if there is none */
+static int parse_offset(const char **p, const char *end, size_t *out)
+{
+    const char *q = *p;
+    size_t v = 0;
+    while (q < end && *q >= '0' && *q <= '9')
+    {
+        size_t d = (size_t)(*q - '0');
+        if (v > ((size_t)-1 - d) / 10)
+            return -1; /* Overflow */
+        v = v * 10 + d;
+        q++;
+    }
+    if (q == *p)
+        return -1;
+    *p = q;
+    *out = v;
     return 0;
 }
 
 /*
- * Send HTTP Response
- * Purpose: Constructs a valid HTTP/1.1 response header including the status line,
- * date, content type, and length, then sends it followed by the actual body.
+ * Parse Range Header
+ * Purpose: Resolves a "bytes=" Range value against a representation of
+ * 'size' bytes. Each element is "first-last", "first-" or "-suffix";
+ * elements past the end are dropped, and 'last' is clamped to the size.
  *
  * Parameters:
- * - fd: The client socket file descriptor.
- * - status: HTTP status code (e.g., 200, 404).
- * - status_msg: Text description of the status (e.g., "OK", "Not Found").
- * - content_type: MIME type of the body (e.g., "text/html").
- * - body: Pointer to the content data (can be NULL for HEAD requests).
- * - body_len: Size of the body content in bytes.
+ * - value: The Range header value.
+ * - size: Size of the selected representation.
+ * - out: Receives the satisfiable ranges (inclusive bounds), in order.
+ * - max: Capacity of 'out'.
+ *
+ * Return:
+ * - Number of ranges stored (> 0).
+ * - 0 if the header must be ignored (malformed, another unit, or more than
+ *   'max' elements): the full representation is sent.
+ * - -1 if it is valid but no element is satisfiable (416).
  */
-void send_http_response(int fd, int status, const char *status_msg, const char *content_type, const char *body, size_t body_len)
+int http_parse_range(http_slice_t value, size_t size, http_range_t *out, int max)
 {
-    /* 1. Generate current time in HTTP-compliant GMT format (RFC 1123) */
+    const char *p = value.ptr;
+    const char *end = value.ptr ? value.ptr + value.len : NULL;
+    if (!p || value.len < 6 || strncasecmp(p, "bytes=", 6) != 0)
+        return 0;
+    p += 6;
+
+    int count = 0, elements = 0;
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p < end && *p == ',')
+        {
+            p++;
+            continue; /* Empty list element */
+        }
+        if (p >= end)
+            break;
+        if (++elements > max)
+            return 0;
+
+        size_t first = 0, last = 0;
+        int has_first = (*p != '-');
+        if (has_first && parse_offset(&p, end, &first) != 0)
+            return 0;
+        if (p >= end || *p != '-')
+            return 0;
+        p++;
+        int has_last = (p < end && *p >= '0' && *p <= '9');
+        if (has_last && parse_offset(&p, end, &last) != 0)
+            return 0;
+        if (!has_first && !has_last)
+            return 0;
+        if (has_first && has_last && last < first)
+            return 0;
+
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p < end && *p != ',')
+            return 0;
+
+        /* Resolve against the size; unsatisfiable elements are skipped */
+        if (!has_first)
+        {
+            if (last == 0 || size == 0)
+                continue;
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        }
+        else
+        {
+            if (first >= size)
+                continue;
+            if (!has_last || last >= size)
+                last = size - 1;
+        }
+        out[count].first = first;
+        out[count].last = last;
+        count++;
+    }
+    if (elements == 0)
+        return 0;
+    return count > 0 ? count : -1;
+}
+
+/*
+ * Keep-Alive Negotiation
+ * Purpose: Decides whether the client wants the connection kept open after
+ * this response. HTTP/1.1 connections are persistent unless the client
+ * sends "Connection: close"; HTTP/1.0 ones only with "Connection: keep-alive".
+ *
+ * Parameters:
+ * - req: The parsed request.
+ *
+ * Return:
+ * - 1 to keep the connection open, 0 to close it.
+ */
+int http_wants_keep_alive(const http_request_t *req)
+{
+    if (http_slice_has_token(req->connection, "close"))
+        return 0;
+    if (http_slice_has_token(req->connection, "keep-alive"))
+        return 1;
+    return strcmp(req->version, "HTTP/1.1") == 0;
+}
+
+/*
+ * Request Body Check
+ * Purpose: Tells whether a body follows the request's header block. The
+ * server never reads request bodies, so the caller must not take the bytes
+ * after the header block as the next request when this returns 1.
+ *
+ * Return:
+ * - 1 if Transfer-Encoding is present, or Content-Length is anything but
+ *   zero (including a malformed value).
+ * - 0 otherwise.
+ */
+int http_has_body(const http_request_t *req)
+{
+    if (req->transfer_encoding.ptr)
+        return 1;
+    if (!req->content_length.ptr)
+        return 0;
+    if (req->content_length.len == 0)
+        return 1;
+    for (size_t i = 0; i < req->content_length.len; i++)
+    {
+        if (req->content_length.ptr[i] != '0')
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Cached Date Value
+ * Purpose: Returns the current time as an RFC 1123 date (HTTP_DATE_LEN
+ * characters). Each thread keeps its own copy and only reformats it when
+ * the second changes, so responses don't pay for gmtime_r/strftime.
+ *
+ * Return:
+ * - Thread-local string, valid until the thread's next call.
+ */
+const char *http_date(void)
+{
+    static __thread time_t cached_sec = -1;
+    static __thread char cached[HTTP_DATE_LEN + 1];
+
     time_t now = time(NULL);
+    if (now != cached_sec)
+    {
+        struct tm tm_data;
+        gmtime_r(&now, &tm_data); /* Thread-safe GMT conversion */
+        strftime(cached, sizeof(cached), "%a, %d %b %Y %H:%M:%S GMT", &tm_data);
+        cached_sec = now;
+    }
+    return cached;
+}
+
+/*
+ * Format HTTP Date
+ * Purpose: Formats a timestamp as an RFC 1123 date (Last-Modified, Expires).
+ *
+ * Parameters:
+ * - t: Seconds since the epoch.
+ * - out: Destination, at least HTTP_DATE_LEN + 1 bytes.
+ */
+void http_format_date(time_t t, char *out)
+{
     struct tm tm_data;
-    gmtime_r(&now, &tm_data); /* Thread-safe GMT conversion */
-
-    char date_str[128];
-    strftime(date_str, sizeof(date_str), "%a, %d %b %Y %H:%M:%S GMT", &tm_data);
-
-    /* 2. Format the HTTP Response Header */
-    char header[2048];
-    int header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 %d %s\r\n"
-                              "Date: %s\r\n"                 
-                              "Content-Type: %s\r\n"
-                              "Content-Length: %zu\r\n"
-                              "Server: ConcurrentHTTP/1.0\r\n"
-                              "Connection: close\r\n"
-                              "\r\n", /* End of headers */
-                              status, status_msg, 
-                              date_str,                     
-                              content_type, body_len);
-
-    /* 3. Send Headers */
-    send(fd, header, header_len, 0);
-
-    /* 4. Send Body (if present) */
-    if (body && body_len > 0)
-    {
-        send(fd, body, body_len, 0);
-    }
-}
\ No newline at end of file
+    gmtime_r(&t, &tm_data);
+    strftime(out, HTTP_DATE_LEN + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm_data);
+}
+
+/*
+ * Parse HTTP Date
+ * Purpose: Reads an RFC 1123 date such as an If-Modified-Since value. The
+ * obsolete RFC 850 and asctime forms are not accepted; a client sending
+ * them just gets a full response.
+ *
+ * Return:
+ * - 0 and the timestamp in *out on success, -1 if the value is not a date.
+ */
+int http_parse_date(http_slice_t value, time_t *out)
+{
+    char tmp[HTTP_DATE_LEN + 1];
+    if (!value.ptr || value.len != HTTP_DATE_LEN)
+        return -1;
+    memcpy(tmp, value.ptr, HTTP_DATE_LEN);
+    tmp[HTTP_DATE_LEN] = '\0';
+
+    struct tm tm_data;
+    memset(&tm_data, 0, sizeof(tm_data));
+    const char *end = strptime(tmp, "%a, %d %b %Y %H:%M:%S GMT", &tm_data);
+    if (!end || *end != '\0')
+        return -1;
+    *out = timegm(&tm_data);
+    return 0;
+}
+
+/*
+ * Entity Tag Matching
+ * Purpose: Evaluates an If-None-Match list against the current entity tag
+ * using the weak comparison the header calls for: "W/" prefixes are
+ * ignored, and "*" matches any existing resource.
+ *
+ * Parameters:
+ * - list: The If-None-Match value.
+ * - etag: Current tag, including its quotes.
+ *
+ * Return:
+ * - 1 if one of the listed tags matches, 0 otherwise.
+ */
+int http_etag_matches(http_slice_t list, const char *etag)
+{
+    if (etag[0] == 'W' && etag[1] == '/')
+        etag += 2;
+    size_t etag_len = strlen(etag);
+    const char *p = list.ptr;
+    const char *end = list.ptr ? list.ptr + list.len : NULL;
+
+    while (p && p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        if (p < end && *p == '*')
+            return 1;
+        if (end - p >= 2 && p[0] == 'W' && p[1] == '/')
+            p += 2;
+        if (p >= end || *p != '"')
+        {
+            /* Not an entity tag: skip to the next element */
+            while (p < end && *p != ',')
+                p++;
+            continue;
+        }
+        const char *tag = p++;
+        while (p < end && *p != '"')
+            p++;
+        if (p < end)
+            p++; /* Closing quote */
+        if ((size_t)(p - tag) == etag_len && memcmp(tag, etag, etag_len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Format Entity Header Block
+ * Purpose: Formats the part of a response header that does not depend on
+ * the connection: status line, Content-Type, Content-Length, Server, any
+ * extra headers and, last, the Date line. Such a block can be stored (e.g.
+ * with a cache entry) and reused with http_patch_date() and
+ * http_format_conn_tail(). If the extra headers end with an Expires line,
+ * http_patch_expires() can refresh it too.
+ *
+ * Parameters:
+ * - buf: Destination buffer.
+ * - buf_len: Capacity of 'buf'.
+ * - status/status_msg: Status line.
+ * - content_type: MIME type of the body (e.g., "text/html").
+ * - body_len: Value of the Content-Length header.
+ * - extra_headers: Complete header lines ("Name: value\r\n"...), or NULL.
+ *
+ * Return:
+ * - Length of the block, or 0 if it does not fit.
+ */
+size_t http_format_entity_header(char *buf, size_t buf_len, int status, const char *status_msg,
+                                 const char *content_type, size_t body_len,
+                                 const char *extra_headers)
+{
+    int len = snprintf(buf, buf_len,
+                       "HTTP/1.1 %d %s\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Server: ConcurrentHTTP/1.0\r\n"
+                       "%s"
+                       "Date: %s\r\n",
+                       status, status_msg, content_type, body_len,
+                       extra_headers ? extra_headers : "", http_date());
+
+    if (len < 0 || (size_t)len >= buf_len)
+        return 0;
+    return (size_t)len;
+}
+
+/*
+ * Refresh Date
+ * Purpose: Overwrites the Date value of a block built by
+ * http_format_entity_header() with the current time. The Date line is the
+ * last one of the block, so its value sits at a fixed distance from the end.
+ */
+void http_patch_date(char *hdr, size_t hdr_len)
+{
+    if (hdr_len >= HTTP_DATE_LEN + 2)
+        memcpy(hdr + hdr_len - 2 - HTTP_DATE_LEN, http_date(), HTTP_DATE_LEN);
+}
+
+/*
+ * Refresh Expires
+ * Purpose: Overwrites the value of an Expires line placed right before the
+ * Date line (see http_format_entity_header) with now + max_age. Blocks
+ * without such a line are left alone. Like the Date, the value is cached
+ * per thread and only reformatted when it changes.
+ */
+void http_patch_expires(char *hdr, size_t hdr_len, int max_age)
+{
+    static const char name[] = "Expires: ";
+    const size_t date_line = 6 + HTTP_DATE_LEN + 2;   /* "Date: <value>\r\n" */
+    const size_t expires_line = 9 + HTTP_DATE_LEN + 2;
+    static __thread time_t cached_at = -1;
+    static __thread char cached[HTTP_DATE_LEN + 1];
+
+    if (max_age < 0 || hdr_len < date_line + expires_line)
+        return;
+    char *line = hdr + hdr_len - date_line - expires_line;
+    if (memcmp(line, name, sizeof(name) - 1) != 0)
+        return;
+
+    time_t at = time(NULL) + max_age;
+    if (at != cached_at)
+    {
+        http_format_date(at, cached);
+        cached_at = at;
+    }
+    memcpy(line + sizeof(name) - 1, cached, HTTP_DATE_LEN);
+}
+
+/* Appends the decimal digits of 'v' at 'p'; returns the new end */
+static char *append_uint(char *p, unsigned v)
+{
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+/*
+ * Format Connection Tail
+ * Purpose: Appends the connection management headers and the blank line
+ * that ends the header block. Built by hand: this runs on every response.
+ *
+ * Parameters:
+ * - buf: Destination (at least HTTP_CONN_TAIL_MAX bytes).
+ * - keep_alive_timeout: Idle timeout to advertise; 0 sends "Connection: close".
+ * - keep_alive_max: Requests the client may still send on this connection.
+ *
+ * Return:
+ * - Number of bytes written.
+ */
+size_t http_format_conn_tail(char *buf, int keep_alive_timeout, int keep_alive_max)
+{
+    static const char close_tail[] = "Connection: close\r\n\r\n";
+    static const char ka_tail[] = "Connection: keep-alive\r\nKeep-Alive: timeout=";
+
+    if (keep_alive_timeout <= 0)
+    {
+        memcpy(buf, close_tail, sizeof(close_tail) - 1);
+        return sizeof(close_tail) - 1;
+    }
+
+    char *p = buf;
+    memcpy(p, ka_tail, sizeof(ka_tail) - 1);
+    p += sizeof(ka_tail) - 1;
+    p = append_uint(p, (unsigned)keep_alive_timeout);
+    memcpy(p, ", max=", 6);
+    p += 6;
+    p = append_uint(p, keep_alive_max > 0 ? (unsigned)keep_alive_max : 0);
+    memcpy(p, "\r\n\r\n", 4);
+    p += 4;
+    return (size_t)(p - buf);
+}
+
+/*
+ * Format 304 Header Block
+ * Purpose: Like http_format_entity_header() for a "304 Not Modified"
+ * response, which has no body and so no Content-Type or Content-Length.
+ * The extra headers carry the validators and caching headers a 200 would.
+ *
+ * Return:
+ * - Length of the block, or 0 if it does not fit.
+ */
+size_t http_format_not_modified(char *buf, size_t buf_len, const char *extra_headers)
+{
+    int len = snprintf(buf, buf_len,
+                       "HTTP/1.1 304 Not Modified\r\n"
+                       "Server: ConcurrentHTTP/1.0\r\n"
+                       "%s"
+                       "Date: %s\r\n",
+                       extra_headers ? extra_headers : "", http_date());
+
+    if (len < 0 || (size_t)len >= buf_len)
+        return 0;
+    return (size_t)len;
+}
+
+/*
+ * Canned Responses
+ * Purpose: The error responses the server sends are rendered once, on
+ * first use, instead of being formatted on every occurrence. Only the Date
+ * value and the connection tail are filled in when one is sent.
+ */
+static http_canned_t canned[] = {
+    { 400, "Bad Request", "<h1>400 Bad Request</h1>", {0}, 0, 0 },
+    { 403, "Forbidden", "<h1>403 Forbidden</h1>", {0}, 0, 0 },
+    { 404, "Not Found", "<h1>404 Not Found</h1>", {0}, 0, 0 },
+    { 405, "Method Not Allowed", "<h1>405 Method Not Allowed</h1>", {0}, 0, 0 },
+    { 431, "Request Header Fields Too Large", "<h1>431 Request Header Fields Too Large</h1>", {0}, 0, 0 },
+    { 500, "Internal Server Error", "<h1>500 Internal Server Error</h1>", {0}, 0, 0 },
+    { 503, "Service Unavailable", "<h1>503 Service Unavailable</h1>Server too busy.\n", {0}, 0, 0 },
+};
+static pthread_once_t canned_once = PTHREAD_ONCE_INIT;
+
+static void render_canned(void)
+{
+    for (size_t i = 0; i < sizeof(canned) / sizeof(canned[0]); i++)
+    {
+        http_canned_t *r = &canned[i];
+        r->body_len = strlen(r->body);
+        r->hdr_len = http_format_entity_header(r->hdr, sizeof(r->hdr), r->status, r->status_msg,
+                                               "text/html", r->body_len, NULL);
+    }
+}
+
+/*
+ * Look Up Canned Response
+ * Return:
+ * - The pre-rendered response for 'status' (500 for unknown codes).
+ */
+const http_canned_t *http_canned(int status)
+{
+    pthread_once(&canned_once, render_canned);
+
+    const http_canned_t *fallback = NULL;
+    for (size_t i = 0; i < sizeof(canned) / sizeof(canned[0]); i++)
+    {
+        if (canned[i].status == status)
+            return &canned[i];
+        if (canned[i].status == 500)
+            fallback = &canned[i];
+    }
+    return fallback;
+}
+
+/*
+ * Send Canned Response
+ * Purpose: Sends a pre-rendered error response with "Connection: close" on
+ * a blocking socket, header and body in a single sendmsg().
+ */
+void http_send_canned(int fd, int status)
+{
+    const http_canned_t *r = http_canned(status);
+    char header[sizeof(r->hdr) + HTTP_CONN_TAIL_MAX];
+
+    memcpy(header, r->hdr, r->hdr_len);
+    http_patch_date(header, r->hdr_len);
+    size_t header_len = r->hdr_len + http_format_conn_tail(header + r->hdr_len, 0, 0);
+
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = (void *)r->body, .iov_len = r->body_len },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+    sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
@@ -2,15 +2,96 @@
 #define HTTP_H
 
 #include <stddef.h>
+#include <time.h>
+
+#define HTTP_MAX_HEADERS 32
+#define HTTP_DATE_LEN 29       /* "Sun, 06 Nov 1994 08:49:37 GMT" */
+#define HTTP_CONN_TAIL_MAX 96  /* Room for http_format_conn_tail() output */
+#define HTTP_MAX_RANGES 16     /* More Range elements than this: full response */
+
+/* Parser results (http_parse_request) */
+#define HTTP_PARSE_INCOMPLETE  0 /* Need more bytes */
+#define HTTP_PARSE_ERROR      -1 /* Malformed request */
+
+/* A view into the receive buffer (not NUL-terminated) */
+typedef struct
+{
+    const char *ptr;
+    size_t len;
+} http_slice_t;
+
+typedef struct
+{
+    http_slice_t name;
+    http_slice_t value;
+} http_header_t;
 
 typedef struct
 {
     char method[16];
     char path[512];
     char version[16];
+
+    /* All header lines, in order (up to HTTP_MAX_HEADERS) */
+    http_header_t headers[HTTP_MAX_HEADERS];
+    int header_count;
+
+    /* Headers the server acts on, resolved during parsing (ptr NULL if absent) */
+    http_slice_t host;
+    http_slice_t connection;
+    http_slice_t if_none_match;
+    http_slice_t if_modified_since;
+    http_slice_t range;
+    http_slice_t if_range;
+    http_slice_t accept_encoding;
+    http_slice_t content_length;
+    http_slice_t transfer_encoding;
 } http_request_t;
 
-int parse_http_request(const char *buffer, http_request_t *req);
-void send_http_response(int fd, int status, const char *status_msg, const char *content_type, const char *body, size_t body_len);
+/* Resumable parser state: how far the buffer has been searched */
+typedef struct
+{
+    size_t scanned;
+} http_parser_t;
+
+/* A satisfiable byte range (inclusive bounds) */
+typedef struct
+{
+    size_t first;
+    size_t last;
+} http_range_t;
+
+/* A response rendered once and reused (error pages) */
+typedef struct
+{
+    int status;
+    const char *status_msg;
+    const char *body;
+    char hdr[256];        /* Entity header block (see http_format_entity_header) */
+    size_t hdr_len;
+    size_t body_len;
+} http_canned_t;
+
+void http_parser_reset(http_parser_t *parser);
+int http_parse_request(http_parser_t *parser, const char *buf, size_t len, http_request_t *req);
+int http_canonical_path(const char *raw, char *out, size_t out_len);
+int http_slice_has_token(http_slice_t slice, const char *token);
+int http_accepts_encoding(http_slice_t accept, const char *coding);
+int http_parse_range(http_slice_t value, size_t size, http_range_t *out, int max);
+int http_wants_keep_alive(const http_request_t *req);
+int http_has_body(const http_request_t *req);
+const char *http_date(void);
+void http_format_date(time_t t, char *out);
+int http_parse_date(http_slice_t value, time_t *out);
+int http_etag_matches(http_slice_t list, const char *etag);
+size_t http_format_entity_header(char *buf, size_t buf_len, int status, const char *status_msg,
+                                 const char *content_type, size_t body_len,
+                                 const char *extra_headers);
+void http_patch_date(char *hdr, size_t hdr_len);
+void http_patch_expires(char *hdr, size_t hdr_len, int max_age);
+size_t http_format_not_modified(char *buf, size_t buf_len, const char *extra_headers);
+size_t http_format_conn_tail(char *buf, int keep_alive_timeout, int keep_alive_max);
+const http_canned_t *http_canned(int status);
+void http_send_canned(int fd, int status);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,92 +1,131 @@
+#define _GNU_SOURCE
+
 #include "ipc.h"
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <stddef.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 /*
- * Send a File Descriptor via UNIX Domain Socket
- * Purpose: Transmits an open file descriptor from the current process to another
+ * Control buffer large enough for a full batch of FDs.
+ * The union ensures proper memory alignment for the cmsghdr.
+ */
+typedef union
+{
+    char buf[CMSG_SPACE(sizeof(int) * IPC_MAX_FDS)];
+    struct cmsghdr align;
+} fd_control_t;
+
+/*
+ * Send a Batch of Connections via UNIX Domain Socket
+ * Purpose: Transmits open file descriptors from the current process to another
  * process. This is required because file descriptors are process-local integers;
  * simply passing the integer value (e.g., '5') to another process is invalid.
  * We must use SCM_RIGHTS (Socket Control Message) to instruct the kernel to
- * duplicate the FD into the receiving process's file table.
+ * duplicate the FDs into the receiving process's file table.
+ *
+ * The regular payload of each message carries one conn_info_t per FD (peer
+ * address, accept timestamp, connection ID), in the same order as the FDs.
+ *
+ * All messages go out in a single sendmmsg() call, so a burst costs one
+ * syscall instead of one per connection. The channel is SOCK_SEQPACKET,
+ * which keeps every message atomic on the receiving side: when several
+ * threads block in recvmsg() on the same socket, each message is delivered
+ * to exactly one of them.
  *
  * Parameters:
  * - socket: The UNIX domain socket (IPC channel) to send through.
- * - fd_to_send: The file descriptor to transfer.
+ * - conns: Connections to transfer (the 'fd' field of each is sent).
+ * - count: Number of entries in 'conns' (1..IPC_MAX_FDS).
+ * - per_message: Connections packed per message (1 lets the kernel spread
+ *   them over the threads receiving directly; >= count sends one message).
  *
  * Return:
- * - Number of bytes sent on success (usually 1).
- * - -1 on failure.
+ * - Number of connections sent (may be less than 'count' if the socket
+ *   buffer filled up part-way on a non-blocking socket).
+ * - -1 on failure before anything was sent (the caller still owns and must
+ *   close the FDs).
  */
-int send_fd(int socket, int fd_to_send)
+int send_conns(int socket, const conn_info_t *conns, int count, int per_message)
 {
-    struct msghdr msg = {0};
+    if (count <= 0 || count > IPC_MAX_FDS)
+        return -1;
+    if (per_message <= 0 || per_message > count)
+        per_message = count;
+
+    int nmsgs = (count + per_message - 1) / per_message;
+    struct mmsghdr msgs[IPC_MAX_FDS];
+    struct iovec io[IPC_MAX_FDS];
+    fd_control_t u[nmsgs]; /* One control buffer per message */
 
-    /* Dummy data buffer. sendmsg requires at least one byte of real data
-     * to be sent along with the ancillary (control) data.
-     */
-    char buf[1] = {0}; 
-    struct iovec io = {.iov_base = buf, .iov_len = 1};
+    /* Zero out the headers and control buffers to prevent garbage data */
+    memset(msgs, 0, sizeof(struct mmsghdr) * nmsgs);
+    memset(u, 0, sizeof(fd_control_t) * nmsgs);
 
-    /* Union ensures proper memory alignment for the control message buffer */
-    union
+    for (int m = 0; m < nmsgs; m++)
     {
-        char buf[CMSG_SPACE(sizeof(int))]; /* Buffer big enough for one int FD */
-        struct cmsghdr align;              /* Enforce alignment */
-    } u;
-    
-    /* Zero out the control buffer to prevent garbage data */
-    memset(&u, 0, sizeof(u)); 
-
-    /* Setup message header */
-    msg.msg_iov = &io;          /* Point to dummy data */
-    msg.msg_iovlen = 1;         /* Number of I/O vectors */
-    msg.msg_control = u.buf;    /* Point to control buffer */
-    msg.msg_controllen = sizeof(u.buf); /* Size of control buffer */
-
-    /* Configure the Ancillary Data (Control Message) Header */
-    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_level = SOL_SOCKET;  /* Socket-level protocol */
-    cmsg->cmsg_type = SCM_RIGHTS;   /* We are sending access rights (FDs) */
-    cmsg->cmsg_len = CMSG_LEN(sizeof(int)); /* Length of data + header */
-
-    /* Copy the file descriptor into the data portion of the control message */
-    *((int *)CMSG_DATA(cmsg)) = fd_to_send;
-
-    return sendmsg(socket, &msg, 0);
+        int first = m * per_message;
+        int n = (count - first < per_message) ? count - first : per_message;
+        struct msghdr *msg = &msgs[m].msg_hdr;
+
+        /* Connection metadata is the real data sent alongside the FDs */
+        io[m].iov_base = (void *)&conns[first];
+        io[m].iov_len = sizeof(conn_info_t) * n;
+
+        /* Setup message header */
+        msg->msg_iov = &io[m];          /* Point to payload */
+        msg->msg_iovlen = 1;            /* Number of I/O vectors */
+        msg->msg_control = u[m].buf;    /* Point to control buffer */
+        msg->msg_controllen = CMSG_SPACE(sizeof(int) * n);
+
+        /* Configure the Ancillary Data (Control Message) Header */
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+        cmsg->cmsg_level = SOL_SOCKET;  /* Socket-level protocol */
+        cmsg->cmsg_type = SCM_RIGHTS;   /* We are sending access rights (FDs) */
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n); /* Length of data + header */
+
+        /* Copy the file descriptors into the data portion of the control message */
+        int *data = (int *)CMSG_DATA(cmsg);
+        for (int i = 0; i < n; i++)
+            data[i] = conns[first + i].fd;
+    }
+
+    /* MSG_NOSIGNAL: a dead worker must not kill the Master with SIGPIPE */
+    int sent_msgs = sendmmsg(socket, msgs, nmsgs, MSG_NOSIGNAL);
+    if (sent_msgs <= 0)
+        return -1;
+
+    int sent = sent_msgs * per_message;
+    return (sent > count) ? count : sent;
 }
 
 /*
- * Receive a File Descriptor via UNIX Domain Socket
- * Purpose: Receives a file descriptor sent by another process. The kernel
- * will automatically add the FD to this process's file table and return
- * its new integer value via the ancillary data.
+ * Receive a Batch of Connections via UNIX Domain Socket
+ * Purpose: Receives one message sent by send_conns(). The kernel
+ * automatically adds the FDs to this process's file table and returns
+ * their new integer values via the ancillary data; they are paired with
+ * the metadata from the payload.
  *
  * Parameters:
  * - socket: The UNIX domain socket to receive from.
+ * - conns: Output array for the received connections.
+ * - max_conns: Capacity of 'conns' (at most IPC_MAX_FDS are ever delivered).
  *
  * Return:
- * - The new valid file descriptor on success.
- * - -1 on failure (recvmsg error or no FD received).
+ * - Number of connections stored in 'conns' (0 if the message carried none).
+ * - -1 on failure or when the peer closed the channel (EOF).
  */
-int recv_fd(int socket)
+int recv_conns(int socket, conn_info_t *conns, int max_conns)
 {
     struct msghdr msg = {0};
 
-    /* Prepare buffer for the dummy byte */
-    char buf[1] = {0};
-    struct iovec io = {.iov_base = buf, .iov_len = 1};
-
-    /* Union for alignment of receiving buffer */
-    union
-    {
-        char buf[CMSG_SPACE(sizeof(int))];
-        struct cmsghdr align;
-    } u;
+    conn_info_t meta[IPC_MAX_FDS];
+    struct iovec io = {.iov_base = meta, .iov_len = sizeof(meta)};
 
+    fd_control_t u;
     memset(&u, 0, sizeof(u));
 
     msg.msg_iov = &io;
@@ -94,19 +133,44 @@ int recv_fd(int socket)
     msg.msg_control = u.buf;
     msg.msg_controllen = sizeof(u.buf);
 
-    /* Perform the receive operation */
-    if (recvmsg(socket, &msg, 0) < 0)
+    /* Perform the receive operation (0 means the Master closed its end) */
+    ssize_t bytes = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (bytes <= 0) {
+        if (bytes == 0) errno = 0; /* EOF: tell it apart from EAGAIN */
         return -1;
+    }
 
-    /* Extract the FD from the ancillary data */
-    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-    
-    /* Verify we received the expected type of message (SCM_RIGHTS) */
-    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    int meta_count = bytes / sizeof(conn_info_t);
+    int received = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
     {
-        /* Return the file descriptor integer */
-        return *((int *)CMSG_DATA(cmsg));
+        /* Only SCM_RIGHTS messages carry descriptors */
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *data = (int *)CMSG_DATA(cmsg);
+        for (int i = 0; i < n; i++)
+        {
+            if (received >= max_conns)
+            {
+                close(data[i]); /* No room: never leak a descriptor */
+                continue;
+            }
+
+            if (received < meta_count)
+            {
+                conns[received] = meta[received];
+            }
+            else
+            {
+                /* Metadata missing: keep the FD, mark the rest unknown */
+                memset(&conns[received], 0, sizeof(conn_info_t));
+            }
+            conns[received].fd = data[i];
+            received++;
+        }
     }
-    
-    return -1; /* Failed to receive a valid FD */
-}
\ No newline at end of file
+
+    return received;
+}
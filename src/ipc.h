@@ -1,8 +1,28 @@
 #ifndef IPC_H
 #define IPC_H
 
-int send_fd(int socket, int fd_to_send);
+#include <netinet/in.h>
+#include <time.h>
 
-int recv_fd(int socket);
+/* Upper bound on FDs carried by one dispatch message (kernel limit is 253) */
+#define IPC_MAX_FDS 64
 
-#endif
\ No newline at end of file
+/*
+ * Connection Descriptor
+ * Everything the acceptor already knows about a connection. It travels with
+ * the FD so pool threads don't need getpeername() and can measure how long
+ * the connection waited before being picked up.
+ */
+typedef struct
+{
+    int fd;                      /* Local descriptor (filled in by the receiver) */
+    struct sockaddr_in peer;     /* Client address from accept() (AF_UNSPEC if unknown) */
+    struct timespec accepted_at; /* CLOCK_MONOTONIC time of accept() (0 if unknown) */
+    unsigned long conn_id;       /* Server-wide connection ID */
+} conn_info_t;
+
+int send_conns(int socket, const conn_info_t *conns, int count, int per_message);
+
+int recv_conns(int socket, conn_info_t *conns, int max_conns);
+
+#endif
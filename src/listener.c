@@ -0,0 +1,69 @@
+#include "listener.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+/* Backlog of pending connections per listening socket */
+#define LISTEN_BACKLOG 128
+
+/*
+ * Create Listening Socket
+ * Purpose: Creates a TCP socket bound to all interfaces on the given port and
+ * puts it in listening state. Shared by the Master (master-dispatch and shared
+ * modes) and by each Worker (reuseport mode).
+ *
+ * Parameters:
+ * - port: TCP port to bind.
+ * - reuseport: If non-zero, sets SO_REUSEPORT so several processes can bind
+ *   the same port and the kernel load-balances new connections between them.
+ * - nonblocking: If non-zero, sets O_NONBLOCK so accept() returns EAGAIN
+ *   instead of blocking (required when the socket is driven by epoll).
+ *
+ * Return:
+ * - The listening file descriptor on success.
+ * - -1 on failure (error printed with perror).
+ */
+int create_listen_socket(int port, int reuseport, int nonblocking)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int opt = 1;
+    /* Allow immediate reuse of the port after server restart */
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY; /* Listen on all interfaces */
+    address.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, LISTEN_BACKLOG) < 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+
+    if (nonblocking) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    return fd;
+}
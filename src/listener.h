@@ -0,0 +1,6 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+int create_listen_socket(int port, int reuseport, int nonblocking);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Binary Access Log (LOG_FORMAT=binary)
+ * A file starts with LOG_BIN_MAGIC, then holds records back to back, each
+ * starting with a one-byte type. Integers are in host byte order (decode
+ * on the same architecture). tools/logdecode turns a file into Common,
+ * Combined or JSON lines.
+ *
+ * Workers append to the same file, one batch at a time. Every batch opens
+ * with a SOURCE record naming the writing process; the PATH and REQUEST
+ * records that follow belong to it, so path IDs only need to be unique per
+ * process. A PATH record always precedes the first REQUEST using its ID
+ * in the same file (they are re-sent after a rotation), and a later PATH
+ * record for the same (pid, id) replaces the earlier one.
+ */
+#define LOG_BIN_MAGIC "WSBLOG1\n"
+#define LOG_BIN_MAGIC_LEN 8
+
+#define LOG_REC_SOURCE  1
+#define LOG_REC_PATH    2
+#define LOG_REC_REQUEST 3
+
+/* Request methods (anything else is logged as LOG_METHOD_OTHER, shown as "-") */
+#define LOG_METHOD_OTHER   0
+#define LOG_METHOD_GET     1
+#define LOG_METHOD_HEAD    2
+#define LOG_METHOD_POST    3
+#define LOG_METHOD_PUT     4
+#define LOG_METHOD_DELETE  5
+#define LOG_METHOD_OPTIONS 6
+#define LOG_METHOD_PATCH   7
+#define LOG_METHOD_COUNT   8
+
+static const char *const log_method_names[LOG_METHOD_COUNT] = {
+    "-", "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH"
+};
+
+/* Starts every batch: records up to the next SOURCE come from 'pid' */
+typedef struct __attribute__((packed)) {
+    uint8_t type;         /* LOG_REC_SOURCE */
+    uint8_t reserved[3];
+    uint32_t pid;
+} log_rec_source_t;
+
+/* Interned request path: 'len' bytes of path follow (no NUL) */
+typedef struct __attribute__((packed)) {
+    uint8_t type;         /* LOG_REC_PATH */
+    uint8_t reserved;
+    uint16_t len;
+    uint32_t id;
+} log_rec_path_t;
+
+/* One request (fixed width) */
+typedef struct __attribute__((packed)) {
+    uint8_t type;         /* LOG_REC_REQUEST */
+    uint8_t method;       /* LOG_METHOD_* */
+    uint16_t status;
+    uint32_t path_id;
+    uint32_t addr;        /* Client IPv4 address, network byte order */
+    uint32_t latency_us;  /* Accept (or request start) to response sent */
+    uint64_t time_ms;     /* Completion, milliseconds since the Unix epoch */
+    uint64_t bytes;       /* Body bytes sent */
+} log_rec_request_t;
+
+#endif
@@ -1,23 +1,145 @@
 #include "logger.h"
+#include "log_format.h"
 #include "config.h" 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <arpa/inet.h>
+#include <zlib.h>
 
 /* Access global configuration for file paths */
 extern server_config_t config;
 
 /*
- * In-Memory Log Buffer
- * Purpose: Aggregates multiple log entries in memory to minimize disk I/O.
- * Synchronization: Access is protected by the 'log_sem' semaphore.
+ * Raw Log Entry
+ * Purpose: What a request thread puts in its ring: the request's fields as
+ * they are, followed by 'path_len' bytes of path. The writer thread turns
+ * it into a text line or a binary record, so no formatting happens on the
+ * request path.
  */
-static char log_buffer[LOG_BUFFER_SIZE];
-static size_t buffer_offset = 0;
+typedef struct {
+    uint32_t len;               /* Whole entry, path included */
+    uint16_t status;
+    uint16_t path_len;
+    uint32_t latency_us;
+    uint32_t reserved;
+    int64_t time_ms;            /* Completion, milliseconds since the Unix epoch */
+    uint64_t bytes;
+    char client_ip[16];
+    char method[16];
+} log_entry_t;
+
+/*
+ * Per-Thread Log Ring
+ * Purpose: Single-producer / single-consumer byte ring. The request thread
+ * that owns it appends entries; the writer thread drains them.
+ *
+ * Synchronization (lock-free):
+ * - 'head' is only written by the producer, 'tail' only by the writer;
+ *   both count bytes since creation and grow without wrapping.
+ * - The producer publishes an entry with a release store of 'head' after
+ *   copying it in; the writer frees space with a release store of 'tail'
+ *   after copying it out. Each side reads the other's index with acquire.
+ * - The indices sit on separate cache lines so the two sides do not
+ *   bounce one line between cores.
+ */
+typedef struct log_ring {
+    size_t head __attribute__((aligned(64)));
+    size_t tail __attribute__((aligned(64)));
+    struct log_ring *next __attribute__((aligned(64))); /* Registry link */
+    char data[LOG_RING_SIZE];
+} log_ring_t;
+
+/* Every ring ever created in this process (push-only, lock-free) */
+static log_ring_t *rings = NULL;
+
+/* The calling thread's ring, created on its first log line */
+static __thread log_ring_t *my_ring = NULL;
+
+/* Lines dropped because a ring was full (reported by the writer) */
+static size_t lines_dropped = 0;
+
+/*
+ * Writer Wake-up
+ * Purpose: Lets a producer whose ring passed half full (or the shutdown
+ * request) wake the writer before its next periodic drain.
+ */
+static sem_t writer_wake;
+static int writer_wake_ready = 0;
+
+/* Writer batch (only touched by the writer thread) */
+static char batch[LOG_BATCH_SIZE];
+static size_t batch_len = 0;
+
+/*
+ * Path Interning (binary format, writer thread only)
+ * Each distinct path gets a small ID, written once per file as a PATH
+ * record and then referenced by every REQUEST record.
+ * - file_gen changes whenever this process finds itself writing to a
+ *   different file (first write, or after a rotation); an entry whose
+ *   'defined_gen' differs must be defined again before use.
+ * - batch_refs lists the entries the current batch uses, so that a
+ *   rotation noticed at write time can re-define exactly those.
+ */
+typedef struct path_id {
+    struct path_id *hnext;
+    uint32_t id;
+    unsigned long defined_gen;  /* File the PATH record went to */
+    unsigned long ref_seq;      /* Last batch that used it */
+    unsigned long def_seq;      /* Last batch that carried its PATH record */
+    uint16_t len;
+    char path[];
+} path_id_t;
+
+#define PATH_ID_BUCKETS 4096
+#define MAX_BATCH_REFS (LOG_BATCH_SIZE / sizeof(log_rec_request_t) + 1)
+
+static path_id_t *path_ids[PATH_ID_BUCKETS];
+static uint32_t path_id_count = 0;
+static path_id_t *batch_refs[MAX_BATCH_REFS];
+static size_t batch_ref_count = 0;
+static unsigned long batch_seq = 1;
+static unsigned long file_gen = 1;
+
+/* PATH records re-sent after a file change, written ahead of the batch */
+static char *preamble = NULL;
+static size_t preamble_len = 0, preamble_cap = 0;
+
+/*
+ * Shared Log File State
+ * Purpose: One block in shared memory (created by the Master before fork)
+ * that every worker's writer consults under 'lock' before writing:
+ * - size: Bytes in the current file, kept up to date by every write, so
+ *   the rotation check needs no stat().
+ * - generation: Bumped when the file is rotated or a reopen is requested
+ *   (SIGUSR1); a writer whose descriptor is older reopens the path.
+ */
+typedef struct {
+    sem_t lock;
+    long size;
+    unsigned long generation;
+} log_shared_t;
+
+static log_shared_t *log_shared = NULL;
+
+/* This process's append-only descriptor (writer thread only) */
+static int log_fd = -1;
+static unsigned long log_fd_generation = 0;
+static dev_t file_dev = 0;
+static ino_t file_ino = 0;
+
+/* Background compression of the file just rotated (LOG_COMPRESS) */
+static pthread_t compress_tid;
+static int compress_running = 0;    /* Started and not yet joined */
+static int compress_done = 0;       /* Set by the thread when finished (atomic) */
 
 /*
  * Shutdown Flag
@@ -26,160 +148,590 @@ static size_t buffer_offset = 0;
  */
 static volatile int logger_shutting_down = 0;
 
+/*
+ * Initialize Shared Logger State
+ * Purpose: Allocates the log file state shared by all workers (see
+ * log_shared_t). Called by the Master before forking the workers.
+ */
+void init_shared_logger()
+{
+    if (log_shared) return;
+    void *mem_block = mmap(NULL, sizeof(log_shared_t),
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem_block == MAP_FAILED) {
+        perror("mmap log state failed");
+        exit(1);
+    }
+    log_shared = mem_block;
+    log_shared->size = 0;
+    log_shared->generation = 1;
+    if (sem_init(&log_shared->lock, 1, 1) != 0) {
+        perror("sem init log");
+        exit(1);
+    }
+}
+
+/*
+ * Initialize the Logger
+ * Purpose: Prepares the writer wake-up semaphore. Must run before the writer
+ * thread and the request threads start.
+ */
+void init_logger()
+{
+    init_shared_logger(); /* No-op when the Master created it */
+    if (!writer_wake_ready && sem_init(&writer_wake, 0, 0) == 0)
+        writer_wake_ready = 1;
+}
+
+/*
+ * Request Reopen
+ * Purpose: Makes every writer reopen LOG_FILE before its next write, e.g.
+ * after an external tool moved it away. Async-signal-safe (the Master calls
+ * it from its SIGUSR1 handler).
+ */
+void logger_request_reopen()
+{
+    if (log_shared) __atomic_fetch_add(&log_shared->generation, 1, __ATOMIC_SEQ_CST);
+}
+
+/* "<LOG_FILE>.<n>" or, compressed, "<LOG_FILE>.<n>.gz" */
+static void generation_name(char *out, size_t cap, int n, int gz)
+{
+    snprintf(out, cap, "%s.%d%s", config.log_file, n, gz ? ".gz" : "");
+}
+
+/*
+ * Compress Rotated File
+ * Purpose: Background thread gzipping "<LOG_FILE>.1" into
+ * "<LOG_FILE>.1.gz" (LOG_COMPRESS=1), off the writer's path. The result is
+ * only installed if the file was not shifted by another rotation while it
+ * was being compressed; otherwise it stays uncompressed.
+ * Parameters:
+ * - arg: Descriptor of the rotated file, opened at rotation (owned).
+ */
+static void *compress_thread(void *arg)
+{
+    int fd = (int)(long)arg;
+    char src[MAX_PATH_LEN + 16], dst[MAX_PATH_LEN + 16], tmp[MAX_PATH_LEN + 32];
+    generation_name(src, sizeof(src), 1, 0);
+    generation_name(dst, sizeof(dst), 1, 1);
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", dst, getpid());
+
+    int ok = 0;
+    gzFile gz = gzopen(tmp, "wb6");
+    if (gz) {
+        char buf[64 * 1024];
+        ssize_t n;
+        ok = 1;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            if (gzwrite(gz, buf, (unsigned)n) != n) { ok = 0; break; }
+        }
+        if (n < 0) ok = 0;
+        if (gzclose(gz) != Z_OK) ok = 0;
+    }
+
+    struct stat mine, now;
+    sem_wait(&log_shared->lock);
+    if (ok && fstat(fd, &mine) == 0 && stat(src, &now) == 0 &&
+        mine.st_ino == now.st_ino && mine.st_dev == now.st_dev &&
+        rename(tmp, dst) == 0) {
+        unlink(src);
+    } else {
+        unlink(tmp);
+    }
+    sem_post(&log_shared->lock);
+    close(fd);
+    __atomic_store_n(&compress_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
 /*
  * Log Rotation Logic
- * Purpose: Checks if the current log file exceeds the maximum size limit.
- * If so, renames it to ".old" to archive it.
- * Note: Caller must hold the log_sem lock (since this modifies file state).
+ * Purpose: Shifts the numbered generations ("<LOG_FILE>.1" is the newest,
+ * LOG_ROTATE_KEEP the oldest kept, compressed or not) and moves the current
+ * file to ".1". Every writer reopens LOG_FILE on its next write.
+ * Note: Caller must hold log_shared->lock.
  */
-void check_and_rotate_log()
+static void rotate_log()
 {
+    int keep = config.log_rotate_keep > 0 ? config.log_rotate_keep : 1;
+    char from[MAX_PATH_LEN + 16], to[MAX_PATH_LEN + 16];
+
+    for (int gz = 0; gz <= 1; gz++) {
+        generation_name(from, sizeof(from), keep, gz);
+        unlink(from);
+        for (int n = keep - 1; n >= 1; n--) {
+            generation_name(from, sizeof(from), n, gz);
+            generation_name(to, sizeof(to), n + 1, gz);
+            rename(from, to);
+        }
+    }
+    generation_name(to, sizeof(to), 1, 0);
+    if (rename(config.log_file, to) != 0) return;
+    log_shared->size = 0;
+    log_shared->generation++;
+
+    if (config.log_compress) {
+        /* Never wait here: the compressor needs this lock to finish. If the
+         * previous one is still busy, this generation stays uncompressed. */
+        if (compress_running && !__atomic_load_n(&compress_done, __ATOMIC_ACQUIRE)) return;
+        if (compress_running) pthread_join(compress_tid, NULL);
+        compress_running = 0;
+        compress_done = 0;
+        int fd = open(to, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            if (pthread_create(&compress_tid, NULL, compress_thread, (void *)(long)fd) == 0)
+                compress_running = 1;
+            else
+                close(fd);
+        }
+    }
+}
+
+/*
+ * Open Log File
+ * Purpose: (Re)opens LOG_FILE for appending when this process has no
+ * descriptor or the shared generation moved on (rotation, SIGUSR1). This
+ * is the only place the file's size is read from the filesystem.
+ * Note: Caller must hold log_shared->lock.
+ * Return: 0 if log_fd is usable, -1 otherwise.
+ */
+static int open_log_file()
+{
+    if (log_fd >= 0 && log_fd_generation == log_shared->generation) return 0;
+    if (log_fd >= 0) close(log_fd);
+
+    log_fd = open(config.log_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
     struct stat st;
-    /* Check file status using the configured filename */
-    if (stat(config.log_file, &st) == 0)
-    {
-        if (st.st_size >= MAX_LOG_FILE_SIZE)
-        {
-            /* Create a sufficiently large buffer for the new filename */
-            char old_log_name[512]; 
-            
-            snprintf(old_log_name, sizeof(old_log_name), "%s.old", config.log_file);
-            rename(config.log_file, old_log_name);
+    if (log_fd < 0 || fstat(log_fd, &st) != 0) {
+        if (log_fd >= 0) close(log_fd);
+        log_fd = -1;
+        return -1;
+    }
+    log_fd_generation = log_shared->generation;
+    log_shared->size = st.st_size;
+    if (st.st_dev != file_dev || st.st_ino != file_ino) {
+        file_dev = st.st_dev;
+        file_ino = st.st_ino;
+        file_gen++; /* Binary format: interned paths must be defined again */
+    }
+    return 0;
+}
+
+static void preamble_append(const void *data, size_t len)
+{
+    if (preamble_len + len > preamble_cap) {
+        size_t cap = preamble_cap ? preamble_cap * 2 : 4096;
+        while (cap < preamble_len + len) cap *= 2;
+        char *p = realloc(preamble, cap);
+        if (!p) return;
+        preamble = p;
+        preamble_cap = cap;
+    }
+    memcpy(preamble + preamble_len, data, len);
+    preamble_len += len;
+}
+
+/*
+ * Binary Preamble
+ * Purpose: Builds what must precede a binary batch in the file: the magic
+ * (empty file), the SOURCE record and, when the file changed since the
+ * batch was encoded, the PATH records of every ID the batch uses that it
+ * does not define itself.
+ * Note: Caller must hold log_shared->lock.
+ */
+static void build_binary_preamble(unsigned long batch_file_gen)
+{
+    preamble_len = 0;
+    if (log_shared->size == 0) preamble_append(LOG_BIN_MAGIC, LOG_BIN_MAGIC_LEN);
+
+    log_rec_source_t src = { .type = LOG_REC_SOURCE, .pid = (uint32_t)getpid() };
+    preamble_append(&src, sizeof(src));
+
+    if (batch_file_gen == file_gen) return;
+    for (size_t i = 0; i < batch_ref_count; i++) {
+        path_id_t *p = batch_refs[i];
+        if (p->def_seq != batch_seq) {
+            log_rec_path_t def = { .type = LOG_REC_PATH, .len = p->len, .id = p->id };
+            preamble_append(&def, sizeof(def));
+            preamble_append(p->path, p->len);
+        }
+        p->defined_gen = file_gen;
+    }
+}
+
+/* writev() until everything is written; returns the bytes written */
+static size_t write_all(int fd, struct iovec *iov, int count)
+{
+    size_t total = 0;
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        total += n;
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
         }
     }
+    return total;
 }
 
 /*
- * Internal Buffer Flush (Unsafe)
- * Purpose: Writes the current buffer content to disk and resets the offset.
- * Warning: This function is NOT thread-safe. The caller MUST hold the 
- * 'log_sem' lock before calling this function.
+ * Batch Write
+ * Purpose: Appends the writer's batch to the log file and empties it.
+ *
+ * Logic (under log_shared->lock, shared by all workers):
+ * 1. Rotate if the tracked size reached LOG_MAX_SIZE_MB.
+ * 2. Reopen if rotation or SIGUSR1 replaced the file.
+ * 3. One writev() of preamble + batch on the O_APPEND descriptor, so a
+ *    batch is never interleaved with another worker's; add it to the size.
  */
-void flush_buffer_to_disk_internal()
+static void write_batch(void)
 {
-    if (buffer_offset == 0) return; /* Nothing to write */
+    if (batch_len == 0) return; /* Nothing to write */
 
-    check_and_rotate_log();
+    int binary = (config.log_format == LOG_FORMAT_BINARY);
+    unsigned long batch_file_gen = file_gen;
 
-    FILE *fp = fopen(config.log_file, "a");
-    if (fp)
-    {
-        fwrite(log_buffer, 1, buffer_offset, fp);
-        fclose(fp);
+    sem_wait(&log_shared->lock);
+    if (config.log_max_size > 0 && log_shared->size >= config.log_max_size) rotate_log();
+    if (open_log_file() == 0) {
+        struct iovec iov[2];
+        int count = 0;
+        if (binary) {
+            build_binary_preamble(batch_file_gen);
+            iov[count].iov_base = preamble;
+            iov[count++].iov_len = preamble_len;
+        }
+        iov[count].iov_base = batch;
+        iov[count++].iov_len = batch_len;
+        log_shared->size += write_all(log_fd, iov, count);
     }
+    sem_post(&log_shared->lock);
+
+    batch_len = 0;
+    batch_ref_count = 0;
+    batch_seq++;
+}
+
+static unsigned long hash_path(const char *s, size_t len)
+{
+    unsigned long h = 5381;
+    for (size_t i = 0; i < len; i++) h = ((h << 5) + h) + (unsigned char)s[i];
+    return h;
+}
 
-    /* Reset buffer pointer */
-    buffer_offset = 0;
+/* Forgets every interned path; IDs restart and are defined again on use */
+static void reset_path_ids(void)
+{
+    for (int i = 0; i < PATH_ID_BUCKETS; i++) {
+        while (path_ids[i]) {
+            path_id_t *next = path_ids[i]->hnext;
+            free(path_ids[i]);
+            path_ids[i] = next;
+        }
+    }
+    path_id_count = 0;
 }
 
 /*
- * Public Buffer Flush (Thread-Safe)
- * Purpose: Forces a write of the log buffer to disk safely.
- * Synchronization: Acquires the semaphore before flushing.
+ * Intern a Path
+ * Purpose: Returns the ID entry for 'path', creating it if needed. When
+ * the table is full, the pending batch is written and the table restarts,
+ * which bounds the writer's memory.
  */
-void flush_logger(sem_t *log_sem)
+static path_id_t *intern_path(const char *path, size_t len)
 {
-    sem_wait(log_sem);
-    flush_buffer_to_disk_internal();
-    sem_post(log_sem);
+    unsigned long h = hash_path(path, len);
+    path_id_t *p = path_ids[h % PATH_ID_BUCKETS];
+    while (p && (p->len != len || memcmp(p->path, path, len) != 0)) p = p->hnext;
+    if (p) return p;
+
+    if (path_id_count >= LOG_MAX_PATH_IDS) {
+        write_batch(); /* The batch references entries about to go */
+        reset_path_ids();
+    }
+    p = malloc(sizeof(path_id_t) + len);
+    if (!p) return NULL;
+    p->id = ++path_id_count;
+    p->defined_gen = p->ref_seq = p->def_seq = 0;
+    p->len = len;
+    memcpy(p->path, path, len);
+    p->hnext = path_ids[h % PATH_ID_BUCKETS];
+    path_ids[h % PATH_ID_BUCKETS] = p;
+    return p;
+}
+
+static uint8_t method_code(const char *method)
+{
+    for (int i = 1; i < LOG_METHOD_COUNT; i++) {
+        if (strcmp(method, log_method_names[i]) == 0) return i;
+    }
+    return LOG_METHOD_OTHER;
+}
+
+/* Appends one REQUEST record (preceded by a PATH record on first use) */
+static void encode_binary(const log_entry_t *e, const char *path)
+{
+    if (batch_len + sizeof(log_rec_path_t) + e->path_len + sizeof(log_rec_request_t) > LOG_BATCH_SIZE)
+        write_batch();
+
+    path_id_t *p = intern_path(path, e->path_len);
+    if (!p) return;
+    if (p->defined_gen != file_gen) {
+        log_rec_path_t def = { .type = LOG_REC_PATH, .len = p->len, .id = p->id };
+        memcpy(batch + batch_len, &def, sizeof(def));
+        memcpy(batch + batch_len + sizeof(def), p->path, p->len);
+        batch_len += sizeof(def) + p->len;
+        p->defined_gen = file_gen;
+        p->def_seq = batch_seq;
+    }
+    if (p->ref_seq != batch_seq) {
+        p->ref_seq = batch_seq;
+        batch_refs[batch_ref_count++] = p;
+    }
+
+    log_rec_request_t rec = {
+        .type = LOG_REC_REQUEST,
+        .method = method_code(e->method),
+        .status = e->status,
+        .path_id = p->id,
+        .latency_us = e->latency_us,
+        .time_ms = (uint64_t)e->time_ms,
+        .bytes = e->bytes,
+    };
+    if (inet_pton(AF_INET, e->client_ip, &rec.addr) != 1) rec.addr = 0;
+    memcpy(batch + batch_len, &rec, sizeof(rec));
+    batch_len += sizeof(rec);
+}
+
+/*
+ * Log Timestamp
+ * Purpose: Returns the Common Log Format time for 'sec', formatted
+ * (localtime_r + strftime) once per distinct second. Writer thread only.
+ */
+static const char *log_timestamp(time_t sec)
+{
+    static time_t cached_sec = -1;
+    static char cached[64];
+
+    if (sec != cached_sec) {
+        struct tm tm_info;
+        localtime_r(&sec, &tm_info);
+        strftime(cached, sizeof(cached), "%d/%b/%Y:%H:%M:%S %z", &tm_info);
+        cached_sec = sec;
+    }
+    return cached;
+}
+
+/* Appends one Common Log Format line */
+static void encode_text(const log_entry_t *e, const char *path)
+{
+    size_t max_line = e->path_len + 160; /* Fixed fields fit in 160 bytes */
+    if (batch_len + max_line > LOG_BATCH_SIZE) write_batch();
+
+    int len = snprintf(batch + batch_len, LOG_BATCH_SIZE - batch_len,
+                       "%s - - [%s] \"%s %.*s HTTP/1.1\" %d %llu\n",
+                       e->client_ip, log_timestamp(e->time_ms / 1000), e->method,
+                       (int)e->path_len, path, e->status, (unsigned long long)e->bytes);
+    if (len > 0 && (size_t)len < LOG_BATCH_SIZE - batch_len) batch_len += len;
+}
+
+/* Copies 'len' bytes out of the ring from position 'pos' (wrapping) */
+static void ring_read(const log_ring_t *r, size_t pos, void *dst, size_t len)
+{
+    size_t start = pos & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - start;
+    if (first > len) first = len;
+    memcpy(dst, r->data + start, first);
+    memcpy((char *)dst + first, r->data, len - first);
+}
+
+/* Copies 'len' bytes into the ring at position 'pos' (wrapping) */
+static void ring_write(log_ring_t *r, size_t pos, const void *src, size_t len)
+{
+    size_t start = pos & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - start;
+    if (first > len) first = len;
+    memcpy(r->data + start, src, first);
+    memcpy(r->data, (const char *)src + first, len - first);
+}
+
+/*
+ * Drain Rings
+ * Purpose: Encodes every entry in all thread rings into the batch (text
+ * lines or binary records per LOG_FORMAT), writing the batch out whenever
+ * it fills, then writes what is left.
+ * Note: Writer thread only.
+ */
+void flush_logger(void)
+{
+    int binary = (config.log_format == LOG_FORMAT_BINARY);
+    char path[LOG_PATH_MAX];
+
+    for (log_ring_t *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        size_t tail = r->tail;
+        while (tail != head) {
+            log_entry_t e;
+            ring_read(r, tail, &e, sizeof(e));
+            ring_read(r, tail + sizeof(e), path, e.path_len);
+            if (binary) encode_binary(&e, path);
+            else encode_text(&e, path);
+            tail += e.len;
+            __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+    write_batch();
+
+    /* Release a replaced file promptly, even with nothing to write */
+    if (log_fd >= 0 && log_fd_generation != __atomic_load_n(&log_shared->generation, __ATOMIC_SEQ_CST)) {
+        sem_wait(&log_shared->lock);
+        open_log_file();
+        sem_post(&log_shared->lock);
+    }
+
+    size_t dropped = __atomic_exchange_n(&lines_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0)
+        fprintf(stderr, "Logger (PID: %d): %zu log lines dropped (ring full)\n", getpid(), dropped);
+}
+
+/* Copies a string into a fixed field, truncating (always NUL-terminated) */
+static void copy_field(char *dst, size_t cap, const char *src)
+{
+    size_t len = strnlen(src, cap - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/* Creates the calling thread's ring and publishes it to the writer */
+static log_ring_t *register_ring(void)
+{
+    log_ring_t *r = malloc(sizeof(log_ring_t));
+    if (!r) return NULL;
+    r->head = r->tail = 0;
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return r;
 }
 
 /*
  * Log a Request
- * Purpose: Formats an HTTP request log entry (Apache Common Log Format) and 
- * appends it to the in-memory buffer.
+ * Purpose: Records an HTTP request in the calling thread's ring. The writer
+ * thread formats it later (Common Log Format, or a binary record).
  *
  * Parameters:
- * - log_sem: Semaphore for synchronization.
  * - client_ip: IP address string of the client.
  * - method: HTTP method (GET, HEAD, etc.).
  * - path: The requested resource path.
  * - status: The HTTP response status code.
  * - bytes: The size of the response body sent.
+ * - latency_us: Time taken to serve the request.
  *
  * Synchronization:
- * - Uses localtime_r for thread-safe time formatting.
- * - Acquires log_sem for the critical section (buffer write).
- * - Automatically flushes if the buffer is full.
+ * - Lock-free: no semaphore, no I/O, no formatting; a few copies.
+ * - If the ring is full (the writer has fallen far behind), the entry is
+ *   dropped and counted rather than blocking the request thread.
  */
-void log_request(sem_t *log_sem, const char *client_ip, const char *method,
-                 const char *path, int status, size_t bytes)
+void log_request(const char *client_ip, const char *method,
+                 const char *path, int status, size_t bytes, long latency_us)
 {
-    /* 1. Generate Timestamp */
-    time_t now = time(NULL);
-    struct tm tm_info;
-    localtime_r(&now, &tm_info); /* Thread-safe struct tm */
-    
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%d/%b/%Y:%H:%M:%S %z", &tm_info);
-
-    /* 2. Format Log Entry */
-    char entry[512];
-    int len = snprintf(entry, sizeof(entry), "%s - - [%s] \"%s %s HTTP/1.1\" %d %zu\n",
-                       client_ip, timestamp, method, path, status, bytes);
+    if (!my_ring && !(my_ring = register_ring())) return;
+    log_ring_t *r = my_ring;
 
-    if (len < 0) return;
+    /* 1. Fill the Entry */
+    log_entry_t e;
+    memset(&e, 0, sizeof(e));
+    size_t path_len = strnlen(path, LOG_PATH_MAX);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    e.len = sizeof(e) + path_len;
+    e.status = status;
+    e.path_len = path_len;
+    e.latency_us = latency_us > 0 ? (uint32_t)latency_us : 0;
+    e.time_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    e.bytes = bytes;
+    copy_field(e.client_ip, sizeof(e.client_ip), client_ip);
+    copy_field(e.method, sizeof(e.method), method);
 
-    /* 3. Critical Section: Append to Buffer */
-    sem_wait(log_sem);
-
-    /* Flush first if there isn't enough space */
-    if (buffer_offset + len >= LOG_BUFFER_SIZE)
-    {
-        flush_buffer_to_disk_internal();
+    /* 2. Reserve Space (only the writer moves 'tail') */
+    size_t head = r->head;
+    size_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (used + e.len > LOG_RING_SIZE) {
+        __atomic_fetch_add(&lines_dropped, 1, __ATOMIC_RELAXED);
+        return;
     }
 
-    memcpy(log_buffer + buffer_offset, entry, len);
-    buffer_offset += len;
+    /* 3. Copy In (possibly wrapping) and Publish */
+    ring_write(r, head, &e, sizeof(e));
+    ring_write(r, head + sizeof(e), path, path_len);
+    __atomic_store_n(&r->head, head + e.len, __ATOMIC_RELEASE);
 
-    sem_post(log_sem);
+    /* 4. Crossing half full: wake the writer early */
+    if (writer_wake_ready && used < LOG_RING_SIZE / 2 && used + e.len >= LOG_RING_SIZE / 2)
+        sem_post(&writer_wake);
 }
 
 /*
- * Flush Wrapper (Compatibility)
- * Purpose: Wrapper for flush_logger to match expected interface.
- */
-void flush_buffer_to_disk(sem_t *log_sem)
-{
-    flush_logger(log_sem);
-}
-
-/*
- * Background Logger Thread
- * Purpose: Periodically flushes the log buffer to disk to ensure logs 
- * are persisted even if the buffer isn't full.
+ * Background Log Writer Thread
+ * Purpose: The only thread that writes the access log. Drains all thread
+ * rings every LOG_FLUSH_INTERVAL_MS, or sooner when a ring fills up.
  *
  * Logic:
- * - Sleeps in 1-second intervals (looping 5 times) to allow for a 
- * responsive shutdown (max 1s delay on CTRL+C).
- * - Uses atomic load to check the shutdown flag safely.
+ * - Waits on 'writer_wake' with a timeout, so producers never have to
+ *   signal it for ordinary traffic.
+ * - Uses atomic load to check the shutdown flag safely; the final drain
+ *   runs after the request threads are joined, so no line is lost.
  */
 void *logger_flush_thread(void *arg)
 {
-    sem_t *log_sem = (sem_t *)arg;
+    (void)arg;
 
     while (!__atomic_load_n(&logger_shutting_down, __ATOMIC_SEQ_CST))
     {
-        /* Check shutdown status every second instead of blocking for 5s */
-        for (int i = 0; i < 5; i++) {
-             if (__atomic_load_n(&logger_shutting_down, __ATOMIC_SEQ_CST)) break;
-             sleep(1);
-        }
+        flush_logger();
 
-        flush_logger(log_sem);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += LOG_FLUSH_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (LOG_FLUSH_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (writer_wake_ready) {
+            while (sem_timedwait(&writer_wake, &deadline) != 0 && errno == EINTR);
+        } else {
+            usleep(LOG_FLUSH_INTERVAL_MS * 1000);
+        }
     }
 
     /* Ensure any remaining logs are written before thread exit */
-    flush_logger(log_sem);
+    flush_logger();
+    reset_path_ids();
+    if (compress_running) pthread_join(compress_tid, NULL);
+    if (log_fd >= 0) close(log_fd);
+    log_fd = -1;
     return NULL;
 }
 
 /*
  * Request Logger Shutdown
- * Purpose: Signals the flush thread to terminate.
+ * Purpose: Signals the writer thread to drain the rings one last time and
+ * terminate. Call after the request threads have stopped.
  * Synchronization: Uses atomic store to prevent data races with the reading thread.
  */
 void logger_request_shutdown()
 {
     __atomic_store_n(&logger_shutting_down, 1, __ATOMIC_SEQ_CST);
-}
\ No newline at end of file
+    if (writer_wake_ready) sem_post(&writer_wake);
+}
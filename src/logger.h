@@ -4,19 +4,23 @@
 #include <semaphore.h>
 #include <stddef.h>
 
-#define MAX_LOG_FILE_SIZE (10 * 1024 * 1024) 
-#define LOG_BUFFER_SIZE 4096
+#define LOG_RING_SIZE (64 * 1024)       /* Per-thread ring (power of two) */
+#define LOG_BATCH_SIZE (256 * 1024)     /* Bytes the writer appends per write */
+#define LOG_FLUSH_INTERVAL_MS 1000
+#define LOG_PATH_MAX 1024               /* Longer paths are truncated */
+#define LOG_MAX_PATH_IDS 16384          /* Interned paths per worker (binary format) */
 
+void init_shared_logger();
 void init_logger();
 
-void log_request(sem_t *log_sem, const char *client_ip, const char *method,
-                 const char *path, int status, size_t bytes);
+void log_request(const char *client_ip, const char *method,
+                 const char *path, int status, size_t bytes, long latency_us);
 
-void flush_logger(sem_t *log_sem);
-void flush_logger(sem_t *log_sem);
+void flush_logger(void);
 
 void *logger_flush_thread(void *arg);
 
 void logger_request_shutdown();
+void logger_request_reopen();
 
-#endif
\ No newline at end of file
+#endif
@@ -3,6 +3,7 @@
 #include "master.h"
 #include "config.h"
 #include "shared_mem.h"
+#include "logger.h"
 
 server_config_t config; 
 
@@ -15,6 +16,7 @@ int main(void)
     }
 
     init_shared_stats();
+    init_shared_logger();
 
     return start_master_server();
 }
\ No newline at end of file
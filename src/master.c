@@ -1,4 +1,4 @@
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
 
 #include "master.h"    
 #include "shared_mem.h"
@@ -7,6 +7,11 @@
 #include "worker.h"  
 #include "stats.h"
 #include "thread_pool.h"
+#include "listener.h"
+#include "http.h"
+#include "cache.h"
+#include "preload.h"
+#include "logger.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
@@ -16,6 +21,10 @@
 #include <pthread.h> 
 #include <signal.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
 
 /* Access global configuration loaded in main.c */
 extern server_config_t config;
@@ -38,10 +47,263 @@ void handle_sigint(int sig) {
     server_running = 0; 
 }
 
+/*
+ * Signal Handler for SIGUSR1
+ * Purpose: Asks every worker's log writer to reopen LOG_FILE before its
+ * next write (only an atomic increment in shared memory).
+ */
+void handle_sigusr1(int sig) {
+    (void)sig;
+    logger_request_reopen();
+}
+
+/*
+ * Signal Handler for SIGCHLD
+ * Purpose: Wakes the supervisor loop (reuseport/shared modes) when a worker
+ * exits so the Master can report it and stop once no workers remain.
+ */
+static volatile sig_atomic_t child_exited = 0;
+
+static void handle_sigchld(int sig) {
+    (void)sig;
+    child_exited = 1;
+}
+
+/*
+ * Supervise Workers (reuseport / shared modes)
+ * Purpose: In these modes workers accept connections themselves, so the
+ * Master only waits for Ctrl+C and reaps workers that die unexpectedly.
+ *
+ * Parameters:
+ * - num_workers: Number of workers forked.
+ *
+ * Logic:
+ * - SIGINT and SIGCHLD are blocked and only delivered inside sigsuspend(),
+ *   so a signal arriving between the flag check and the wait is never lost.
+ */
+static void supervise_workers(int num_workers)
+{
+    struct sigaction sa;
+    sa.sa_handler = handle_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    sigset_t block, orig;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &orig);
+
+    int alive = num_workers;
+    while (server_running && alive > 0) {
+        sigsuspend(&orig);
+
+        if (child_exited) {
+            child_exited = 0;
+            pid_t pid;
+            int status;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                fprintf(stderr, "Worker (PID: %d) exited unexpectedly.\n", pid);
+                alive--;
+            }
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &orig, NULL);
+}
+
+/*
+ * Process Liveness (shared cache recovery)
+ * Purpose: Tells cache_recover_shared() whether a process that used the
+ * shared cache still runs: the Master itself, or a worker that has not
+ * exited. Exited workers are seen without being reaped (WNOWAIT), so the
+ * supervisor loop still reports them.
+ */
+static int process_alive(pid_t pid)
+{
+    if (pid == getpid()) return 1;
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0)
+        return 0; /* Already reaped */
+    return info.si_pid != pid;
+}
+
+/*
+ * Shared Cache Recovery Thread
+ * Purpose: Once a second, lets the shared cache recover from a worker that
+ * died while using it (see cache_recover_shared()). A reset is never
+ * interrupted by the cancellation at shutdown.
+ */
+static void *cache_recovery_thread(void *arg)
+{
+    (void)arg;
+    while (1) {
+        sleep(1);
+        int state;
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        if (cache_recover_shared(process_alive))
+            fprintf(stderr, "Shared cache reset after a worker died while using it.\n");
+        pthread_setcancelstate(state, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * Connection Dispatcher State (master-dispatch mode)
+ * Purpose: Groups a burst of accepted FDs per destination worker so each
+ * worker receives its share in a single message.
+ */
+typedef struct
+{
+    int num_workers;
+    int *pipes;          /* Master's (non-blocking) end of each socketpair */
+    int *batch_count;    /* FDs assigned to each worker in the current burst */
+    conn_info_t *batch;  /* num_workers x IPC_MAX_FDS assignment table */
+    char *dead;          /* Worker's channel is broken (worker exited) */
+    char *unavailable;   /* Skipped for the rest of this burst */
+    int rr_next;         /* Round-robin cursor (also breaks ties) */
+    unsigned int seed;   /* PRNG state for power-of-two choices */
+} dispatcher_t;
+
+/*
+ * Pick Destination Worker
+ * Purpose: Chooses a worker for one connection according to DISPATCH_POLICY.
+ * The load of a worker is what it published in shared memory plus what has
+ * already been assigned to it in the current burst.
+ *
+ * Return:
+ * - Worker index.
+ * - -1 if every worker is unavailable (stalled or dead).
+ */
+static int pick_worker(dispatcher_t *d)
+{
+    int n = d->num_workers;
+
+    if (config.dispatch_policy == DISPATCH_P2C && n > 1) {
+        int a = rand_r(&d->seed) % n;
+        int b = rand_r(&d->seed) % (n - 1);
+        if (b >= a) b++; /* Two distinct candidates */
+
+        if (!d->unavailable[a] && !d->unavailable[b]) {
+            int la = worker_load_score(&worker_loads[a]) + d->batch_count[a];
+            int lb = worker_load_score(&worker_loads[b]) + d->batch_count[b];
+            return (lb < la) ? b : a;
+        }
+        if (!d->unavailable[a]) return a;
+        if (!d->unavailable[b]) return b;
+        /* Both candidates stalled: fall through to a full scan */
+    }
+
+    int best = -1;
+    int best_load = 0;
+    for (int k = 0; k < n; k++) {
+        /* Start from the rotating cursor so ties are spread evenly */
+        int i = (d->rr_next + k) % n;
+        if (d->unavailable[i]) continue;
+
+        if (config.dispatch_policy == DISPATCH_ROUND_ROBIN) {
+            best = i;
+            break;
+        }
+
+        int load = worker_load_score(&worker_loads[i]) + d->batch_count[i];
+        if (best < 0 || load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+
+    if (best >= 0) {
+        d->rr_next = (best + 1) % n;
+    }
+    return best;
+}
+
+/*
+ * Reject Connection from the Master
+ * Purpose: Answers 503 and closes the FD when no worker can take it.
+ */
+static void reject_connection(int client_fd)
+{
+    http_send_canned(client_fd, 503);
+    close(client_fd);
+}
+
+/*
+ * Dispatch a Burst of Connections
+ * Purpose: Spreads the FDs of one accept burst over the workers and sends
+ * each worker its share in one SCM_RIGHTS message.
+ *
+ * Parameters:
+ * - d: Dispatcher state.
+ * - conns: Accepted connections (ownership is taken: all FDs are closed on return).
+ * - count: Number of connections.
+ *
+ * Logic:
+ * 1. Assign every FD to a worker via pick_worker().
+ * 2. Send each group without blocking. A worker whose socket buffer is full
+ *    (EAGAIN) is skipped for the rest of the burst and its FDs go back to
+ *    step 1; a broken channel (EPIPE) marks the worker dead for good.
+ * 3. FDs that no worker can take are answered 503 by the Master.
+ */
+static void dispatch_burst(dispatcher_t *d, conn_info_t *conns, int count)
+{
+    memcpy(d->unavailable, d->dead, d->num_workers);
+
+    while (count > 0) {
+        memset(d->batch_count, 0, sizeof(int) * d->num_workers);
+
+        for (int i = 0; i < count; i++) {
+            int w = pick_worker(d);
+            if (w < 0) {
+                reject_connection(conns[i].fd);
+                continue;
+            }
+            d->batch[w * IPC_MAX_FDS + d->batch_count[w]++] = conns[i];
+        }
+
+        int retry = 0;
+        for (int w = 0; w < d->num_workers; w++) {
+            int n = d->batch_count[w];
+            if (n == 0) continue;
+            conn_info_t *group = &d->batch[w * IPC_MAX_FDS];
+
+            /* Threads receiving directly want one connection per message */
+            int per_message = (config.worker_recv_mode == RECV_MODE_DIRECT) ? 1 : n;
+            int sent = send_conns(d->pipes[w], group, n, per_message);
+            if (sent > 0) {
+                __atomic_fetch_add(&worker_loads[w].pending, sent, __ATOMIC_RELAXED);
+                /* * CRITICAL: Master must close the FDs.
+                 * The worker now has copies. If Master doesn't close them, the
+                 * sockets will remain open until the Master process exits.
+                 */
+                for (int i = 0; i < sent; i++) {
+                    close(group[i].fd);
+                }
+                if (sent == n) continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+                perror("send_conns");
+                fprintf(stderr, "Worker %d is unreachable, no longer dispatching to it.\n", w);
+                d->dead[w] = 1;
+            }
+            d->unavailable[w] = 1;
+
+            /* Re-queue the unsent part of this group for another worker */
+            if (sent < 0) sent = 0;
+            memcpy(&conns[retry], &group[sent], sizeof(conn_info_t) * (n - sent));
+            retry += n - sent;
+        }
+        count = retry;
+    }
+}
+
 /*
  * Start Master Server Logic
  * Purpose: Initializes the server socket, spawns worker processes, and 
- * enters the main loop to accept and distribute connections.
+ * either accepts and distributes connections (master-dispatch mode) or
+ * supervises workers that accept on their own (reuseport / shared modes).
  *
  * Return:
  * - 0 on clean shutdown.
@@ -56,40 +318,92 @@ int start_master_server()
     sa.sa_flags = 0; /* No SA_RESTART: we want accept() to be interrupted */
     sigaction(SIGINT, &sa, NULL);
 
-    /* 2. Create Server Socket */
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    int opt = 1;
-    /* Allow immediate reuse of the port after server restart */
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    /* SIGUSR1: every worker reopens LOG_FILE (after external log rotation) */
+    sa.sa_handler = handle_sigusr1;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    /* 2. Create Server Socket
+     * In reuseport mode every worker binds its own socket after fork, so the
+     * Master must not hold a listener (it would receive a share of the load).
+     * The listener is non-blocking: the Master drains its backlog in bursts
+     * and, in shared mode, workers drive it through epoll.
+     */
+    int server_socket = -1;
+    if (config.accept_mode != ACCEPT_MODE_REUSEPORT) {
+        server_socket = create_listen_socket(config.port, 0, 1);
+        if (server_socket < 0) {
+            return 1;
+        }
+    }
+
+    static const char *mode_names[] = { "master", "reuseport", "shared" };
+    printf("Master (PID: %d) listening on port %d (accept mode: %s).\n",
+           getpid(), config.port, mode_names[config.accept_mode]);
 
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY; /* Listen on all interfaces */
-    address.sin_port = htons(config.port); 
+    /* Shared per-worker load slots (read by the dispatcher and the monitor) */
+    init_worker_loads(config.num_workers);
 
-    if (bind(server_socket, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        return 1;
+    /* Optional shared file cache: created here so every worker inherits the
+     * same mapping (workers then skip creating a private cache).
+     */
+    int cache_ready = 0;
+    if (config.cache_shared) {
+        if (cache_init_shared((size_t)config.cache_size_mb * 1024 * 1024) != 0) {
+            perror("cache_init_shared");
+        } else {
+            cache_ready = 1;
+        }
     }
-    
-    /* Listen with a backlog of 128 pending connections */
-    listen(server_socket, 128);
 
-    printf("Master (PID: %d) listening on port %d.\n", getpid(), config.port);
+    /* Optional preload: warm the cache before forking. A private cache
+     * created here is inherited by each worker copy-on-write (workers then
+     * skip cache_init). Hits only write to the entries' slots, kept apart
+     * from the loaded bytes, so those pages stay shared (see cache.c).
+     */
+    if (config.cache_preload && config.cache_size_mb > 0) {
+        if (!config.cache_shared) {
+            if (cache_init((size_t)config.cache_size_mb * 1024 * 1024) == 0)
+                cache_ready = 1;
+            else
+                perror("cache_init");
+        }
+        /* Without a cache (creation failed) there is nothing to fill */
+        if (cache_ready) cache_preload();
+    }
 
     /* 3. Start Statistics Monitor Thread
      * This runs in the background to print server metrics periodically.
      */
     pthread_t stats_tid;
+    sigset_t stats_mask, prev_mask;
+    sigemptyset(&stats_mask);
+    sigaddset(&stats_mask, SIGINT);
+    sigaddset(&stats_mask, SIGCHLD);
+    /* The thread inherits a mask blocking SIGINT/SIGCHLD, so both are always
+     * delivered to the main thread (where accept()/sigsuspend() wait for them).
+     */
+    pthread_sigmask(SIG_BLOCK, &stats_mask, &prev_mask);
     pthread_create(&stats_tid, NULL, stats_monitor_thread, NULL);
 
+    /* Resets the shared cache if a worker dies inside it (same signal mask) */
+    pthread_t recovery_tid;
+    int recovering = (config.cache_shared && cache_ready &&
+                      pthread_create(&recovery_tid, NULL, cache_recovery_thread, NULL) == 0);
+    pthread_sigmask(SIG_SETMASK, &prev_mask, NULL);
+
     /* 4. Fork Worker Processes */
+    fflush(stdout); /* Don't let children inherit (and re-print) buffered output */
     int *worker_pipes = malloc(sizeof(int) * config.num_workers);
     for (int i = 0; i < config.num_workers; i++)
     {
-        /* Create a UNIX domain socket pair for passing File Descriptors */
+        /* Create a UNIX domain socket pair for passing File Descriptors.
+         * In reuseport/shared modes it carries no data and only signals
+         * shutdown (EOF) to the worker.
+         */
         int sv[2]; 
-        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        /* SOCK_SEQPACKET keeps each FD batch a single, atomic message */
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
             perror("socketpair");
             exit(1);
         }
@@ -97,53 +411,114 @@ int start_master_server()
         pid_t pid = fork();
         if (pid == 0) {
             /* === CHILD PROCESS (WORKER) === */
-            close(server_socket); /* Child does not accept connections */
             close(sv[0]);         /* Close Master's end of the pipe */
+
+            /* Close the pipes inherited for previously forked workers, so
+             * each worker sees EOF as soon as the Master closes its end.
+             */
+            for (int j = 0; j < i; j++) {
+                close(worker_pipes[j]);
+            }
+
+            /* Publish this worker's load in its own shared slot */
+            local_load = &worker_loads[i];
+            local_worker = i;
+
+            /* Pick the listener this worker accepts on (if any) */
+            int listen_fd = -1;
+            if (config.accept_mode == ACCEPT_MODE_MASTER) {
+                close(server_socket); /* Child does not accept connections */
+            } else if (config.accept_mode == ACCEPT_MODE_SHARED) {
+                listen_fd = server_socket; /* Inherited, shared by all workers */
+            } else {
+                listen_fd = create_listen_socket(config.port, 1, 1);
+                if (listen_fd < 0) {
+                    exit(1);
+                }
+            }
             
             /* Ignore SIGINT: Workers wait for pipe EOF to shutdown gracefully.
              * This prevents workers from dying mid-request when Ctrl+C is pressed.
              */
             signal(SIGINT, SIG_IGN); 
+            signal(SIGUSR1, SIG_IGN); /* Reopen requests go through the Master */
             
-            start_worker_process(sv[1]); /* Enter Worker Logic */
+            start_worker_process(sv[1], listen_fd); /* Enter Worker Logic */
             exit(0);
         }
         
         /* === PARENT PROCESS (MASTER) === */
         close(sv[1]); /* Close Worker's end */
+        /* Non-blocking: a stalled worker must never block the accept loop */
+        fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0) | O_NONBLOCK);
         worker_pipes[i] = sv[0]; /* Store Master's end */
     }
 
-    /* 5. Main Loop: Accept and Distribute */
-    int current_worker = 0;
-    
-    while (server_running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
+    /* 5. Main Loop */
+    if (config.accept_mode != ACCEPT_MODE_MASTER) {
+        /* Workers own the accept path; the Master no longer needs the socket */
+        if (server_socket >= 0) {
+            close(server_socket);
+            server_socket = -1;
+        }
+        supervise_workers(config.num_workers);
+    }
 
-        /* Blocking call - waits for a client */
-        int client_fd = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
-        
-        /* Check if accept failed due to signal interruption (Ctrl+C) */
-        if (client_fd < 0) {
+    /* Master-dispatch mode: Accept in bursts and Distribute */
+    dispatcher_t dispatcher = {0};
+    dispatcher.num_workers = config.num_workers;
+    dispatcher.pipes = worker_pipes;
+    dispatcher.batch_count = calloc(config.num_workers, sizeof(int));
+    dispatcher.batch = malloc(sizeof(conn_info_t) * IPC_MAX_FDS * config.num_workers);
+    dispatcher.dead = calloc(config.num_workers, 1);
+    dispatcher.unavailable = calloc(config.num_workers, 1);
+    dispatcher.seed = (unsigned int)getpid();
+    unsigned long next_conn_id = 0; /* Master-assigned IDs: acceptor 0 in the top bits */
+    int batch_limit = config.accept_batch;
+    if (batch_limit < 1) batch_limit = 1;
+    if (batch_limit > IPC_MAX_FDS) batch_limit = IPC_MAX_FDS;
+
+    struct pollfd listen_pfd = { .fd = server_socket, .events = POLLIN };
+    
+    while (server_running && config.accept_mode == ACCEPT_MODE_MASTER) {
+        /* Block until a client is waiting (interrupted by Ctrl+C) */
+        if (poll(&listen_pfd, 1, -1) < 0) {
             if (errno == EINTR) continue; /* Loop back to check server_running */
-            perror("accept");
+            perror("poll");
             continue;
         }
 
-        /* * Distribute connection to a worker via IPC (Round-Robin).
-         * We send the File Descriptor itself using SCM_RIGHTS.
-         */
-        send_fd(worker_pipes[current_worker], client_fd);
-        
-        /* * CRITICAL: Master must close the FD.
-         * The worker now has a copy. If Master doesn't close it, the socket
-         * will remain open until the Master process exits.
+        /* Drain the accept backlog until EAGAIN or the batch is full */
+        conn_info_t conns[IPC_MAX_FDS];
+        int count = 0;
+        while (count < batch_limit) {
+            conn_info_t *c = &conns[count];
+            socklen_t peer_len = sizeof(c->peer);
+            int client_fd = accept4(server_socket, (struct sockaddr *)&c->peer, &peer_len, SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+                break;
+            }
+            /* The metadata travels with the FD to the pool thread */
+            c->fd = client_fd;
+            clock_gettime(CLOCK_MONOTONIC, &c->accepted_at);
+            c->conn_id = ++next_conn_id;
+            count++;
+        }
+        if (count == 0) continue;
+
+        /* * Distribute the burst to the least busy workers via IPC.
+         * The FDs travel as SCM_RIGHTS messages, one per destination worker.
          */
-        close(client_fd);
-        current_worker = (current_worker + 1) % config.num_workers;
+        dispatch_burst(&dispatcher, conns, count);
     }
 
+    free(dispatcher.batch_count);
+    free(dispatcher.batch);
+    free(dispatcher.dead);
+    free(dispatcher.unavailable);
+
     /* 6. Shutdown Sequence */
     printf("\nShutting down server...\n");
 
@@ -160,10 +535,17 @@ int start_master_server()
      */
     pthread_cancel(stats_tid);
     pthread_join(stats_tid, NULL);
+    if (recovering) {
+        pthread_cancel(recovery_tid);
+        pthread_join(recovery_tid, NULL);
+    }
 
     /* Final cleanup */
+    cache_destroy();
     free(worker_pipes);
-    close(server_socket);
+    if (server_socket >= 0) {
+        close(server_socket);
+    }
 
     printf("Server stopped cleanly.\n");
     return 0;
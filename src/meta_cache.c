@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+
+#include "meta_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define META_SHARDS 16
+#define META_BUCKETS_PER_SHARD 256
+
+/* * Metadata Cache
+ * Remembers what a request path resolved to on disk: the file actually
+ * served (index.html for a directory) and its stat() result, or that
+ * nothing exists there. Hits cost no syscall, so HEAD, 304 and 404
+ * responses are answered without touching the filesystem.
+ *
+ * Keys are the document root joined with the canonical request path
+ * (percent-decoded, no "//" or "." segments, no trailing '/'), so every
+ * spelling of a URL shares one entry, and they are file paths the cache
+ * watcher can invalidate directly.
+ *
+ * Entries expire after 'ttl' seconds (negative ones after 'negative_ttl'),
+ * which bounds staleness when no watcher runs. Each shard is a small hash
+ * table under a mutex (a hit may remove an expired entry) with its entries
+ * on an insertion-ordered list: when a shard is full its oldest entry goes.
+ */
+typedef struct meta_entry {
+    struct meta_entry *hnext;
+    struct meta_entry *prev, *next; /* Insertion order (oldest first) */
+    unsigned long hash;
+    long expires_ms;
+    int found;
+    struct stat st;
+    char *path;                     /* Resolved file path (after the key) */
+    char key[];
+} meta_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    meta_entry_t *buckets[META_BUCKETS_PER_SHARD];
+    meta_entry_t *oldest, *newest;
+    size_t count;
+} __attribute__((aligned(64))) meta_shard_t;
+
+static struct {
+    meta_shard_t *shards;
+    size_t max_per_shard;
+    long ttl_ms;
+    long negative_ttl_ms;
+} meta;
+
+static unsigned long hash_str(const char *s)
+{
+    unsigned long h = 5381;
+    int c;
+    while ((c = *s++)) h = ((h << 5) + h) + (unsigned long)c;
+    return h;
+}
+
+/* Coarse monotonic clock: read from the vDSO, no syscall */
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static meta_shard_t *shard_of(unsigned long hash)
+{
+    return &meta.shards[hash % META_SHARDS];
+}
+
+static meta_entry_t **bucket_of(meta_shard_t *sh, unsigned long hash)
+{
+    return &sh->buckets[(hash / META_SHARDS) % META_BUCKETS_PER_SHARD];
+}
+
+/*
+ * Initialize the metadata cache.
+ * Purpose: Sets up an empty, process-private cache.
+ * Parameters:
+ * - max_entries: Capacity (0 disables the cache).
+ * - ttl: Seconds a found path stays valid.
+ * - negative_ttl: Seconds a missing path stays valid (0: not cached).
+ * Return: 0 on success (or disabled), -1 on failure.
+ */
+int meta_cache_init(size_t max_entries, int ttl, int negative_ttl)
+{
+    if (meta.shards) return 0;
+    if (max_entries == 0 || (ttl <= 0 && negative_ttl <= 0)) return 0;
+
+    meta_shard_t *shards = calloc(META_SHARDS, sizeof(meta_shard_t));
+    if (!shards) return -1;
+    for (int i = 0; i < META_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+    }
+    meta.max_per_shard = (max_entries + META_SHARDS - 1) / META_SHARDS;
+    meta.ttl_ms = ttl > 0 ? ttl * 1000L : 0;
+    meta.negative_ttl_ms = negative_ttl > 0 ? negative_ttl * 1000L : 0;
+    meta.shards = shards;
+    return 0;
+}
+
+/*
+ * Internal removal helper.
+ * Purpose: Unlinks an entry from its chain and the age list and frees it.
+ * Note: Caller must hold the shard lock.
+ */
+static void remove_entry(meta_shard_t *sh, meta_entry_t *e)
+{
+    meta_entry_t **link = bucket_of(sh, e->hash);
+    while (*link && *link != e) link = &(*link)->hnext;
+    if (*link) *link = e->hnext;
+
+    if (e->prev) e->prev->next = e->next; else sh->oldest = e->next;
+    if (e->next) e->next->prev = e->prev; else sh->newest = e->prev;
+    sh->count--;
+    free(e);
+}
+
+static meta_entry_t *find_entry(meta_shard_t *sh, const char *key, unsigned long hash)
+{
+    meta_entry_t *e = *bucket_of(sh, hash);
+    while (e && (e->hash != hash || strcmp(e->key, key) != 0)) e = e->hnext;
+    return e;
+}
+
+void meta_cache_destroy(void)
+{
+    if (!meta.shards) return;
+    for (int i = 0; i < META_SHARDS; i++) {
+        meta_shard_t *sh = &meta.shards[i];
+        while (sh->oldest) remove_entry(sh, sh->oldest);
+        pthread_mutex_destroy(&sh->lock);
+    }
+    free(meta.shards);
+    meta.shards = NULL;
+}
+
+/*
+ * Look up a path.
+ * Purpose: Returns the cached resolution of 'key' if it has not expired.
+ * Return: 0 on a hit ('out' filled, check out->found), -1 on a miss.
+ */
+int meta_cache_get(const char *key, meta_info_t *out)
+{
+    if (!meta.shards) return -1;
+    unsigned long h = hash_str(key);
+    meta_shard_t *sh = shard_of(h);
+
+    pthread_mutex_lock(&sh->lock);
+    meta_entry_t *e = find_entry(sh, key, h);
+    if (e && e->expires_ms - now_ms() <= 0) {
+        remove_entry(sh, e);
+        e = NULL;
+    }
+    if (e) {
+        out->found = e->found;
+        out->st = e->st;
+        snprintf(out->path, sizeof(out->path), "%s", e->path);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return e ? 0 : -1;
+}
+
+/*
+ * Remember a path.
+ * Purpose: Stores (or replaces) the resolution of 'key', evicting the
+ * shard's oldest entry when it is full. Negative results are only kept if
+ * a negative TTL is configured, positive ones if a TTL is.
+ */
+void meta_cache_put(const char *key, const meta_info_t *info)
+{
+    if (!meta.shards) return;
+    long ttl = info->found ? meta.ttl_ms : meta.negative_ttl_ms;
+    if (ttl == 0) return;
+
+    size_t key_len = strlen(key), path_len = info->found ? strlen(info->path) : 0;
+    meta_entry_t *n = malloc(sizeof(meta_entry_t) + key_len + 1 + path_len + 1);
+    if (!n) return;
+    n->hash = hash_str(key);
+    n->expires_ms = now_ms() + ttl;
+    n->found = info->found;
+    n->st = info->st;
+    memcpy(n->key, key, key_len + 1);
+    n->path = n->key + key_len + 1;
+    memcpy(n->path, info->found ? info->path : "", path_len + 1);
+
+    meta_shard_t *sh = shard_of(n->hash);
+    pthread_mutex_lock(&sh->lock);
+    meta_entry_t *old = find_entry(sh, key, n->hash);
+    if (old) remove_entry(sh, old);
+    if (sh->count >= meta.max_per_shard && sh->oldest) remove_entry(sh, sh->oldest);
+
+    meta_entry_t **bucket = bucket_of(sh, n->hash);
+    n->hnext = *bucket;
+    *bucket = n;
+    n->next = NULL;
+    n->prev = sh->newest;
+    if (sh->newest) sh->newest->next = n; else sh->oldest = n;
+    sh->newest = n;
+    sh->count++;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+static void drop_key(const char *key)
+{
+    unsigned long h = hash_str(key);
+    meta_shard_t *sh = shard_of(h);
+    pthread_mutex_lock(&sh->lock);
+    meta_entry_t *e = find_entry(sh, key, h);
+    if (e) remove_entry(sh, e);
+    pthread_mutex_unlock(&sh->lock);
+}
+
+/*
+ * Invalidate paths.
+ * Purpose: Forgets what is known about a file path that changed (created,
+ * written, deleted, renamed). A changed "index.html" also drops its
+ * directory's entry, which resolved to it. With 'subtree' set, 'path' is a
+ * directory and every key below it goes too, negative entries included.
+ */
+void meta_cache_invalidate(const char *path, int subtree)
+{
+    if (!meta.shards) return;
+    drop_key(path);
+
+    const char *slash = strrchr(path, '/');
+    if (slash && strcmp(slash + 1, "index.html") == 0) {
+        char dir[META_PATH_MAX];
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+        drop_key(dir);
+    }
+
+    if (!subtree) return;
+    size_t len = strlen(path);
+    for (int i = 0; i < META_SHARDS; i++) {
+        meta_shard_t *sh = &meta.shards[i];
+        pthread_mutex_lock(&sh->lock);
+        meta_entry_t *e = sh->oldest;
+        while (e) {
+            meta_entry_t *next = e->next;
+            if (strncmp(e->key, path, len) == 0 && e->key[len] == '/') remove_entry(sh, e);
+            e = next;
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef META_CACHE_H
+#define META_CACHE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#define META_PATH_MAX 1024
+
+/* What a path lookup resolved to */
+typedef struct {
+    int found;                  /* 0: negative entry (the path does not exist) */
+    struct stat st;             /* Attributes of the file served */
+    char path[META_PATH_MAX];   /* File served (".../index.html" for a directory) */
+} meta_info_t;
+
+int meta_cache_init(size_t max_entries, int ttl, int negative_ttl);
+void meta_cache_destroy(void);
+int meta_cache_get(const char *key, meta_info_t *out);
+void meta_cache_put(const char *key, const meta_info_t *info);
+void meta_cache_invalidate(const char *path, int subtree);
+
+#endif
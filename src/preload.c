@@ -0,0 +1,254 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "cache.h"
+#include "connection.h"
+#include "preload.h"
+
+extern server_config_t config;
+
+/* One file found by the directory walk */
+typedef struct {
+    char *path;
+    size_t size;
+} preload_file_t;
+
+/* * Preload Job
+ * The file list is built once by the Master thread, then loader threads
+ * claim files through 'next' and reserve their size against the budget
+ * before reading, so the budget is never overshot.
+ */
+typedef struct {
+    preload_file_t *files;
+    size_t count, cap;
+    size_t next;          /* Next unclaimed file (atomic) */
+    size_t budget;        /* Bytes that may be read */
+    size_t reserved;      /* Bytes claimed so far (atomic) */
+    size_t cached;        /* Bytes actually stored, incl. gzip variants (atomic) */
+    size_t loaded;        /* Files stored (atomic) */
+} preload_job_t;
+
+/* Wall-clock start of the preload (0: none), inherited by the workers */
+static time_t preload_started;
+
+/*
+ * Glob Match
+ * Purpose: Checks a file against PRELOAD_GLOBS (e.g. "*.css,*.js").
+ * Patterns without a '/' match the file name in any directory, the others
+ * the path relative to the document root.
+ */
+static int matches_globs(const char *rel_path, const char *name)
+{
+    char globs[sizeof(config.preload_globs)];
+    snprintf(globs, sizeof(globs), "%s", config.preload_globs);
+
+    char *save = NULL;
+    for (char *g = strtok_r(globs, ",", &save); g; g = strtok_r(NULL, ",", &save)) {
+        const char *subject = strchr(g, '/') ? rel_path : name;
+        if (fnmatch(g, subject, strchr(g, '/') ? FNM_PATHNAME : 0) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Is 'path' (ending in ".gz") the precompressed sibling of an existing file? */
+static int is_gz_sibling(const char *path)
+{
+    size_t len = strlen(path);
+    if (len < 4 || strcmp(path + len - 3, ".gz") != 0)
+        return 0;
+    char base[PATH_MAX];
+    snprintf(base, sizeof(base), "%.*s", (int)(len - 3), path);
+    struct stat st;
+    return stat(base, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/*
+ * Collect Files
+ * Purpose: Walks the document root recursively and lists the regular files
+ * the cache would accept (non-empty, under 1MB) that match the globs.
+ * Precompressed ".gz" siblings are skipped: they are loaded as the gzip
+ * variant of their base file. Symbolic links to directories are not
+ * followed.
+ */
+static void collect_files(preload_job_t *job, const char *dir_path, size_t root_len)
+{
+    DIR *dir = opendir(dir_path[0] ? dir_path : "/");
+    if (!dir) return;
+
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", dir_path, e->d_name) >= (int)sizeof(path))
+            continue;
+
+        struct stat st;
+        if (lstat(path, &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode)) {
+            collect_files(job, path, root_len);
+            continue;
+        }
+        if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || !S_ISREG(st.st_mode)))
+            continue;
+        if (!S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size >= 1 * 1024 * 1024)
+            continue;
+        if (!matches_globs(path + root_len + 1, e->d_name) || is_gz_sibling(path))
+            continue;
+
+        if (job->count == job->cap) {
+            size_t cap = job->cap ? job->cap * 2 : 256;
+            preload_file_t *files = realloc(job->files, cap * sizeof(*files));
+            if (!files) break;
+            job->files = files;
+            job->cap = cap;
+        }
+        char *copy = strdup(path);
+        if (!copy) break;
+        job->files[job->count].path = copy;
+        job->files[job->count].size = st.st_size;
+        job->count++;
+    }
+    closedir(dir);
+}
+
+/* Smallest files first: the most hits per preloaded byte */
+static int by_size(const void *a, const void *b)
+{
+    size_t x = ((const preload_file_t *)a)->size, y = ((const preload_file_t *)b)->size;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Loader Thread
+ * Purpose: Claims files from the job until the list or the budget runs out
+ * and stores each one in the cache (see conn_preload_file()).
+ */
+static void *preload_thread(void *arg)
+{
+    preload_job_t *job = arg;
+
+    while (1) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count)
+            break;
+        preload_file_t *f = &job->files[i];
+
+        /* Sorted by size: once one file exceeds the budget, all later ones do */
+        size_t before = __atomic_fetch_add(&job->reserved, f->size, __ATOMIC_RELAXED);
+        if (before + f->size > job->budget) {
+            __atomic_fetch_sub(&job->reserved, f->size, __ATOMIC_RELAXED);
+            break;
+        }
+
+        struct stat st;
+        if (stat(f->path, &st) != 0)
+            continue;
+        size_t cached = conn_preload_file(f->path, &st);
+        if (cached > 0) {
+            __atomic_fetch_add(&job->cached, cached, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&job->loaded, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Preload Cache
+ * Purpose: Fills the cache from the document root before the workers are
+ * forked (CACHE_PRELOAD=1), so the first requests after a start are hits.
+ * Must run in the Master after the cache exists and before fork(). With a
+ * private cache, each worker inherits the loaded entries copy-on-write; with
+ * CACHE_SHARED all workers see the same entries.
+ *
+ * Logic:
+ * - The file list is sorted by size and read by PRELOAD_THREADS loader
+ *   threads, up to PRELOAD_BUDGET_MB (at most the cache size).
+ * - The threads are joined before returning, so fork() sees a single
+ *   threaded process with every cache lock released.
+ *
+ * Return:
+ * - Number of files preloaded.
+ */
+int cache_preload(void)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    preload_started = time(NULL);
+
+    char root[PATH_MAX];
+    snprintf(root, sizeof(root), "%s", config.document_root);
+    size_t root_len = strlen(root);
+    while (root_len > 0 && root[root_len - 1] == '/')
+        root[--root_len] = '\0';
+
+    preload_job_t job = {0};
+    size_t cache_bytes = (size_t)config.cache_size_mb * 1024 * 1024;
+    job.budget = (size_t)config.preload_budget_mb * 1024 * 1024;
+    if (job.budget == 0 || job.budget > cache_bytes)
+        job.budget = cache_bytes;
+
+    collect_files(&job, root, root_len);
+    qsort(job.files, job.count, sizeof(*job.files), by_size);
+
+    int count = config.preload_threads > 0 ? config.preload_threads : 1;
+    pthread_t *threads = malloc(sizeof(pthread_t) * count);
+    int created = 0;
+    for (int i = 0; threads && i < count; i++) {
+        if (pthread_create(&threads[i], NULL, preload_thread, &job) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        created++;
+    }
+    if (created == 0)
+        preload_thread(&job); /* No threads: load inline */
+    for (int i = 0; i < created; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    printf("Cache preload: %zu of %zu files, %.1f MB in %ld ms (%d threads).\n",
+           job.loaded, job.count, job.cached / (1024.0 * 1024.0), ms, created);
+
+    for (size_t i = 0; i < job.count; i++) {
+        free(job.files[i].path);
+    }
+    free(job.files);
+    return (int)job.loaded;
+}
+
+/* Changed since the preload began (1s margin for coarse file timestamps)? */
+static int changed_since_preload(const char *path, void *arg)
+{
+    (void)arg;
+    struct stat st;
+    return stat(path, &st) != 0 || st.st_mtime >= preload_started - 1;
+}
+
+/*
+ * Recheck Preloaded Entries
+ * Purpose: Called by a worker once its cache watcher runs. Files changed
+ * between the preload and that point produced no event the worker could
+ * see, so any entry whose file is newer than the preload (or gone) is
+ * dropped. No-op if nothing was preloaded.
+ */
+void cache_preload_recheck(void)
+{
+    if (preload_started == 0)
+        return;
+    cache_invalidate_if(changed_since_preload, NULL);
+}
@@ -0,0 +1,7 @@
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+int cache_preload(void);
+void cache_preload_recheck(void);
+
+#endif
@@ -10,6 +10,16 @@
 /* Global pointers to shared memory regions */
 connection_queue_t *queue = NULL;
 server_stats_t *stats = NULL;
+worker_load_t *worker_loads = NULL;
+
+/* This worker's own slot in worker_loads (NULL in the Master) */
+worker_load_t *local_load = NULL;
+
+/* Latency histograms, one set per stats slot */
+thread_latency_t *stats_latencies = NULL;
+
+/* This worker's index (-1 in the Master) */
+int local_worker = -1;
 
 /*
  * Initialize Shared Connection Queue
@@ -64,12 +74,6 @@ void init_shared_queue(int max_queue_size)
     }
     pthread_mutexattr_destroy(&mutex_attr);
 
-    /* Initialize Semaphore for Logging (Binary Semaphore / Mutex) */
-    if (sem_init(&queue->log_mutex, 1, 1) != 0) {
-        perror("sem init log_mutex");
-        exit(1);
-    }
-    
     /* Initialize Producer-Consumer Semaphores */
     if (sem_init(&queue->empty_slots, 1, max_queue_size) != 0 ||
         sem_init(&queue->filled_slots, 1, 0) != 0) {
@@ -80,39 +84,80 @@ void init_shared_queue(int max_queue_size)
 
 /*
  * Initialize Shared Statistics
- * Purpose: Allocates a shared memory block for server metrics (requests, bytes, etc.).
+ * Purpose: Allocates a shared memory block for server metrics (requests, bytes, etc.)
+ * and the latency histograms that go with each slot.
  *
  * Logic:
- * - Uses mmap for shared access.
- * - Initializes a process-shared semaphore (stats->mutex) to protect counter updates.
+ * - Uses mmap for shared access; must run in the Master before fork.
+ * - No lock: each thread updates its own slot (see stats.c).
+ * - Pages are only committed when touched, so the histograms of slots no
+ *   thread claims cost no memory.
  */
 void init_shared_stats()
 {
     void *mem_block = mmap(NULL, sizeof(server_stats_t), 
                            PROT_READ | PROT_WRITE, 
                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    void *lat_block = mmap(NULL, sizeof(thread_latency_t) * STATS_MAX_SLOTS,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
 
-    if (mem_block == MAP_FAILED) {
+    if (mem_block == MAP_FAILED || lat_block == MAP_FAILED) {
         perror("mmap stats failed");
         exit(1);
     }
 
+    /* Anonymous mappings are zero-filled: all counters start at 0 */
     stats = (server_stats_t *)mem_block;
+    stats_latencies = (thread_latency_t *)lat_block;
+}
+
+/*
+ * Initialize Worker Load Table
+ * Purpose: Allocates one zeroed, cache-line sized load slot per worker in
+ * shared memory. Must be called by the Master before forking so every
+ * worker inherits the same mapping.
+ *
+ * Parameters:
+ * - num_workers: Number of slots to allocate.
+ */
+void init_worker_loads(int num_workers)
+{
+    void *mem_block = mmap(NULL, sizeof(worker_load_t) * num_workers,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
 
-    /* Zero out all counters */
-    stats->total_requests = 0;
-    stats->bytes_transferred = 0;
-    stats->status_200 = 0;
-    stats->status_404 = 0;
-    stats->status_500 = 0;
-    stats->active_connections = 0;
-    stats->average_response_time = 0;
-
-    /* Initialize binary semaphore (value 1) for mutual exclusion */
-    if (sem_init(&stats->mutex, 1, 1) != 0) {
-        perror("sem init stats");
+    if (mem_block == MAP_FAILED) {
+        perror("mmap worker loads failed");
         exit(1);
     }
+
+    /* Anonymous mappings are zero-filled: all counters start at 0 */
+    worker_loads = (worker_load_t *)mem_block;
+}
+
+/*
+ * Worker Load Score
+ * Purpose: Returns the number of connections a worker currently owns
+ * (in transit + queued + being served). Lower is less loaded.
+ */
+int worker_load_score(const worker_load_t *load)
+{
+    return __atomic_load_n(&load->pending, __ATOMIC_RELAXED) +
+           __atomic_load_n(&load->queued, __ATOMIC_RELAXED) +
+           __atomic_load_n(&load->in_flight, __ATOMIC_RELAXED);
+}
+
+/*
+ * Worker Waiting Count
+ * Purpose: Returns the number of connections a worker owns that no pool
+ * thread has picked up yet (in transit from the Master + queued locally).
+ * Non-zero means an idle keep-alive connection is holding a thread they need.
+ */
+int worker_load_waiting(const worker_load_t *load)
+{
+    return __atomic_load_n(&load->pending, __ATOMIC_RELAXED) +
+           __atomic_load_n(&load->queued, __ATOMIC_RELAXED);
 }
 
 /*
@@ -14,28 +14,102 @@ typedef struct
     sem_t empty_slots;
     sem_t filled_slots;
     pthread_mutex_t mutex;
-    sem_t log_mutex;
     int shutting_down; 
 } connection_queue_t;
 
+#define STATS_MAX_SLOTS 1024
+
+/*
+ * Per-thread statistics counters. Every thread that serves requests claims
+ * its own slot on first use, so updates never share a cache line with
+ * another thread and need no lock; readers sum all slots (see stats.c).
+ * All fields are accessed with relaxed __atomic built-ins.
+ */
 typedef struct
 {
     long total_requests;
     long bytes_transferred;
+    long response_time_ns;     /* Sum over total_requests */
     long status_200;
     long status_404;
     long status_500;
-    int active_connections;
-    int average_response_time;
-    sem_t mutex;
+    long queue_delay_total_us; /* Sum of accept -> thread pickup delays */
+    long queue_delay_samples;
+    long active_connections;   /* Opened minus closed by this thread */
+    int worker;                /* Owning worker's index (-1: the Master) */
+} __attribute__((aligned(64))) stats_slot_t;
+
+typedef struct
+{
+    int slots_claimed;         /* Slots handed out so far (atomic) */
+    stats_slot_t slots[STATS_MAX_SLOTS];
 } server_stats_t;
 
 
+/*
+ * Per-worker load counters, published by each worker and read by the Master
+ * to choose where to dispatch new connections. Each slot owns a full cache
+ * line so workers never contend on each other's counters.
+ * All fields are accessed with __atomic built-ins.
+ */
+typedef struct
+{
+    int pending;   /* Sent by the Master, not yet received by the worker */
+    int queued;    /* Waiting in the worker's local queue */
+    int in_flight; /* Being served by a pool thread */
+} __attribute__((aligned(64))) worker_load_t;
+
+/*
+ * Latency Histogram (log-linear, HDR style)
+ * Request latencies in nanoseconds. Values below 2 * LAT_SUB_COUNT have a
+ * bucket each; above, every power of two is split into LAT_SUB_COUNT equal
+ * buckets, so any value is known to within 1/LAT_SUB_COUNT (about 3%)
+ * from 64 ns up to LAT_MAX_NS, where larger values are clamped. Buckets
+ * only ever grow, so a reader gets the counts for an interval by
+ * subtracting an earlier copy.
+ */
+#define LAT_SUB_BITS 5
+#define LAT_SUB_COUNT (1 << LAT_SUB_BITS)
+#define LAT_MAX_SHIFT 31                                    /* Largest bucket width: 2^31 ns */
+#define LAT_BUCKETS ((LAT_MAX_SHIFT + 2) * LAT_SUB_COUNT)
+#define LAT_MAX_NS ((2L * LAT_SUB_COUNT << LAT_MAX_SHIFT) - 1) /* ~137 s */
+
+/* Status classes with their own histogram */
+#define LAT_CLASS_2XX 0 /* Also anything below 200 */
+#define LAT_CLASS_3XX 1
+#define LAT_CLASS_4XX 2
+#define LAT_CLASS_5XX 3 /* Also anything above 599 */
+#define LAT_CLASSES   4
+
+typedef struct
+{
+    long count;
+    long sum_ns;
+    long buckets[LAT_BUCKETS];
+} latency_hist_t;
+
+/*
+ * One thread's histograms, by status class. Kept per stats slot (same
+ * index), so like the counters they are only written by their own thread
+ * and the monitor sums them; the slot's 'worker' attributes them.
+ */
+typedef struct
+{
+    latency_hist_t by_class[LAT_CLASSES];
+} __attribute__((aligned(64))) thread_latency_t;
+
 extern connection_queue_t *queue;
 extern server_stats_t *stats;
+extern worker_load_t *worker_loads;
+extern worker_load_t *local_load;
+extern thread_latency_t *stats_latencies;
+extern int local_worker;
 
 void init_shared_queue(int max_queue_size);
 void init_shared_stats();
+void init_worker_loads(int num_workers);
+int worker_load_score(const worker_load_t *load);
+int worker_load_waiting(const worker_load_t *load);
 int enqueue(int client_socket);
 int dequeue();
 
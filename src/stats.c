@@ -1,12 +1,263 @@
 #include "shared_mem.h"
+#include "stats.h"
 #include "config.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
 
 /* Access global configuration for the timeout interval */
 extern server_config_t config;
 
+/* The calling thread's slot and histograms, claimed on its first update */
+static __thread stats_slot_t *my_slot = NULL;
+static __thread thread_latency_t *my_latency = NULL;
+
+/*
+ * Claim a Slot
+ * Purpose: Returns the calling thread's counters. Slots are handed out once
+ * per thread across all workers; past STATS_MAX_SLOTS the threads share
+ * the last one (still correct, since updates are atomic adds). The slot
+ * records its worker, and the histograms with the same index become the
+ * thread's.
+ */
+static stats_slot_t *local_slot(void)
+{
+    if (!my_slot) {
+        int i = __atomic_fetch_add(&stats->slots_claimed, 1, __ATOMIC_RELAXED);
+        if (i >= STATS_MAX_SLOTS) i = STATS_MAX_SLOTS - 1;
+        my_slot = &stats->slots[i];
+        __atomic_store_n(&my_slot->worker, local_worker, __ATOMIC_RELAXED);
+        if (stats_latencies) my_latency = &stats_latencies[i];
+    }
+    return my_slot;
+}
+
+#define STAT_ADD(slot, field, value) __atomic_fetch_add(&(slot)->field, (value), __ATOMIC_RELAXED)
+
+/*
+ * Record a New Connection
+ * Parameters:
+ * - queue_delay_us: accept() to thread pickup, or -1 if unknown.
+ */
+void stats_connection_opened(long queue_delay_us)
+{
+    stats_slot_t *s = local_slot();
+    STAT_ADD(s, active_connections, 1);
+    if (queue_delay_us >= 0) {
+        STAT_ADD(s, queue_delay_total_us, queue_delay_us);
+        STAT_ADD(s, queue_delay_samples, 1);
+    }
+}
+
+void stats_connection_closed(void)
+{
+    STAT_ADD(local_slot(), active_connections, -1);
+}
+
+/*
+ * Latency Bucket
+ * Purpose: Maps a latency in nanoseconds to its histogram bucket (see
+ * latency_hist_t): exact below 2 * LAT_SUB_COUNT, then LAT_SUB_COUNT
+ * buckets per power of two.
+ */
+int latency_bucket(long ns)
+{
+    if (ns < 0) ns = 0;
+    if (ns > LAT_MAX_NS) ns = LAT_MAX_NS;
+    if (ns < 2 * LAT_SUB_COUNT) return (int)ns;
+
+    int shift = (63 - __builtin_clzl((unsigned long)ns)) - LAT_SUB_BITS;
+    return shift * LAT_SUB_COUNT + (int)(ns >> shift);
+}
+
+/* Largest latency (ns) counted in 'bucket' */
+long latency_bucket_max(int bucket)
+{
+    if (bucket < 2 * LAT_SUB_COUNT) return bucket;
+    int shift = bucket / LAT_SUB_COUNT - 1;
+    long sub = bucket - shift * LAT_SUB_COUNT; /* In [LAT_SUB_COUNT, 2 * LAT_SUB_COUNT) */
+    return ((sub + 1) << shift) - 1;
+}
+
+/* Adds one latency to a histogram (atomic: the last slot may be shared) */
+void latency_record(latency_hist_t *h, long ns)
+{
+    __atomic_fetch_add(&h->buckets[latency_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Latency Percentile
+ * Purpose: Returns the latency (ns) at or below which 'percent' percent of
+ * the recorded requests fall, as the upper bound of the bucket holding
+ * that rank (an overestimate of at most ~3%). 0 for an empty histogram.
+ */
+long latency_percentile(const latency_hist_t *h, double percent)
+{
+    long total = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) total += h->buckets[i];
+    if (total == 0) return 0;
+
+    long rank = (long)(percent / 100.0 * total + 0.999999);
+    if (rank < 1) rank = 1;
+    long seen = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) return latency_bucket_max(i);
+    }
+    return LAT_MAX_NS;
+}
+
+static int latency_class(int status)
+{
+    if (status < 300) return LAT_CLASS_2XX;
+    if (status < 400) return LAT_CLASS_3XX;
+    if (status < 500) return LAT_CLASS_4XX;
+    return LAT_CLASS_5XX;
+}
+
+/* Record a Finished Request */
+void stats_request_done(int status, long bytes, long elapsed_ns)
+{
+    stats_slot_t *s = local_slot();
+    STAT_ADD(s, total_requests, 1);
+    STAT_ADD(s, bytes_transferred, bytes);
+    STAT_ADD(s, response_time_ns, elapsed_ns);
+
+    if (status == 200) STAT_ADD(s, status_200, 1);
+    else if (status == 404) STAT_ADD(s, status_404, 1);
+    else if (status == 500) STAT_ADD(s, status_500, 1);
+
+    if (my_latency)
+        latency_record(&my_latency->by_class[latency_class(status)], elapsed_ns);
+}
+
+/*
+ * Read Totals
+ * Purpose: Sums every claimed slot into 'totals'. Counters are read one by
+ * one while threads keep updating them, so the totals are a close, not an
+ * exact, snapshot (e.g. a request may be counted before its bytes).
+ */
+void stats_read(stats_slot_t *totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    int n = __atomic_load_n(&stats->slots_claimed, __ATOMIC_RELAXED);
+    if (n > STATS_MAX_SLOTS) n = STATS_MAX_SLOTS;
+
+    for (int i = 0; i < n; i++) {
+        const stats_slot_t *s = &stats->slots[i];
+        totals->total_requests += __atomic_load_n(&s->total_requests, __ATOMIC_RELAXED);
+        totals->bytes_transferred += __atomic_load_n(&s->bytes_transferred, __ATOMIC_RELAXED);
+        totals->response_time_ns += __atomic_load_n(&s->response_time_ns, __ATOMIC_RELAXED);
+        totals->status_200 += __atomic_load_n(&s->status_200, __ATOMIC_RELAXED);
+        totals->status_404 += __atomic_load_n(&s->status_404, __ATOMIC_RELAXED);
+        totals->status_500 += __atomic_load_n(&s->status_500, __ATOMIC_RELAXED);
+        totals->queue_delay_total_us += __atomic_load_n(&s->queue_delay_total_us, __ATOMIC_RELAXED);
+        totals->queue_delay_samples += __atomic_load_n(&s->queue_delay_samples, __ATOMIC_RELAXED);
+        totals->active_connections += __atomic_load_n(&s->active_connections, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Interval Histogram
+ * Purpose: Adds to 'acc' what 'cur' (live, shared) recorded since 'prev'
+ * was copied from it, then refreshes 'prev'. The live histograms are never
+ * written by the reader, so "resetting" each interval costs the workers
+ * nothing.
+ */
+static void add_interval(latency_hist_t *acc, const latency_hist_t *cur, latency_hist_t *prev)
+{
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        long now = __atomic_load_n(&cur->buckets[i], __ATOMIC_RELAXED);
+        acc->buckets[i] += now - prev->buckets[i];
+        prev->buckets[i] = now;
+    }
+    long count = __atomic_load_n(&cur->count, __ATOMIC_RELAXED);
+    long sum = __atomic_load_n(&cur->sum_ns, __ATOMIC_RELAXED);
+    acc->count += count - prev->count;
+    acc->sum_ns += sum - prev->sum_ns;
+    prev->count = count;
+    prev->sum_ns = sum;
+}
+
+static void merge_hist(latency_hist_t *acc, const latency_hist_t *h)
+{
+    for (int i = 0; i < LAT_BUCKETS; i++) acc->buckets[i] += h->buckets[i];
+    acc->count += h->count;
+    acc->sum_ns += h->sum_ns;
+}
+
+static void print_latency_row(const char *label, const latency_hist_t *h)
+{
+    if (h->count <= 0) return;
+    printf("  %-10s %9ld %9.3f %9.3f %9.3f %9.3f %9.3f\n", label, h->count,
+           latency_percentile(h, 50.0) / 1e6, latency_percentile(h, 90.0) / 1e6,
+           latency_percentile(h, 99.0) / 1e6, latency_percentile(h, 99.9) / 1e6,
+           latency_percentile(h, 100.0) / 1e6);
+}
+
+/*
+ * Latency Report
+ * Purpose: Prints p50/p90/p99/p99.9/max of the requests completed since the
+ * previous report: overall, per status class and per worker.
+ * Logic: Like stats_read(), walks every claimed slot: the interval part of
+ * each thread's histograms is added to the totals, its class and the
+ * worker recorded in its slot.
+ */
+static void print_latency_report(void)
+{
+    static thread_latency_t *prev = NULL; /* Last copy of each slot's histograms */
+    static int prev_slots = 0;
+    static latency_hist_t *merged = NULL; /* All, per class, per worker */
+    static latency_hist_t interval;
+    int workers = config.num_workers;
+    int merged_count = 1 + LAT_CLASSES + workers;
+
+    if (!stats_latencies || workers <= 0) return;
+    if (!merged && !(merged = malloc(sizeof(latency_hist_t) * merged_count))) return;
+
+    int n = __atomic_load_n(&stats->slots_claimed, __ATOMIC_RELAXED);
+    if (n > STATS_MAX_SLOTS) n = STATS_MAX_SLOTS;
+    if (n > prev_slots) {
+        thread_latency_t *grown = realloc(prev, sizeof(thread_latency_t) * n);
+        if (!grown) return;
+        memset(grown + prev_slots, 0, sizeof(thread_latency_t) * (n - prev_slots));
+        prev = grown;
+        prev_slots = n;
+    }
+
+    memset(merged, 0, sizeof(latency_hist_t) * merged_count);
+    for (int i = 0; i < n; i++) {
+        int w = __atomic_load_n(&stats->slots[i].worker, __ATOMIC_RELAXED);
+        for (int c = 0; c < LAT_CLASSES; c++) {
+            memset(&interval, 0, sizeof(interval));
+            add_interval(&interval, &stats_latencies[i].by_class[c], &prev[i].by_class[c]);
+            if (interval.count == 0) continue;
+            merge_hist(&merged[0], &interval);
+            merge_hist(&merged[1 + c], &interval);
+            if (w >= 0 && w < workers) merge_hist(&merged[1 + LAT_CLASSES + w], &interval);
+        }
+    }
+
+    static const char *class_names[LAT_CLASSES] = { "2xx", "3xx", "4xx", "5xx" };
+    printf("Latency (ms, last %ds):\n", config.timeout_seconds);
+    if (merged[0].count <= 0) {
+        printf("  (no requests)\n");
+        return;
+    }
+    printf("  %-10s %9s %9s %9s %9s %9s %9s\n", "", "count", "p50", "p90", "p99", "p99.9", "max");
+    print_latency_row("All", &merged[0]);
+    for (int c = 0; c < LAT_CLASSES; c++) print_latency_row(class_names[c], &merged[1 + c]);
+    for (int w = 0; w < workers; w++) {
+        char label[24];
+        snprintf(label, sizeof(label), "Worker %d", w);
+        print_latency_row(label, &merged[1 + LAT_CLASSES + w]);
+    }
+}
+
 /*
  * Statistics Monitor Thread
  * Purpose: This thread runs in the background (typically in the Master process)
@@ -18,11 +269,11 @@ extern server_config_t config;
  *
  * Logic:
  * 1. Sleeps for a configured interval (e.g., 30 seconds).
- * 2. Acquires the stats mutex to ensure it reads a consistent snapshot of the data.
- * (This prevents reading partially updated counters from workers).
+ * 2. Sums the per-thread slots (no lock: the request threads never wait
+ *    for the monitor, nor the monitor for them).
  * 3. Calculates derived metrics (e.g., Average Response Time).
- * 4. Prints a formatted report.
- * 5. Releases the mutex.
+ * 4. Prints a formatted report, with latency percentiles for the
+ *    requests of the last interval.
  */
 void *stats_monitor_thread(void *arg) {
     (void)arg; /* Mark unused parameter to avoid compiler warnings */
@@ -31,28 +282,37 @@ void *stats_monitor_thread(void *arg) {
         /* Wait for the next reporting interval defined in server.conf */
         sleep(config.timeout_seconds);
 
-        /* Enter Critical Section: Lock stats to prevent modification during read */
-        sem_wait(&stats->mutex);
+        stats_slot_t t;
+        stats_read(&t);
         
         /* Calculate Average Response Time (avoid division by zero) */
         double avg_time = 0.0;
-        if (stats->total_requests > 0) {
-            avg_time = (double)stats->average_response_time / stats->total_requests;
+        if (t.total_requests > 0) {
+            avg_time = (double)t.response_time_ns / t.total_requests / 1e6;
+        }
+
+        double avg_queue_delay = 0.0;
+        if (t.queue_delay_samples > 0) {
+            avg_queue_delay = (double)t.queue_delay_total_us / t.queue_delay_samples / 1000.0;
         }
 
         /* Display Statistics Dashboard */
         printf("\n=== SERVER STATISTICS ===\n");
-        printf("Active Connections: %d\n", stats->active_connections);
-        printf("Total Requests:     %ld\n", stats->total_requests);
-        printf("Bytes Transferred:  %ld\n", stats->bytes_transferred);
-        printf("Avg Response Time:  %.2f ms\n", avg_time);
-        printf("Status 200 (OK):    %ld\n", stats->status_200);
-        printf("Status 404 (NF):    %ld\n", stats->status_404);
-        printf("Status 500 (Err):   %ld\n", stats->status_500);
+        printf("Active Connections: %ld\n", t.active_connections);
+        printf("Total Requests:     %ld\n", t.total_requests);
+        printf("Bytes Transferred:  %ld\n", t.bytes_transferred);
+        printf("Avg Response Time:  %.3f ms\n", avg_time);
+        printf("Avg Queue Delay:    %.3f ms\n", avg_queue_delay);
+        printf("Status 200 (OK):    %ld\n", t.status_200);
+        printf("Status 404 (NF):    %ld\n", t.status_404);
+        printf("Status 500 (Err):   %ld\n", t.status_500);
+        for (int i = 0; worker_loads && i < config.num_workers; i++) {
+            printf("Worker %d Load:      %d queued, %d in flight\n", i,
+                   __atomic_load_n(&worker_loads[i].queued, __ATOMIC_RELAXED),
+                   __atomic_load_n(&worker_loads[i].in_flight, __ATOMIC_RELAXED));
+        }
+        print_latency_report();
         printf("=========================\n\n");
-
-        /* Exit Critical Section */
-        sem_post(&stats->mutex);
     }
     return NULL;
 }
\ No newline at end of file
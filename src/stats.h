@@ -1,6 +1,18 @@
 #ifndef STATS_H
-#define SHARED_MEM_H
+#define STATS_H
+
+#include "shared_mem.h"
+
+void stats_connection_opened(long queue_delay_us);
+void stats_connection_closed(void);
+void stats_request_done(int status, long bytes, long elapsed_ns);
+void stats_read(stats_slot_t *totals);
+
+int latency_bucket(long ns);
+long latency_bucket_max(int bucket);
+void latency_record(latency_hist_t *h, long ns);
+long latency_percentile(const latency_hist_t *h, double percent);
 
 void *stats_monitor_thread(void *arg);
 
-#endif
\ No newline at end of file
+#endif
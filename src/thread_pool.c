@@ -1,9 +1,18 @@
+#define _GNU_SOURCE
+
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
 #include "config.h"
 #include "logger.h"
 #include "shared_mem.h"
@@ -11,40 +20,202 @@
 #include "ipc.h"
 #include "http.h"
 #include "cache.h"
+#include "event_loop.h"
+#include "watcher.h"
+#include "preload.h"
+#include "meta_cache.h"
+#include "fd_cache.h"
 
 /* Access global configuration and shared queue structure */
 extern server_config_t config;
 extern connection_queue_t *queue;
 
+/* EPOLLEXCLUSIVE (Linux 4.5+) may be missing from older libc headers */
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+/*
+ * Accept Loop (reuseport / shared modes)
+ * Purpose: Accepts connections directly on the worker's listening socket and
+ * hands them to the thread pool, removing the Master relay from the hot path.
+ *
+ * Parameters:
+ * - listen_fd: Non-blocking listening socket (own SO_REUSEPORT socket, or
+ *   the listener inherited from the Master in shared mode).
+ * - ipc_socket: Channel to the Master. It carries no data in these modes;
+ *   EOF on it is the shutdown signal.
+ * - local_q: The thread pool queue.
+ *
+ * Logic:
+ * - In shared mode the listener is registered with EPOLLEXCLUSIVE so a new
+ *   connection wakes only one of the workers instead of all of them.
+ * - On wake-up the backlog is drained with accept4() until EAGAIN (another
+ *   worker may have won the race, which is harmless).
+ */
+static void run_accept_loop(int listen_fd, int ipc_socket, local_queue_t *local_q)
+{
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        return;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    if (config.accept_mode == ACCEPT_MODE_SHARED) {
+        ev.events |= EPOLLEXCLUSIVE;
+    }
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("epoll_ctl listen");
+        close(epfd);
+        return;
+    }
+
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = ipc_socket;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, ipc_socket, &ev) < 0) {
+        perror("epoll_ctl ipc");
+        close(epfd);
+        return;
+    }
+
+    /* Connection IDs stay unique server-wide: the acceptor (worker index + 1)
+     * goes in the top bits, the Master uses 0.
+     */
+    unsigned long conn_id_base = 0;
+    if (local_load) conn_id_base = (unsigned long)(local_load - worker_loads + 1) << 48;
+    unsigned long conn_seq = 0;
+
+    int running = 1;
+    while (running) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epfd, events, 2, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == ipc_socket) {
+                /* Master closed its end — begin shutdown sequence */
+                running = 0;
+                continue;
+            }
+
+            /* Drain the accept backlog */
+            while (1) {
+                conn_info_t conn;
+                socklen_t peer_len = sizeof(conn.peer);
+                conn.fd = accept4(listen_fd, (struct sockaddr *)&conn.peer, &peer_len, SOCK_CLOEXEC);
+                if (conn.fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+                    break;
+                }
+                clock_gettime(CLOCK_MONOTONIC, &conn.accepted_at);
+                conn.conn_id = conn_id_base | ++conn_seq;
+                dispatch_to_pool(local_q, &conn);
+            }
+        }
+    }
+
+    close(epfd);
+}
+
+/*
+ * Run Event Loops (WORKER_ENGINE=epoll)
+ * Purpose: Starts THREADS_PER_WORKER event loop threads and waits for the
+ * Master to close the IPC channel, then stops them.
+ *
+ * Parameters:
+ * - ipc_socket: Channel to the Master (connection source in master mode).
+ * - listen_fd: Worker listener in reuseport/shared modes, -1 otherwise.
+ *
+ * Logic:
+ * - The IPC socket is made non-blocking so loops that lose the race for a
+ *   message see EAGAIN instead of stalling.
+ * - The main thread only waits for POLLRDHUP, so it never consumes a
+ *   message meant for a loop; an eventfd then wakes every loop to stop.
+ */
+static void run_event_loops(int ipc_socket, int listen_fd)
+{
+    event_loop_args_t args;
+    args.source_is_listener = (listen_fd >= 0);
+    args.source_fd = args.source_is_listener ? listen_fd : ipc_socket;
+    args.stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (args.stop_fd < 0) {
+        perror("eventfd");
+        return;
+    }
+
+    if (!args.source_is_listener) {
+        fcntl(ipc_socket, F_SETFL, fcntl(ipc_socket, F_GETFL) | O_NONBLOCK);
+    }
+
+    int count = config.threads_per_worker > 0 ? config.threads_per_worker : 1;
+    pthread_t *loops = malloc(sizeof(pthread_t) * count);
+    int created = 0;
+    for (int i = 0; loops && i < count; i++) {
+        if (pthread_create(&loops[i], NULL, event_loop_thread, &args) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        created++;
+    }
+
+    struct pollfd pfd = { .fd = ipc_socket, .events = POLLRDHUP };
+    while (created > 0 && poll(&pfd, 1, -1) < 0 && errno == EINTR);
+
+    uint64_t one = 1;
+    if (write(args.stop_fd, &one, sizeof(one)) < 0) {
+        perror("eventfd write");
+    }
+    for (int i = 0; i < created; i++) {
+        pthread_join(loops[i], NULL);
+    }
+
+    free(loops);
+    close(args.stop_fd);
+}
+
 /*
  * Start Worker Process
  * Purpose: This is the main entry point for a Worker process. It initializes 
  * process-local resources (cache, thread pool, logger thread) and enters 
- * a loop to receive client connections from the Master process.
+ * a loop to receive client connections from the Master process, or to
+ * accept them itself when a listening socket is provided.
  *
  * Parameters:
  * - ipc_socket: The UNIX domain socket used to receive File Descriptors 
- * from the Master process.
+ * from the Master process (EOF on it signals shutdown).
+ * - listen_fd: Listening socket for reuseport/shared accept modes, or -1
+ * in master-dispatch mode.
  */
-void start_worker_process(int ipc_socket)
+void start_worker_process(int ipc_socket, int listen_fd)
 {
     printf("Worker (PID: %d) started\n", getpid());
 
     /* Initialize time zone information for logging */
     tzset();
-    
-    /* * Initialize shared queue structures. 
-     * Note: In this architecture, this primarily sets up the shared log_mutex 
-     * needed for thread-safe logging across processes.
+
+    /* sendfile() has no MSG_NOSIGNAL: a client hanging up mid-transfer must
+     * fail the call with EPIPE rather than kill the worker.
      */
+    signal(SIGPIPE, SIG_IGN);
+    
+    /* * Initialize shared queue structures. */
     init_shared_queue(config.max_queue_size);
 
-    /* * Start the Logger Flush Thread
-     * This background thread ensures logs are written to disk periodically 
-     * even if the buffer isn't full.
+    /* * Start the Log Writer Thread
+     * Request threads format into their own lock-free rings; this thread
+     * drains them in batches and is the only one doing log file I/O.
      */
+    init_logger();
     pthread_t flush_tid;
-    if (pthread_create(&flush_tid, NULL, logger_flush_thread, (void *)&queue->log_mutex) != 0) {
+    if (pthread_create(&flush_tid, NULL, logger_flush_thread, NULL) != 0) {
         perror("Failed to create logger flush thread");
     }
 
@@ -58,18 +229,45 @@ void start_worker_process(int ipc_socket)
     }
     
     /* * Initialize File Cache
-     * Sets up the in-memory LRU cache with the size defined in server.conf.
+     * Sets up the in-memory file cache (CLOCK replacement) with the size defined in server.conf.
+     * With CACHE_SHARED the Master already created one shared cache before
+     * forking, and this is a no-op.
      */
     size_t cache_bytes = (size_t)config.cache_size_mb * 1024 * 1024;
     if (cache_init(cache_bytes) != 0) {
         perror("cache_init");
     }
 
+    /* Path -> file metadata cache (stat results, 404s) */
+    if (meta_cache_init(config.meta_cache_entries, config.meta_cache_ttl, config.meta_negative_ttl) != 0) {
+        perror("meta_cache_init");
+    }
+
+    /* Descriptors of large files kept open between requests */
+    fd_cache_init(config.open_file_cache_size > 0 ? config.open_file_cache_size : 0,
+                  config.open_file_cache_ttl);
+
+    /* * Start the Cache Watcher
+     * Drops entries (content and metadata) for files changed under the
+     * document root (inotify).
+     * With CACHE_SHARED every worker watches too; dropping an entry twice
+     * is harmless.
+     */
+    int watching = (config.cache_watch &&
+                    (cache_bytes > 0 || config.meta_cache_entries > 0 || config.open_file_cache_size > 0) &&
+                    watcher_start(config.document_root) == 0);
+    cache_preload_recheck(); /* Preloaded files changed before the watcher ran */
+
     /* * Create Thread Pool
      * Spawns a fixed number of threads (consumer) that will block waiting 
-     * for work on the local_q.
+     * for work on the local_q, or — in direct receive mode — directly in
+     * recvmsg() on the IPC socket, skipping the main-thread handoff.
      */
-    int thread_count = config.threads_per_worker > 0 ? config.threads_per_worker : 0;
+    int evented = (config.worker_engine == ENGINE_EPOLL);
+    int direct = (!evented && listen_fd < 0 && config.worker_recv_mode == RECV_MODE_DIRECT);
+    direct_pool_t direct_pool = { .queue = &local_q, .ipc_socket = ipc_socket };
+
+    int thread_count = (!evented && config.threads_per_worker > 0) ? config.threads_per_worker : 0;
     pthread_t *threads = NULL;
     if (thread_count > 0) {
         threads = malloc(sizeof(pthread_t) * thread_count);
@@ -81,7 +279,10 @@ void start_worker_process(int ipc_socket)
 
     int created = 0;
     for (int i = 0; i < thread_count; i++) {
-        if (pthread_create(&threads[i], NULL, worker_thread, &local_q) != 0) {
+        int rc = direct
+            ? pthread_create(&threads[i], NULL, worker_thread_direct, &direct_pool)
+            : pthread_create(&threads[i], NULL, worker_thread, &local_q);
+        if (rc != 0) {
             perror("pthread_create");
             break;
         }
@@ -89,29 +290,39 @@ void start_worker_process(int ipc_socket)
     }
 
     /* * Main Loop: Receive and Dispatch
-     * 1. Block waiting for a File Descriptor from Master (IPC).
-     * 2. Enqueue the FD into the local thread pool queue.
+     * - Event-driven engine: the event loop threads take connections straight
+     *   from the source; the pool above is not used.
+     * - Accept modes: accept directly on the listener.
+     * - Direct receive mode: pool threads receive on their own; just wait
+     *   for the Master to close the channel.
+     * - Master-dispatch mode:
+     *   1. Block waiting for a batch of connections from Master (IPC).
+     *   2. Enqueue each one into the local thread pool queue.
      */
-    while (1)
+    if (evented) {
+        run_event_loops(ipc_socket, listen_fd);
+        if (listen_fd >= 0) close(listen_fd);
+    } else if (listen_fd >= 0) {
+        run_accept_loop(listen_fd, ipc_socket, &local_q);
+        close(listen_fd);
+    } else if (direct) {
+        /* POLLRDHUP only: never steal a message from the pool threads */
+        struct pollfd pfd = { .fd = ipc_socket, .events = POLLRDHUP };
+        while (poll(&pfd, 1, -1) < 0 && errno == EINTR);
+    }
+
+    while (listen_fd < 0 && !direct && !evented)
     {
-        int client_fd = recv_fd(ipc_socket);
-        if (client_fd < 0) {
+        conn_info_t conns[IPC_MAX_FDS];
+        int count = recv_conns(ipc_socket, conns, IPC_MAX_FDS);
+        if (count < 0) {
             /* IPC socket closed or error — begin shutdown sequence */
             break;
         }
+        if (local_load) __atomic_fetch_sub(&local_load->pending, count, __ATOMIC_RELAXED);
 
-        /* * Dispatch to Thread Pool
-         * Try to add the client FD to the local queue. If the queue is full,
-         * we reject the request immediately with 503 to prevent overload.
-         */
-        if (local_queue_enqueue(&local_q, client_fd) != 0) {
-            fprintf(stderr, "[Worker %d] Queue full! Rejecting client.\n", getpid());
-            
-            const char *error_body = "<h1>503 Service Unavailable</h1>Server too busy.\n";
-            send_http_response(client_fd, 503, "Service Unavailable", 
-                               "text/html", error_body, strlen(error_body));
-
-            close(client_fd);
+        for (int i = 0; i < count; i++) {
+            dispatch_to_pool(&local_q, &conns[i]);
         }
     }
 
@@ -125,19 +336,22 @@ void start_worker_process(int ipc_socket)
     pthread_cond_broadcast(&local_q.cond);
     pthread_mutex_unlock(&local_q.mutex);
 
-    /* 2. Stop Logger Thread */
-    logger_request_shutdown();
-    pthread_join(flush_tid, NULL);
-
-    /* 3. Join Worker Threads */
+    /* 2. Join Worker Threads */
     for (int i = 0; i < created; i++) {
         pthread_join(threads[i], NULL);
     }
 
+    /* 3. Stop Logger Thread (after a last drain of every ring) */
+    logger_request_shutdown();
+    pthread_join(flush_tid, NULL);
+
     /* 4. Cleanup Resources */
+    if (watching) watcher_stop();
     if (threads) free(threads);
     local_queue_destroy(&local_q);
     cache_destroy();
+    meta_cache_destroy();
+    fd_cache_destroy();
     
     close(ipc_socket);
 }
\ No newline at end of file
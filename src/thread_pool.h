@@ -1,6 +1,6 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
-void start_worker_process(int ipc_socket);
+void start_worker_process(int ipc_socket, int listen_fd);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include "watcher.h"
+#include "cache.h"
+#include "meta_cache.h"
+#include "fd_cache.h"
+
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                      IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR)
+
+/* * Watcher State
+ * inotify watches single directories, so every directory under the document
+ * root gets its own watch; 'dirs' maps each watch descriptor back to the
+ * directory path, which prefixes the names reported in events. Paths are
+ * built exactly like cache keys (root + "/" + relative path).
+ *
+ * Only the watcher thread touches the table after watcher_start().
+ */
+typedef struct {
+    int wd;
+    char *path;
+} watch_dir_t;
+
+static struct {
+    int fd;               /* inotify instance */
+    int stop_fd;          /* eventfd written by watcher_stop() */
+    pthread_t tid;
+    int running;
+    watch_dir_t *dirs;
+    int count, cap;
+    char root[PATH_MAX];
+} watcher = { .fd = -1, .stop_fd = -1 };
+
+static watch_dir_t *find_dir(int wd)
+{
+    for (int i = 0; i < watcher.count; i++) {
+        if (watcher.dirs[i].wd == wd) return &watcher.dirs[i];
+    }
+    return NULL;
+}
+
+/*
+ * Watch Directory Tree
+ * Purpose: Adds a watch on 'path' and, recursively, on every directory
+ * below it. A directory that is already watched (same inode, e.g. after a
+ * rename) keeps its descriptor and just gets its new path.
+ *
+ * Logic:
+ * - Symbolic links are not followed (d_type / IN_DONT_FOLLOW), so a link
+ *   cycle cannot recurse forever.
+ * - Running out of watches (ENOSPC, fs.inotify.max_user_watches) is
+ *   reported once per directory; files below it are then only refreshed
+ *   by eviction, as without CACHE_WATCH.
+ */
+static void watch_tree(const char *path)
+{
+    int follow = (path == watcher.root); /* The root itself may be a link */
+    int wd = inotify_add_watch(watcher.fd, path[0] ? path : "/",
+                               WATCH_EVENTS | (follow ? 0 : IN_DONT_FOLLOW));
+    if (wd < 0) {
+        if (errno != ENOENT && errno != ENOTDIR)
+            fprintf(stderr, "inotify_add_watch %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    watch_dir_t *d = find_dir(wd);
+    if (!d) {
+        if (watcher.count == watcher.cap) {
+            int cap = watcher.cap ? watcher.cap * 2 : 64;
+            watch_dir_t *dirs = realloc(watcher.dirs, cap * sizeof(*dirs));
+            if (!dirs) {
+                inotify_rm_watch(watcher.fd, wd);
+                return;
+            }
+            watcher.dirs = dirs;
+            watcher.cap = cap;
+        }
+        d = &watcher.dirs[watcher.count++];
+        d->wd = wd;
+        d->path = NULL;
+    }
+    char *copy = strdup(path);
+    if (!copy) return;
+    free(d->path);
+    d->path = copy;
+
+    DIR *dir = opendir(path[0] ? path : "/");
+    if (!dir) return;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if (e->d_type != DT_DIR && e->d_type != DT_UNKNOWN)
+            continue;
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        char child[PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, e->d_name) < (int)sizeof(child))
+            watch_tree(child);
+    }
+    closedir(dir);
+}
+
+/*
+ * Forget Directory Tree
+ * Purpose: Drops the watches on 'path' and below after the directory was
+ * moved away. If it was moved within the root, IN_MOVED_TO watches it again
+ * under the new name.
+ */
+static void unwatch_tree(const char *path)
+{
+    size_t len = strlen(path);
+    for (int i = 0; i < watcher.count; ) {
+        const char *p = watcher.dirs[i].path;
+        if (strncmp(p, path, len) == 0 && (p[len] == '\0' || p[len] == '/')) {
+            inotify_rm_watch(watcher.fd, watcher.dirs[i].wd);
+            free(watcher.dirs[i].path);
+            watcher.dirs[i] = watcher.dirs[--watcher.count];
+        } else {
+            i++;
+        }
+    }
+}
+
+/* A watch went away (directory deleted, or removed above) */
+static void drop_watch(int wd)
+{
+    watch_dir_t *d = find_dir(wd);
+    if (!d) return;
+    free(d->path);
+    *d = watcher.dirs[--watcher.count];
+}
+
+/* Drops what the content, metadata and open file caches know about 'path' */
+static void invalidate(const char *path, int subtree)
+{
+    cache_invalidate(path, subtree);
+    meta_cache_invalidate(path, subtree);
+    fd_cache_invalidate(path, subtree);
+}
+
+/*
+ * Handle One Event
+ * Purpose: Maps an inotify event to cache invalidations (content and
+ * metadata: a created file also ends a cached 404).
+ *
+ * Logic:
+ * - A file that was written, replaced, renamed or deleted: its entry.
+ * - A directory deleted or moved away: every entry below it (and its
+ *   watches). A directory created or moved in: watched, and any stale
+ *   entries under its path are dropped.
+ * - Queue overflow: events were lost, so the whole cache under the root
+ *   is dropped.
+ */
+static void handle_event(const struct inotify_event *ev)
+{
+    if (ev->mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, "inotify queue overflow, invalidating cache\n");
+        invalidate(watcher.root, 1);
+        return;
+    }
+    if (ev->mask & IN_IGNORED) {
+        drop_watch(ev->wd);
+        return;
+    }
+
+    watch_dir_t *d = find_dir(ev->wd);
+    if (!d || ev->len == 0) return; /* Events on the directory itself */
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", d->path, ev->name) >= (int)sizeof(path))
+        return;
+
+    if (ev->mask & IN_ISDIR) {
+        if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            invalidate(path, 1);
+            if (ev->mask & IN_MOVED_FROM) unwatch_tree(path);
+        } else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            invalidate(path, 1);
+            watch_tree(path);
+        }
+        return;
+    }
+    invalidate(path, 0);
+}
+
+/*
+ * Watcher Thread
+ * Purpose: Reads inotify events until watcher_stop() signals the eventfd.
+ */
+static void *watcher_thread(void *arg)
+{
+    (void)arg;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfds[2] = {
+        { .fd = watcher.fd, .events = POLLIN },
+        { .fd = watcher.stop_fd, .events = POLLIN },
+    };
+
+    while (1) {
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll inotify");
+            break;
+        }
+        if (pfds[1].revents)
+            break;
+
+        ssize_t n = read(watcher.fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("read inotify");
+            break;
+        }
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Start Cache Watcher
+ * Purpose: Watches the document root recursively and drops cache entries
+ * for files that change on disk, so deployed content is served without
+ * restarting workers and without re-validating entries on every hit.
+ *
+ * Parameters:
+ * - root: The document root, as used to build cache keys.
+ *
+ * Return:
+ * - 0 on success.
+ * - -1 if inotify is unavailable (the cache then works as before).
+ */
+int watcher_start(const char *root)
+{
+    snprintf(watcher.root, sizeof(watcher.root), "%s", root);
+    size_t len = strlen(watcher.root);
+    while (len > 0 && watcher.root[len - 1] == '/')
+        watcher.root[--len] = '\0';
+
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+    watcher.stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (watcher.stop_fd < 0) {
+        perror("eventfd");
+        close(watcher.fd);
+        watcher.fd = -1;
+        return -1;
+    }
+
+    watch_tree(watcher.root);
+
+    if (pthread_create(&watcher.tid, NULL, watcher_thread, NULL) != 0) {
+        perror("Failed to create cache watcher thread");
+        watcher_stop();
+        return -1;
+    }
+    watcher.running = 1;
+    return 0;
+}
+
+/*
+ * Stop Cache Watcher
+ * Purpose: Stops the thread and releases the inotify instance and table.
+ */
+void watcher_stop(void)
+{
+    if (watcher.running) {
+        uint64_t one = 1;
+        if (write(watcher.stop_fd, &one, sizeof(one)) < 0) {
+            perror("eventfd write");
+        }
+        pthread_join(watcher.tid, NULL);
+        watcher.running = 0;
+    }
+
+    for (int i = 0; i < watcher.count; i++) {
+        free(watcher.dirs[i].path);
+    }
+    free(watcher.dirs);
+    watcher.dirs = NULL;
+    watcher.count = watcher.cap = 0;
+
+    if (watcher.fd >= 0) close(watcher.fd);
+    if (watcher.stop_fd >= 0) close(watcher.stop_fd);
+    watcher.fd = watcher.stop_fd = -1;
+}
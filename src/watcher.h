@@ -0,0 +1,7 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+int watcher_start(const char *root);
+void watcher_stop(void);
+
+#endif
@@ -10,6 +10,8 @@
 #include <sys/stat.h>
 #include <pthread.h>
 #include <time.h> 
+#include <poll.h>
+#include <errno.h>
 
 #include "http.h"
 #include "config.h"
@@ -18,20 +20,12 @@
 #include "logger.h"
 #include "worker.h"
 #include "cache.h"
+#include "connection.h"
 
 /* Access global config and shared structures */
 extern server_config_t config;
 extern connection_queue_t *queue;
 
-/*
- * Helper: Calculate Time Difference in Milliseconds
- * Purpose: Computes the elapsed time between two timespec structs.
- * Used for tracking request latency.
- */
-long get_time_diff_ms(struct timespec start, struct timespec end) {
-    return (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
-}
-
 /*
  * Helper: Get Client IP Address
  * Purpose: Extracts the client's IP address string from the socket file descriptor.
@@ -51,256 +45,101 @@ void get_client_ip(int client_fd, char *ip_buffer, size_t buffer_len) {
  * Helper: Determine MIME Type
  * Purpose: Returns the correct Content-Type header based on the file extension.
  * Defaults to "application/octet-stream" for unknown types.
+ * Logic: One pass over a small table, comparing the extension length before
+ * its bytes. Only cache misses and uncached files get here: hits reuse the
+ * header stored with the cache entry.
  */
+static const struct {
+    const char *ext;
+    size_t ext_len;
+    const char *type;
+} mime_types[] = {
+    { ".html", 5, "text/html" },
+    { ".css", 4, "text/css" },
+    { ".js", 3, "application/javascript" },
+    { ".png", 4, "image/png" },
+    { ".jpg", 4, "image/jpeg" },
+    { ".jpeg", 5, "image/jpeg" },
+};
+
 const char *get_mime_type(const char *path)
 {
     const char *ext = strrchr(path, '.');
     if (!ext)
         return "application/octet-stream";
-    if (strcmp(ext, ".html") == 0)
-        return "text/html";
-    if (strcmp(ext, ".css") == 0)
-        return "text/css";
-    if (strcmp(ext, ".js") == 0)
-        return "application/javascript";
-    if (strcmp(ext, ".png") == 0)
-        return "image/png";
-    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0)
-        return "image/jpeg";
+    size_t len = strlen(ext);
+    for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
+        if (mime_types[i].ext_len == len && memcmp(ext, mime_types[i].ext, len) == 0)
+            return mime_types[i].type;
+    }
     return "application/octet-stream";
 }
 
+/* Slice of an idle keep-alive wait between checks for waiting connections */
+#define IDLE_POLL_SLICE_MS 100
+
 /*
- * Handle Client Request (Core Logic)
- * Purpose: Processes a single HTTP request from start to finish.
+ * Wait For Next Request
+ * Purpose: Blocks until a kept-alive connection becomes readable again.
  *
- * Workflow:
- * 1. Updates "Active Connections" stat.
- * 2. Reads and parses the HTTP request.
- * 3. Validates method (GET/HEAD only) and security (no ".." paths).
- * 4. Resolves the physical file path (handling index.html).
- * 5. Checks the In-Memory Cache (for small files).
- * 6. If not cached, reads from disk and populates the cache.
- * 7. Sends the HTTP response.
- * 8. Updates final stats and logs the request.
+ * Return:
+ * - 1 if the client sent data (or hung up, which the read will see).
+ * - 0 on idle timeout, or when other connections are waiting for this worker.
  *
- * Synchronization:
- * - Uses shared memory semaphores to atomic updates to global stats.
- * - Uses cache_get/cache_put which handle their own Read-Write locks.
+ * Logic: Polls in IDLE_POLL_SLICE_MS slices up to KEEPALIVE_TIMEOUT. After
+ * each slice it checks the worker's load: an idle client must not hold the
+ * pool thread while connections queued (or in transit from the Master)
+ * starve, so the connection is closed as soon as any are waiting.
  */
-void handle_client(int client_socket)
+static int wait_next_request(int fd)
 {
-    struct timespec start_time, end_time;
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-
-    /* 1. Increment Active Connections (Critical Section) */
-    sem_wait(&stats->mutex);
-    stats->active_connections++;
-    sem_post(&stats->mutex);
-
-    char client_ip[INET_ADDRSTRLEN];
-    get_client_ip(client_socket, client_ip, sizeof(client_ip));
-
-    /* Read Request */
-    char buffer[2048];
-    ssize_t bytes = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-
-    int status_code = 0;
-    long bytes_sent = 0;
-    http_request_t req = {0}; 
-
-    if (bytes <= 0)
-    {
-        /* Connection closed or error */
-        close(client_socket);
-        sem_wait(&stats->mutex);
-        stats->active_connections--;
-        sem_post(&stats->mutex);
-        return;
-    }
-    buffer[bytes] = '\0';
-
-    /* Parse HTTP Header */
-    if (parse_http_request(buffer, &req) != 0)
-    {
-        status_code = 400;
-        const char *body = "<h1>400 Bad Request</h1>";
-        size_t len = strlen(body);
-        send_http_response(client_socket, 400, "Bad Request", "text/html", body, len);
-        bytes_sent = len; 
-        close(client_socket);
-        goto update_stats_and_log; /* Jump to cleanup/logging */
-    }
-
-    /* Validate Method (Only GET and HEAD supported) */
-    int is_head = (strcmp(req.method, "HEAD") == 0);
-    if (strcmp(req.method, "GET") != 0 && strcmp(req.method, "HEAD") != 0)
-    {
-        status_code = 405;
-        const char *body = "<h1>405 Method Not Allowed</h1>";
-        size_t len = strlen(body);
-        send_http_response(client_socket, 405, "Method Not Allowed", "text/html", body, len);
-        bytes_sent = len;
-        close(client_socket);
-        goto update_stats_and_log;
-    }
-
-    /* Security: Prevent Directory Traversal */
-    if (strstr(req.path, ".."))
-    {
-        status_code = 403;
-        const char *body = "<h1>403 Forbidden</h1>";
-        size_t len = strlen(body);
-        send_http_response(client_socket, 403, "Forbidden", "text/html", body, len);
-        bytes_sent = len;
-        close(client_socket);
-        goto update_stats_and_log;
-    }
-
-    /* Resolve Path */
-    char full_path[1024];
-    snprintf(full_path, sizeof(full_path), "%s%s", config.document_root, req.path);
-
-    /* Directory Handling (Serve index.html) */
-    struct stat st;
-    if (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode))
-    {
-        strncat(full_path, "/index.html", sizeof(full_path) - strlen(full_path) - 1);
-    }
-
-    /* File Existence Check */
-    if (stat(full_path, &st) != 0) {
-        status_code = 404;
-        const char *body = "<h1>404 Not Found</h1>";
-        size_t len = strlen(body);
-        send_http_response(client_socket, 404, "Not Found", "text/html", body, len);
-        bytes_sent = len;
-        close(client_socket);
-        goto update_stats_and_log;
-    }
-
-    long fsize = st.st_size;
-    char *content = NULL;
-    size_t read_bytes = 0;
-
-    /* * CACHING LOGIC
-     * Only cache files smaller than 1MB to preserve memory.
-     */
-    if (fsize > 0 && fsize < (1 * 1024 * 1024)) {
-        /* Try to retrieve from cache first */
-        if (cache_get(full_path, &content, &read_bytes) == 0) {
-            /* HIT: 'content' is now a malloc'd copy from the cache */
-        } else {
-            /* MISS: Read from disk */
-            FILE *fp = fopen(full_path, "rb");
-            if (!fp) {
-                status_code = 404;
-                const char *body = "<h1>404 Not Found</h1>";
-                size_t len = strlen(body);
-                send_http_response(client_socket, 404, "Not Found", "text/html", body, len);
-                bytes_sent = len;
-                close(client_socket);
-                goto update_stats_and_log;
-            }
-            char *buf = malloc(fsize);
-            if (!buf) {
-                fclose(fp);
-                status_code = 500;
-                const char *body = "<h1>500 Internal Server Error</h1>";
-                size_t len = strlen(body);
-                send_http_response(client_socket, 500, "Internal Server Error", "text/html", body, len);
-                bytes_sent = len;
-                close(client_socket);
-                goto update_stats_and_log;
-            }
-            size_t rb = fread(buf, 1, fsize, fp);
-            fclose(fp);
-            
-            if (rb != (size_t)fsize) {
-                free(buf);
-                status_code = 500;
-                // ... send error ...
-                close(client_socket);
-                goto update_stats_and_log;
-            }
-            read_bytes = rb;
-            content = buf;
-
-            /* Update Cache (Best Effort) */
-            cache_put(full_path, content, read_bytes);
-        }
-    } else {
-        /* Large files: Direct Disk Read (No Caching) */
-        FILE *fp = fopen(full_path, "rb");
-        if (!fp) {
-            status_code = 404;
-            // ... send 404 ...
-            close(client_socket);
-            goto update_stats_and_log;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int remaining_ms = config.keepalive_timeout * 1000;
+
+    while (remaining_ms > 0) {
+        int slice = remaining_ms < IDLE_POLL_SLICE_MS ? remaining_ms : IDLE_POLL_SLICE_MS;
+        int ready = poll(&pfd, 1, slice);
+        if (ready > 0)
+            return 1;
+        if (ready < 0 && errno != EINTR)
+            return 0;
+        if (ready == 0) {
+            /* Only a client idle for a whole slice gives up the thread; one
+             * whose next request is already on its way must not be cut off */
+            remaining_ms -= slice;
+            if (local_load && worker_load_waiting(local_load) > 0)
+                return 0;
         }
-        char *buf = malloc(fsize);
-        if (!buf) {
-            fclose(fp);
-            status_code = 500;
-            // ... send 500 ...
-            close(client_socket);
-            goto update_stats_and_log;
-        }
-        size_t rb = fread(buf, 1, fsize, fp);
-        fclose(fp);
-        if (rb != (size_t)fsize) {
-            free(buf);
-            status_code = 500;
-            // ... send 500 ...
-            close(client_socket);
-            goto update_stats_and_log;
-        }
-        content = buf;
-        read_bytes = rb;
-    }
-
-    /* Send Response */
-    const char *mime = get_mime_type(full_path);
-    status_code = 200;
-    if (is_head)
-    {
-        send_http_response(client_socket, 200, "OK", mime, NULL, fsize);
-        bytes_sent = 0;
-    }
-    else
-    {
-        send_http_response(client_socket, 200, "OK", mime, content, fsize);
-        bytes_sent = fsize;
     }
+    return 0;
+}
 
-    free(content);
-    close(client_socket);
-
-/* * Cleanup Label: Updates stats and logs the request. 
- * Reached via goto from error handlers or normal completion.
+/*
+ * Handle Client Connection (Blocking Driver)
+ * Purpose: Serves one connection on the calling pool thread from start to
+ * finish by driving the connection state machine (see connection.c) over a
+ * blocking socket: each step simply waits until its I/O completes.
+ *
+ * Logic:
+ * - A kept-alive connection stays on this thread for its next request,
+ *   but only for KEEPALIVE_TIMEOUT seconds of idleness, and only while no
+ *   other connection is waiting for the worker; otherwise (or if the client
+ *   hangs up) it is closed.
  */
-update_stats_and_log:
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
-    long elapsed_ms = get_time_diff_ms(start_time, end_time);
-
-    /* Update Shared Stats (Critical Section) */
-    sem_wait(&stats->mutex);
-    stats->active_connections--;
-    stats->total_requests++;
-    stats->bytes_transferred += bytes_sent;
-    stats->average_response_time += elapsed_ms;
-
-    if (status_code == 200) stats->status_200++;
-    else if (status_code == 404) stats->status_404++;
-    else if (status_code == 500) stats->status_500++;
-    
-    sem_post(&stats->mutex);
+void handle_client(const conn_info_t *info)
+{
+    conn_t c;
+    conn_init(&c, info);
+    c.pooled = 1;
+
+    int next = CONN_WANT_READ;
+    while (next != CONN_CLOSE) {
+        if (next == CONN_WANT_READ && conn_is_idle(&c) && !wait_next_request(c.info.fd))
+            break;
+        next = (next == CONN_WANT_READ) ? conn_on_readable(&c) : conn_on_writable(&c);
+    }
 
-    /* Log Request (Apache Format) */
-    const char *log_method = (req.method[0] != '\0') ? req.method : "-";
-    const char *log_path = (req.path[0] != '\0') ? req.path : "-";
-    
-    log_request(&queue->log_mutex, client_ip, log_method, log_path, status_code, bytes_sent);
+    conn_close(&c);
 }
 
 /*
@@ -309,8 +148,8 @@ update_stats_and_log:
  */
 int local_queue_init(local_queue_t *q, int max_size)
 {
-    q->fds = malloc(sizeof(int) * max_size);
-    if (!q->fds) return -1;
+    q->items = malloc(sizeof(conn_info_t) * max_size);
+    if (!q->items) return -1;
     q->head = 0;
     q->tail = 0;
     q->max_size = max_size;
@@ -323,17 +162,17 @@ int local_queue_init(local_queue_t *q, int max_size)
 void local_queue_destroy(local_queue_t *q)
 {
     if (!q) return;
-    free(q->fds);
+    free(q->items);
     pthread_mutex_destroy(&q->mutex);
     pthread_cond_destroy(&q->cond);
 }
 
 /*
- * Enqueue (Producer: Worker Main Thread)
- * Purpose: Adds a client FD to the pool.
- * Return: -1 if full (Master will send 503).
+ * Enqueue Connection (Producer: Worker Main Thread)
+ * Purpose: Adds a client connection (FD plus acceptor metadata) to the pool.
+ * Return: -1 if full (caller sends 503).
  */
-int local_queue_enqueue(local_queue_t *q, int client_fd)
+int local_queue_enqueue_conn(local_queue_t *q, const conn_info_t *conn)
 {
     pthread_mutex_lock(&q->mutex);
     int next = (q->tail + 1) % q->max_size;
@@ -341,7 +180,7 @@ int local_queue_enqueue(local_queue_t *q, int client_fd)
         pthread_mutex_unlock(&q->mutex);
         return -1; /* Queue Full */
     }
-    q->fds[q->tail] = client_fd;
+    q->items[q->tail] = *conn;
     q->tail = next;
     /* Signal waiting threads that work is available */
     pthread_cond_signal(&q->cond);
@@ -350,11 +189,12 @@ int local_queue_enqueue(local_queue_t *q, int client_fd)
 }
 
 /*
- * Dequeue (Consumer: Worker Threads)
- * Purpose: Retrieves a FD to process.
+ * Dequeue Connection (Consumer: Worker Threads)
+ * Purpose: Retrieves a connection to process.
  * Logic: Blocks on condition variable if queue is empty.
+ * Return: 0 on success, -1 on shutdown.
  */
-int local_queue_dequeue(local_queue_t *q)
+int local_queue_dequeue_conn(local_queue_t *q, conn_info_t *out)
 {
     pthread_mutex_lock(&q->mutex);
     while (q->head == q->tail && !q->shutting_down) {
@@ -364,10 +204,85 @@ int local_queue_dequeue(local_queue_t *q)
         pthread_mutex_unlock(&q->mutex);
         return -1; /* Shutdown signal received */
     }
-    int fd = q->fds[q->head];
+    *out = q->items[q->head];
+    q->head = (q->head + 1) % q->max_size;
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/*
+ * Try Dequeue Connection (Non-blocking)
+ * Purpose: Retrieves a connection only if one is immediately available.
+ * Return: 0 on success, -1 if the queue is empty.
+ */
+int local_queue_try_dequeue_conn(local_queue_t *q, conn_info_t *out)
+{
+    pthread_mutex_lock(&q->mutex);
+    if (q->head == q->tail) {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    *out = q->items[q->head];
     q->head = (q->head + 1) % q->max_size;
     pthread_mutex_unlock(&q->mutex);
-    return fd;
+    return 0;
+}
+
+/*
+ * Dispatch Connection to Thread Pool
+ * Purpose: Adds a client connection to the local queue. If the queue is full,
+ * the request is rejected immediately with 503 to prevent overload.
+ */
+void dispatch_to_pool(local_queue_t *q, const conn_info_t *conn)
+{
+    if (local_queue_enqueue_conn(q, conn) == 0) {
+        if (local_load) __atomic_fetch_add(&local_load->queued, 1, __ATOMIC_RELAXED);
+    } else {
+        fprintf(stderr, "[Worker %d] Queue full! Rejecting client (conn %lu).\n",
+                getpid(), conn->conn_id);
+
+        http_send_canned(conn->fd, 503);
+
+        close(conn->fd);
+    }
+}
+
+/*
+ * Enqueue (FD only)
+ * Purpose: Adds a bare client FD with no acceptor metadata.
+ * Return: -1 if full.
+ */
+int local_queue_enqueue(local_queue_t *q, int client_fd)
+{
+    conn_info_t conn = {0};
+    conn.fd = client_fd;
+    return local_queue_enqueue_conn(q, &conn);
+}
+
+/*
+ * Dequeue (FD only)
+ * Purpose: Retrieves the FD of the next connection.
+ * Return: The FD, or -1 on shutdown.
+ */
+int local_queue_dequeue(local_queue_t *q)
+{
+    conn_info_t conn;
+    if (local_queue_dequeue_conn(q, &conn) != 0) return -1;
+    return conn.fd;
+}
+
+/*
+ * Serve Connection
+ * Purpose: Runs handle_client() while publishing the in-flight count for
+ * the Master's dispatcher.
+ */
+static void serve_connection(const conn_info_t *conn)
+{
+    if (local_load) __atomic_fetch_add(&local_load->in_flight, 1, __ATOMIC_RELAXED);
+
+    handle_client(conn);
+
+    if (local_load) __atomic_fetch_sub(&local_load->in_flight, 1, __ATOMIC_RELAXED);
 }
 
 /*
@@ -379,12 +294,54 @@ void *worker_thread(void *arg)
     local_queue_t *q = (local_queue_t *)arg;
     while (1)
     {
-        int client_socket = local_queue_dequeue(q);
-        if (client_socket < 0) {
+        conn_info_t conn;
+        if (local_queue_dequeue_conn(q, &conn) != 0) {
             break; /* shutdown signaled */
         }
 
-        handle_client(client_socket);
+        if (local_load) __atomic_fetch_sub(&local_load->queued, 1, __ATOMIC_RELAXED);
+        serve_connection(&conn);
     }
     return NULL;
-}
\ No newline at end of file
+}
+
+/*
+ * Direct Worker Thread Entry Point
+ * Purpose: Receives connections straight from the Master's IPC socket, so a
+ * request reaches the thread that serves it without a mutex/condvar handoff
+ * through the main thread. Every pool thread blocks in recvmsg() on the same
+ * SOCK_SEQPACKET socket and the kernel hands each message to one of them.
+ *
+ * Logic:
+ * - The Master sends one connection per message in this mode. If a message
+ *   still carries several, the extras go to the local queue (503 if full)
+ *   and are drained by this thread before it blocks again.
+ * - EOF on the IPC socket (Master closed it) ends the thread.
+ */
+void *worker_thread_direct(void *arg)
+{
+    direct_pool_t *pool = (direct_pool_t *)arg;
+    while (1)
+    {
+        conn_info_t conn;
+        if (local_queue_try_dequeue_conn(pool->queue, &conn) == 0) {
+            if (local_load) __atomic_fetch_sub(&local_load->queued, 1, __ATOMIC_RELAXED);
+            serve_connection(&conn);
+            continue;
+        }
+
+        conn_info_t conns[IPC_MAX_FDS];
+        int count = recv_conns(pool->ipc_socket, conns, IPC_MAX_FDS);
+        if (count < 0) {
+            break; /* Master closed the channel: shutdown */
+        }
+        if (count == 0) continue;
+        if (local_load) __atomic_fetch_sub(&local_load->pending, count, __ATOMIC_RELAXED);
+
+        for (int i = 1; i < count; i++) {
+            dispatch_to_pool(pool->queue, &conns[i]);
+        }
+        serve_connection(&conns[0]);
+    }
+    return NULL;
+}
@@ -2,19 +2,19 @@
 #define WORKER_H
 
 #include <stddef.h>
-#include <time.h>
 #include <pthread.h>
+#include "ipc.h"
 
-long get_time_diff_ms(struct timespec start, struct timespec end);
 void get_client_ip(int client_fd, char *ip_buffer, size_t buffer_len);
 const char *get_mime_type(const char *path);
-void handle_client(int client_socket);
+void handle_client(const conn_info_t *conn);
 
 struct local_queue;
 void *worker_thread(void *arg);
+void *worker_thread_direct(void *arg);
 
 typedef struct local_queue {
-    int *fds;
+    conn_info_t *items;
     int head;
     int tail;
     int max_size;
@@ -27,5 +27,15 @@ int local_queue_init(local_queue_t *q, int max_size);
 void local_queue_destroy(local_queue_t *q);
 int local_queue_enqueue(local_queue_t *q, int client_fd);
 int local_queue_dequeue(local_queue_t *q);
+int local_queue_enqueue_conn(local_queue_t *q, const conn_info_t *conn);
+int local_queue_dequeue_conn(local_queue_t *q, conn_info_t *out);
+int local_queue_try_dequeue_conn(local_queue_t *q, conn_info_t *out);
+void dispatch_to_pool(local_queue_t *q, const conn_info_t *conn);
+
+/* Arguments for pool threads in direct receive mode */
+typedef struct {
+    local_queue_t *queue; /* Overflow when a message carries several connections */
+    int ipc_socket;       /* Socketpair end shared by all pool threads */
+} direct_pool_t;
 
 #endif
\ No newline at end of file
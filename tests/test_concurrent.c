@@ -6,10 +6,23 @@
 #include <unistd.h>
 #include <time.h>
 #include <stdint.h>    
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <zlib.h>
 
 #include "../src/worker.h"
 #include "../src/cache.h"
 #include "../src/config.h"
+#include "../src/ipc.h"
+#include "../src/http.h"
+#include "../src/meta_cache.h"
+#include "../src/fd_cache.h"
+#include "../src/stats.h"
+#include "../src/shared_mem.h"
+#include "../src/logger.h"
 
 server_config_t config;
 
@@ -292,15 +305,15 @@ void test_cache_eviction(void)
     }
 
 
-    /* Access /k/1 to make it MRU (Most Recently Used) */
+    /* Access /k/1 again: its CLOCK bit is set */
     if (cache_get("/k/1", &out, &len) != 0) {
         fail("test_cache_eviction - missing /k/1 (2)"); 
         free(out);
     }
 
-    /* Cache state (MRU -> LRU): 1, 5, 4, 3, 2 */
+    /* Ring from the hand: 1 (set), 2, 3, 4, 5 (set) */
     
-    /* Add new item (forces eviction of LRU: /k/2) */
+    /* Add new item (hand spares /k/1, clearing its bit, and evicts /k/2) */
     cache_put("/k/6", val, 20);
 
     /* Verify /k/2 is gone */
@@ -309,7 +322,7 @@ void test_cache_eviction(void)
         fail("test_cache_eviction - /k/2 should be evicted"); 
     }
     
-    /* Verify /k/1 (MRU) and /k/6 (New) are present */
+    /* Verify /k/1 (second chance) and /k/6 (New) are present */
     if (cache_get("/k/1", &out, &len) != 0) {
         fail("test_cache_eviction - /k/1 evicted incorrectly"); 
         free(out);
@@ -361,10 +374,1005 @@ void test_queue_shutdown(void)
     pass("test_queue_shutdown");
 }
 
+/* -------------------------
+   Test 8: Batched connection passing
+   ------------------------- */
+void test_ipc_conn_batch(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0) fail("test_ipc_conn_batch - socketpair");
+
+    /* Three pipes give us six distinct descriptors to pass */
+    int pipes[6];
+    for (int i = 0; i < 3; ++i) {
+        if (pipe(&pipes[i * 2]) != 0) fail("test_ipc_conn_batch - pipe");
+    }
+
+    conn_info_t sent[6];
+    memset(sent, 0, sizeof(sent));
+    for (int i = 0; i < 6; ++i) {
+        sent[i].fd = pipes[i];
+        sent[i].peer.sin_family = AF_INET;
+        sent[i].peer.sin_port = (unsigned short)(1000 + i);
+        sent[i].accepted_at.tv_sec = 100 + i;
+        sent[i].conn_id = 42 + i;
+    }
+
+    if (send_conns(sv[0], sent, 6, 6) != 6) fail("test_ipc_conn_batch - send");
+
+    conn_info_t got[IPC_MAX_FDS];
+    int n = recv_conns(sv[1], got, IPC_MAX_FDS);
+    if (n != 6) fail("test_ipc_conn_batch - count");
+
+    /* Received FDs must refer to the same open files, with their metadata, in order */
+    for (int i = 0; i < 6; ++i) {
+        struct stat a, b;
+        if (fstat(sent[i].fd, &a) != 0 || fstat(got[i].fd, &b) != 0) fail("test_ipc_conn_batch - fstat");
+        if (a.st_ino != b.st_ino) fail("test_ipc_conn_batch - fd mismatch");
+        if (got[i].conn_id != sent[i].conn_id ||
+            got[i].peer.sin_port != sent[i].peer.sin_port ||
+            got[i].accepted_at.tv_sec != sent[i].accepted_at.tv_sec)
+            fail("test_ipc_conn_batch - metadata mismatch");
+        close(sent[i].fd);
+        close(got[i].fd);
+    }
+
+    /* Closing the sender end is reported as EOF */
+    close(sv[0]);
+    if (recv_conns(sv[1], got, IPC_MAX_FDS) != -1) fail("test_ipc_conn_batch - eof");
+    close(sv[1]);
+    pass("test_ipc_conn_batch");
+}
+
+/* -------------------------
+   Test 9: Incremental request parser
+   ------------------------- */
+static int slice_eq(http_slice_t s, const char *str)
+{
+    return s.ptr && s.len == strlen(str) && memcmp(s.ptr, str, s.len) == 0;
+}
+
+void test_http_parser(void)
+{
+    const char *req1 =
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "User-Agent: test\r\n"
+        "Accept-Encoding: br, GZIP;q=0.8\r\n"
+        "range:   bytes=0-99  \r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    const char *req2 = "HEAD /style.css HTTP/1.0\r\n\r\n";
+
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s%s", req1, req2);
+    size_t len1 = strlen(req1), total = strlen(buf);
+
+    /* Fed one byte at a time, it completes exactly at the blank line */
+    http_parser_t parser;
+    http_request_t req;
+    http_parser_reset(&parser);
+    for (size_t n = 1; n < len1; ++n) {
+        if (http_parse_request(&parser, buf, n, &req) != HTTP_PARSE_INCOMPLETE)
+            fail("test_http_parser - early completion");
+    }
+    if (http_parse_request(&parser, buf, total, &req) != (int)len1) fail("test_http_parser - length");
+
+    if (strcmp(req.method, "GET") != 0 || strcmp(req.path, "/index.html") != 0 ||
+        strcmp(req.version, "HTTP/1.1") != 0)
+        fail("test_http_parser - request line");
+    if (req.header_count != 5) fail("test_http_parser - header count");
+    if (!slice_eq(req.host, "example.com") || !slice_eq(req.range, "bytes=0-99"))
+        fail("test_http_parser - header slices");
+    if (!http_slice_has_token(req.accept_encoding, "gzip") ||
+        http_slice_has_token(req.accept_encoding, "deflate"))
+        fail("test_http_parser - tokens");
+    if (!http_accepts_encoding(req.accept_encoding, "gzip")) fail("test_http_parser - accepts gzip");
+    if (req.if_none_match.ptr != NULL) fail("test_http_parser - absent header");
+    if (!http_wants_keep_alive(&req)) fail("test_http_parser - keep-alive");
+
+    /* The pipelined request follows directly */
+    http_parser_reset(&parser);
+    if (http_parse_request(&parser, buf + len1, total - len1, &req) != (int)(total - len1))
+        fail("test_http_parser - pipelined");
+    if (strcmp(req.method, "HEAD") != 0 || http_wants_keep_alive(&req))
+        fail("test_http_parser - pipelined fields");
+
+    /* Known headers are found past HTTP_MAX_HEADERS */
+    size_t off = (size_t)snprintf(buf, sizeof(buf), "GET / HTTP/1.1\r\n");
+    for (int i = 0; i < HTTP_MAX_HEADERS + 4; ++i)
+        off += (size_t)snprintf(buf + off, sizeof(buf) - off, "X-%d: v\r\n", i);
+    off += (size_t)snprintf(buf + off, sizeof(buf) - off, "Host: late\r\n\r\n");
+    http_parser_reset(&parser);
+    if (http_parse_request(&parser, buf, off, &req) != (int)off) fail("test_http_parser - many headers");
+    if (req.header_count != HTTP_MAX_HEADERS || !slice_eq(req.host, "late"))
+        fail("test_http_parser - many headers fields");
+
+    /* Request bodies: the bytes after the header block are not a request */
+    struct { const char *hdr; int body; } bodies[] = {
+        { "", 0 }, { "Content-Length: 0\r\n", 0 }, { "Content-Length: 00\r\n", 0 },
+        { "Content-Length: 33\r\n", 1 }, { "content-length: x\r\n", 1 },
+        { "Transfer-Encoding: chunked\r\n", 1 }, { "TRANSFER-ENCODING: identity\r\n", 1 },
+        { "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n", 0 },
+    };
+    for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); ++i) {
+        off = (size_t)snprintf(buf, sizeof(buf), "POST / HTTP/1.1\r\n%s\r\n", bodies[i].hdr);
+        http_parser_reset(&parser);
+        if (http_parse_request(&parser, buf, off, &req) != (int)off || http_has_body(&req) != bodies[i].body)
+            fail("test_http_parser - request body");
+    }
+    if (!req.if_modified_since.ptr || req.transfer_encoding.ptr) fail("test_http_parser - length 17 names");
+
+    /* Accept-Encoding negotiation: q=0 refuses, "*" covers unlisted codings */
+    struct { const char *value; int gzip; } ae[] = {
+        { "gzip;q=0", 0 }, { "gzip; q=0.000, br", 0 }, { "GZIP;Q=0.001", 1 }, { "x-gzip", 1 },
+        { "*", 1 }, { "*;q=0", 0 }, { "gzip;q=0, *", 0 }, { "deflate, br", 0 }, { "", 0 },
+    };
+    for (size_t i = 0; i < sizeof(ae) / sizeof(ae[0]); ++i) {
+        http_slice_t v = { ae[i].value, strlen(ae[i].value) };
+        if (http_accepts_encoding(v, "gzip") != ae[i].gzip) fail("test_http_parser - accept-encoding");
+    }
+    http_slice_t absent = { NULL, 0 };
+    if (http_accepts_encoding(absent, "gzip")) fail("test_http_parser - absent accept-encoding");
+
+    /* Malformed requests */
+    const char *bad[] = { "GARBAGE\r\n\r\n", "GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+                          "GET  HTTP/1.1\r\n\r\n", "GET / FTP/1.0\r\n\r\n" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        http_parser_reset(&parser);
+        if (http_parse_request(&parser, bad[i], strlen(bad[i]), &req) != HTTP_PARSE_ERROR)
+            fail("test_http_parser - malformed accepted");
+    }
+
+    /* Canonical paths: one spelling per resource */
+    const char *canon[][2] = {
+        { "/a//b/./c.css?v=2", "/a/b/c.css" }, { "/docs/", "/docs/" }, { "/", "/" },
+        { "/%7Euser/a%20b.txt#top", "/~user/a b.txt" }, { "//./", "/" }, { "/a..b", "/a..b" },
+    };
+    char out[64];
+    for (size_t i = 0; i < sizeof(canon) / sizeof(canon[0]); i++) {
+        if (http_canonical_path(canon[i][0], out, sizeof(out)) != 0 || strcmp(out, canon[i][1]) != 0)
+            fail("test_http_parser - canonical path");
+    }
+    if (http_canonical_path("/a/%2e%2E/etc", out, sizeof(out)) != -2) fail("test_http_parser - encoded traversal");
+    if (http_canonical_path("/a/../b", out, sizeof(out)) != -2) fail("test_http_parser - traversal");
+    if (http_canonical_path("/a%zz", out, sizeof(out)) != -1) fail("test_http_parser - bad escape");
+    if (http_canonical_path("/a%00b", out, sizeof(out)) != -1) fail("test_http_parser - NUL escape");
+    if (http_canonical_path("a/b", out, sizeof(out)) != -1) fail("test_http_parser - relative");
+
+    pass("test_http_parser");
+}
+
+/* -------------------------
+   Test 10: Borrowed cache entries
+   ------------------------- */
+void test_cache_refcount(void)
+{
+    /* Room for two 20-byte entries */
+    if (cache_init(40) != 0) fail("test_cache_refcount - init");
+
+    char v1[20], v2[20];
+    memset(v1, '1', sizeof(v1));
+    memset(v2, '2', sizeof(v2));
+
+    cache_put("/r/a", v1, sizeof(v1));
+    const cache_node_t *h1 = cache_acquire("/r/a");
+    const cache_node_t *h2 = cache_acquire("/r/a");
+    if (!h1 || h1 != h2) fail("test_cache_refcount - acquire");
+    if (cache_acquire("/r/missing") != NULL) fail("test_cache_refcount - miss");
+
+    /* Replacing the path must not touch the bytes a reader holds */
+    cache_put("/r/a", v2, sizeof(v2));
+    if (memcmp(h1->data, v1, sizeof(v1)) != 0) fail("test_cache_refcount - replaced in place");
+
+    const cache_node_t *h3 = cache_acquire("/r/a");
+    if (!h3 || h3 == h1 || memcmp(h3->data, v2, sizeof(v2)) != 0) fail("test_cache_refcount - new version");
+
+    /* Evict the new version while it is borrowed (it was hit, so CLOCK
+     * gives it a second chance before the hand comes back to it) */
+    cache_put("/r/b", v1, sizeof(v1));
+    cache_put("/r/c", v1, sizeof(v1));
+    cache_put("/r/d", v1, sizeof(v1));
+    cache_put("/r/e", v1, sizeof(v1));
+    if (cache_acquire("/r/a") != NULL) fail("test_cache_refcount - not evicted");
+    if (h3->len != sizeof(v2) || memcmp(h3->data, v2, sizeof(v2)) != 0) fail("test_cache_refcount - evicted early");
+
+    cache_release(h1);
+    cache_release(h2);
+    cache_release(h3);
+
+    /* A handle may outlive the cache itself */
+    const cache_node_t *h4 = cache_acquire("/r/e");
+    if (!h4) fail("test_cache_refcount - acquire before destroy");
+    cache_destroy();
+    if (memcmp(h4->data, v1, sizeof(v1)) != 0) fail("test_cache_refcount - freed by destroy");
+    cache_release(h4);
+
+    /* Hits leave the entry's own bytes untouched (copy-on-write friendly) */
+    if (cache_init(1024 * 1024) != 0) fail("test_cache_refcount - init slots");
+    cache_put("/r/hot", v1, sizeof(v1));
+    const cache_node_t *hot = cache_acquire("/r/hot");
+    cache_node_t before = *hot;
+    for (int i = 0; i < 10; i++) cache_release(cache_acquire("/r/hot"));
+    if (memcmp(&before, hot, sizeof(before)) != 0) fail("test_cache_refcount - hit wrote to entry");
+    cache_release(hot);
+
+    /* More one-byte entries than slots: inserts evict instead of failing */
+    char key[32];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(key, sizeof(key), "/r/tiny/%d", i);
+        if (cache_put(key, "t", 1) != 0) fail("test_cache_refcount - out of slots");
+    }
+    const cache_node_t *last = cache_acquire("/r/tiny/19999");
+    if (!last) fail("test_cache_refcount - newest entry");
+    cache_release(last);
+    cache_destroy();
+
+    pass("test_cache_refcount");
+}
+
+/* -------------------------
+   Test 11: Cache shared between processes
+   ------------------------- */
+void test_cache_shared(void)
+{
+    if (cache_init_shared(64 * 1024) != 0) fail("test_cache_shared - init");
+    if (cache_init(1024) != 0) fail("test_cache_shared - private init should be a no-op");
+
+    /* A child process fills the cache; the parent must see its entries */
+    pid_t pid = fork();
+    if (pid < 0) fail("test_cache_shared - fork");
+    if (pid == 0) {
+        char val[1000];
+        for (int i = 0; i < 200; ++i) {
+            char key[32];
+            snprintf(key, sizeof(key), "/s/%d", i);
+            memset(val, 'a' + (i % 26), sizeof(val));
+            if (cache_put(key, val, sizeof(val)) != 0) _exit(1);
+        }
+        cache_destroy(); /* Detaches only: the parent owns the region */
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) fail("test_cache_shared - child put");
+
+    /* 200 KB were inserted into a 64 KB cache: the newest entries remain */
+    const cache_node_t *e = cache_acquire("/s/199");
+    if (!e || e->len != 1000 || e->data[0] != 'a' + (199 % 26)) fail("test_cache_shared - lookup");
+    if (cache_acquire("/s/0") != NULL) fail("test_cache_shared - eviction");
+    cache_release(e);
+
+    cache_destroy();
+    pass("test_cache_shared");
+}
+
 /* -------------------------
    Runner
    ------------------------- */
 
+/* -------------------------
+   Test 12: Sharded cache under eviction pressure
+   ------------------------- */
+#define CLOCK_THREADS 8
+#define CLOCK_ITERS 20000
+#define CLOCK_KEYS 256
+
+void *clock_worker(void *arg)
+{
+    unsigned seed = (unsigned)(intptr_t)arg;
+    char key[32], val[64];
+    for (int i = 0; i < CLOCK_ITERS; ++i) {
+        int k = (int)(rand_r(&seed) % CLOCK_KEYS);
+        snprintf(key, sizeof(key), "/c/%d", k);
+
+        /* Entry contents are derived from the key, so any hit can be checked */
+        const cache_node_t *n = cache_acquire(key);
+        if (n) {
+            memset(val, 'a' + (k % 26), sizeof(val));
+            if (n->len != sizeof(val) || memcmp(n->data, val, sizeof(val)) != 0)
+                fail("test_cache_clock - corrupt entry");
+            cache_release(n);
+        } else {
+            memset(val, 'a' + (k % 26), sizeof(val));
+            cache_put(key, val, sizeof(val));
+        }
+    }
+    return NULL;
+}
+
+void test_cache_clock(void)
+{
+    /* Holds a quarter of the keys: hits and evictions interleave constantly */
+    if (cache_init(CLOCK_KEYS / 4 * 64) != 0) fail("test_cache_clock - init");
+
+    pthread_t threads[CLOCK_THREADS];
+    for (long i = 0; i < CLOCK_THREADS; ++i)
+        if (pthread_create(&threads[i], NULL, clock_worker, (void *)(intptr_t)(i + 1)) != 0)
+            fail("test_cache_clock - create");
+    for (int i = 0; i < CLOCK_THREADS; ++i) pthread_join(threads[i], NULL);
+
+    /* A frequently hit entry survives a scan of one-off puts */
+    char val[64];
+    memset(val, 'h', sizeof(val));
+    cache_put("/c/hot", val, sizeof(val));
+    for (int i = 0; i < CLOCK_KEYS; ++i) {
+        char key[32];
+        const cache_node_t *n = cache_acquire("/c/hot");
+        if (!n) fail("test_cache_clock - hot entry evicted");
+        cache_release(n);
+        snprintf(key, sizeof(key), "/scan/%d", i);
+        cache_put(key, val, sizeof(val));
+    }
+
+    cache_destroy();
+    pass("test_cache_clock");
+}
+
+/* -------------------------
+   Test 13: Prebuilt response headers
+   ------------------------- */
+void test_http_headers(void)
+{
+    char hdr[256], full[512];
+    size_t len = http_format_entity_header(hdr, sizeof(hdr), 200, "OK", "text/css", 1234, NULL);
+    if (len == 0 || strncmp(hdr, "HTTP/1.1 200 OK\r\n", 17) != 0) fail("test_http_headers - status line");
+    if (!strstr(hdr, "Content-Length: 1234\r\n")) fail("test_http_headers - length");
+
+    /* The Date value is the last line of the block and can be patched in place */
+    memset(hdr + len - 2 - HTTP_DATE_LEN, 'x', HTTP_DATE_LEN);
+    http_patch_date(hdr, len);
+    if (memcmp(hdr + len - 2 - HTTP_DATE_LEN, http_date(), HTTP_DATE_LEN) != 0 ||
+        memcmp(hdr + len - 2, "\r\n", 2) != 0)
+        fail("test_http_headers - date patch");
+
+    /* The connection tail completes the block */
+    size_t tail = http_format_conn_tail(hdr + len, 5, 42);
+    hdr[len + tail] = '\0';
+    if (!strstr(hdr, "Connection: keep-alive\r\nKeep-Alive: timeout=5, max=42\r\n\r\n"))
+        fail("test_http_headers - keep-alive tail");
+    tail = http_format_conn_tail(full, 0, 0);
+    full[tail] = '\0';
+    if (strcmp(full, "Connection: close\r\n\r\n") != 0) fail("test_http_headers - close tail");
+
+    /* Validators: dates round-trip, If-None-Match uses weak comparison */
+    char date[HTTP_DATE_LEN + 1];
+    time_t when = 784111777, parsed = 0;
+    http_format_date(when, date);
+    http_slice_t date_slice = { date, strlen(date) };
+    if (strcmp(date, "Sun, 06 Nov 1994 08:49:37 GMT") != 0 ||
+        http_parse_date(date_slice, &parsed) != 0 || parsed != when)
+        fail("test_http_headers - dates");
+    http_slice_t bad_date = { "yesterday", 9 };
+    if (http_parse_date(bad_date, &parsed) == 0) fail("test_http_headers - bad date");
+    http_slice_t inm = { "\"a\", W/\"b-1\"", 13 };
+    if (!http_etag_matches(inm, "\"b-1\"") || !http_etag_matches(inm, "\"a\"") ||
+        http_etag_matches(inm, "\"b\""))
+        fail("test_http_headers - etag match");
+
+    /* An Expires line right before Date is refreshed with the Date */
+    len = http_format_entity_header(hdr, sizeof(hdr), 200, "OK", "text/css", 1,
+                                    "Expires: Thu, 01 Jan 1970 00:00:00 GMT\r\n");
+    http_patch_expires(hdr, len, 60);
+    hdr[len] = '\0';
+    if (strstr(hdr, "1970")) fail("test_http_headers - expires patch");
+
+    /* Canned pages: known codes, unknown ones fall back to 500 */
+    const http_canned_t *r = http_canned(404);
+    if (r->status != 404 || r->body_len != strlen(r->body) || !strstr(r->hdr, "Content-Length: 22\r\n"))
+        fail("test_http_headers - canned 404");
+    if (http_canned(999)->status != 500) fail("test_http_headers - canned fallback");
+
+    /* Byte ranges: bounds are clamped, unsatisfiable elements dropped */
+    http_range_t rg[HTTP_MAX_RANGES];
+    http_slice_t rv = { "bytes=0-9, 20-, -5", 18 };
+    if (http_parse_range(rv, 100, rg, HTTP_MAX_RANGES) != 3 || rg[0].last != 9 ||
+        rg[1].first != 20 || rg[1].last != 99 || rg[2].first != 95)
+        fail("test_http_headers - range list");
+    rv = (http_slice_t){ "bytes=200-300", 13 };
+    if (http_parse_range(rv, 100, rg, HTTP_MAX_RANGES) != -1) fail("test_http_headers - range 416");
+    rv = (http_slice_t){ "bytes=5-2", 9 };
+    if (http_parse_range(rv, 100, rg, HTTP_MAX_RANGES) != 0) fail("test_http_headers - range invalid");
+    rv = (http_slice_t){ "items=0-1", 9 };
+    if (http_parse_range(rv, 100, rg, HTTP_MAX_RANGES) != 0) fail("test_http_headers - range unit");
+
+    /* Cache entries carry their header block */
+    if (cache_init(4096) != 0) fail("test_http_headers - cache init");
+    cache_rep_t rep = { hdr, len, "body", 4 };
+    cache_put_entry("/h/a", &rep, NULL);
+    const cache_node_t *n = cache_acquire("/h/a");
+    if (!n || n->hdr_len != len || memcmp(n->hdr, hdr, len) != 0 || memcmp(n->data, "body", 4) != 0)
+        fail("test_http_headers - cache entry header");
+    cache_release(n);
+    cache_destroy();
+
+    pass("test_http_headers");
+}
+
+/* -------------------------
+   Test 14: Invalidation of changed files
+   ------------------------- */
+void test_cache_invalidate(void)
+{
+    if (cache_init(4096) != 0) fail("test_cache_invalidate - init");
+    cache_put("/w/a.css", "a", 1);
+    cache_put("/w/sub/b.css", "b", 1);
+    cache_put("/w/sub/deep/c.css", "c", 1);
+    cache_put("/w/subway.css", "d", 1);
+
+    /* A borrowed entry survives its invalidation until released */
+    const cache_node_t *held = cache_acquire("/w/a.css");
+    if (cache_invalidate("/w/a.css", 0) != 1) fail("test_cache_invalidate - file");
+    if (!held || held->data[0] != 'a') fail("test_cache_invalidate - held entry");
+    cache_release(held);
+    if (cache_acquire("/w/a.css")) fail("test_cache_invalidate - file still cached");
+
+    /* A directory drops everything below it, not its name-prefixed siblings */
+    if (cache_invalidate("/w/sub", 1) != 2) fail("test_cache_invalidate - subtree");
+    const cache_node_t *n = cache_acquire("/w/subway.css");
+    if (!n) fail("test_cache_invalidate - sibling dropped");
+    cache_release(n);
+
+    /* Data read before an invalidation is not inserted after it */
+    unsigned long gen = cache_generation();
+    cache_invalidate("/w/e.css", 0);
+    cache_rep_t rep = { NULL, 0, "e", 1 };
+    if (cache_put_current("/w/e.css", &rep, NULL, gen) == 0) fail("test_cache_invalidate - stale put");
+    if (cache_put_current("/w/e.css", &rep, NULL, cache_generation()) != 0)
+        fail("test_cache_invalidate - current put");
+
+    cache_destroy();
+    pass("test_cache_invalidate");
+}
+
+/* -------------------------
+   Test 15: Metadata cache (positive, negative, invalidation)
+   ------------------------- */
+void test_meta_cache(void)
+{
+    if (meta_cache_init(64, 60, 1) != 0) fail("test_meta_cache - init");
+
+    meta_info_t in, out;
+    memset(&in, 0, sizeof(in));
+    in.found = 1;
+    in.st.st_size = 42;
+    snprintf(in.path, sizeof(in.path), "/w/docs/index.html");
+    meta_cache_put("/w/docs", &in);
+    snprintf(in.path, sizeof(in.path), "/w/docs/a.css");
+    meta_cache_put("/w/docs/a.css", &in);
+    in.found = 0;
+    meta_cache_put("/w/missing", &in);
+
+    if (meta_cache_get("/w/docs", &out) != 0 || !out.found || out.st.st_size != 42 ||
+        strcmp(out.path, "/w/docs/index.html") != 0)
+        fail("test_meta_cache - positive hit");
+    if (meta_cache_get("/w/missing", &out) != 0 || out.found) fail("test_meta_cache - negative hit");
+    if (meta_cache_get("/w/other", &out) == 0) fail("test_meta_cache - unexpected hit");
+
+    /* A changed index drops its directory; a created file ends its 404 */
+    meta_cache_invalidate("/w/docs/index.html", 0);
+    if (meta_cache_get("/w/docs", &out) == 0) fail("test_meta_cache - index invalidation");
+    meta_cache_invalidate("/w/missing", 0);
+    if (meta_cache_get("/w/missing", &out) == 0) fail("test_meta_cache - negative invalidation");
+    meta_cache_invalidate("/w/docs", 1);
+    if (meta_cache_get("/w/docs/a.css", &out) == 0) fail("test_meta_cache - subtree invalidation");
+
+    /* Negative entries expire after their TTL */
+    meta_cache_put("/w/missing", &in);
+    sleep(2);
+    if (meta_cache_get("/w/missing", &out) == 0) fail("test_meta_cache - negative TTL");
+
+    /* Capacity: the oldest entries make room */
+    in.found = 1;
+    char key[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "/w/f%d", i);
+        meta_cache_put(key, &in);
+    }
+    if (meta_cache_get("/w/f999", &out) != 0) fail("test_meta_cache - newest kept");
+    if (meta_cache_get("/w/f0", &out) == 0) fail("test_meta_cache - oldest evicted");
+
+    meta_cache_destroy();
+    pass("test_meta_cache");
+}
+
+/* -------------------------
+   Test 16: Open file cache (sharing, invalidation, eviction)
+   ------------------------- */
+void test_fd_cache(void)
+{
+    char path_a[] = "/tmp/fdcache_a_XXXXXX", path_b[] = "/tmp/fdcache_b_XXXXXX";
+    int fa = mkstemp(path_a), fb = mkstemp(path_b);
+    if (fa < 0 || fb < 0) fail("test_fd_cache - mkstemp");
+    if (write(fa, "hello", 5) != 5) fail("test_fd_cache - write");
+    close(fa);
+    close(fb);
+
+    fd_cache_init(1, 60);
+    const fd_cache_entry_t *e1 = fd_cache_open(path_a);
+    const fd_cache_entry_t *e2 = fd_cache_open(path_a);
+    if (!e1 || e1 != e2 || e1->st.st_size != 5) fail("test_fd_cache - shared entry");
+    if (fd_cache_open("/tmp/fdcache_missing_file") != NULL) fail("test_fd_cache - missing file");
+
+    /* An invalidated entry stays usable by its borrowers */
+    fd_cache_invalidate(path_a, 0);
+    const fd_cache_entry_t *e3 = fd_cache_open(path_a);
+    if (!e3 || e3 == e1) fail("test_fd_cache - invalidation");
+    char buf[5];
+    if (pread(e1->fd, buf, 5, 0) != 5 || memcmp(buf, "hello", 5) != 0) fail("test_fd_cache - borrowed fd");
+    fd_cache_release(e1);
+    fd_cache_release(e2);
+
+    /* Capacity 1: opening another file evicts the first */
+    const fd_cache_entry_t *e4 = fd_cache_open(path_b);
+    const fd_cache_entry_t *e5 = fd_cache_open(path_a);
+    if (!e4 || !e5 || e5 == e3) fail("test_fd_cache - eviction");
+    fd_cache_release(e3);
+    fd_cache_release(e4);
+    fd_cache_release(e5);
+    fd_cache_destroy();
+
+    /* Disabled: every open is a private descriptor */
+    fd_cache_init(0, 60);
+    e1 = fd_cache_open(path_a);
+    e2 = fd_cache_open(path_a);
+    if (!e1 || !e2 || e1 == e2) fail("test_fd_cache - disabled");
+    fd_cache_release(e1);
+    fd_cache_release(e2);
+    fd_cache_destroy();
+
+    unlink(path_a);
+    unlink(path_b);
+    pass("test_fd_cache");
+}
+
+/* -------------------------
+   Test 17: Latency histogram (buckets, percentiles)
+   ------------------------- */
+static void *latency_thread(void *arg)
+{
+    (void)arg;
+    stats_request_done(404, 10, 5000);
+    return NULL;
+}
+
+void test_latency_histogram(void)
+{
+    /* Buckets are contiguous, and every value lies within its bucket's range */
+    for (long v = 0; v < 1000000; v += (v < 5000) ? 1 : 997) {
+        int b = latency_bucket(v);
+        if (v > latency_bucket_max(b) || (b > 0 && v <= latency_bucket_max(b - 1)))
+            fail("test_latency_histogram - bucket range");
+        if (v >= 64 && latency_bucket_max(b) - v > v / LAT_SUB_COUNT)
+            fail("test_latency_histogram - precision");
+    }
+    if (latency_bucket(LAT_MAX_NS * 2) != LAT_BUCKETS - 1) fail("test_latency_histogram - clamp");
+
+    /* 1..10000 us: every percentile within ~3% of the exact value */
+    latency_hist_t *h = calloc(1, sizeof(*h));
+    if (!h) fail("test_latency_histogram - alloc");
+    for (long us = 1; us <= 10000; us++) latency_record(h, us * 1000);
+    if (h->count != 10000) fail("test_latency_histogram - count");
+
+    double pcts[] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+    for (int i = 0; i < 5; i++) {
+        double exact = pcts[i] / 100.0 * 10000 * 1000;
+        double got = latency_percentile(h, pcts[i]);
+        if (got < exact || got > exact * 1.032) fail("test_latency_histogram - percentile");
+    }
+    free(h);
+
+    /* Each thread records into the histograms next to its own stats slot */
+    if (!stats) init_shared_stats();
+    local_worker = 1;
+    pthread_t t;
+    if (pthread_create(&t, NULL, latency_thread, NULL) != 0) fail("test_latency_histogram - create");
+    pthread_join(t, NULL);
+    local_worker = -1;
+    int slot = __atomic_load_n(&stats->slots_claimed, __ATOMIC_RELAXED) - 1;
+    const latency_hist_t *mine = &stats_latencies[slot].by_class[LAT_CLASS_4XX];
+    if (stats->slots[slot].worker != 1 || mine->count != 1 || mine->sum_ns != 5000 ||
+        stats_latencies[slot].by_class[LAT_CLASS_2XX].count != 0)
+        fail("test_latency_histogram - per-thread slot");
+    pass("test_latency_histogram");
+}
+
+/* -------------------------
+   Test 18: Idle keep-alive yields to waiting connections
+   ------------------------- */
+static void *keepalive_server(void *arg)
+{
+    conn_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.fd = (int)(intptr_t)arg;
+    handle_client(&info);
+    return NULL;
+}
+
+/* Serves one request on a fresh connection, then returns the ms until the
+   idle connection is closed by the server (or -1 if open after 'wait_ms') */
+static long keepalive_idle_close_ms(worker_load_t *load, int *field, int wait_ms)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) fail("test_keepalive_yield - socketpair");
+    memset(load, 0, sizeof(*load));
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, keepalive_server, (void *)(intptr_t)sv[1]) != 0)
+        fail("test_keepalive_yield - create");
+
+    const char *req = "GET /missing.html HTTP/1.1\r\nHost: x\r\n\r\n";
+    char buf[1024];
+    if (write(sv[0], req, strlen(req)) != (ssize_t)strlen(req)) fail("test_keepalive_yield - write");
+    ssize_t n = read(sv[0], buf, sizeof(buf) - 1);
+    if (n <= 0) fail("test_keepalive_yield - response");
+    buf[n] = '\0';
+    if (!strstr(buf, " 404 ") || !strstr(buf, "Keep-Alive:")) fail("test_keepalive_yield - kept alive");
+
+    /* Another connection starts waiting while this one is idle */
+    usleep(200000);
+    if (field) __atomic_store_n(field, 1, __ATOMIC_RELAXED);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct pollfd pfd = { .fd = sv[0], .events = POLLIN };
+    int ready = poll(&pfd, 1, wait_ms);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    if (ready > 0 && read(sv[0], buf, sizeof(buf)) != 0) fail("test_keepalive_yield - unexpected data");
+
+    /* Hanging up ends the server side either way */
+    close(sv[0]);
+    pthread_join(t, NULL);
+    return ready > 0 ? ms : -1;
+}
+
+void test_keepalive_yield(void)
+{
+    config.keepalive_timeout = 5;
+    config.keepalive_max_requests = 100;
+    snprintf(config.document_root, sizeof(config.document_root), "/tmp/keepalive_test_no_root");
+    if (!stats) init_shared_stats();
+
+    worker_load_t load;
+    local_load = &load;
+
+    /* Nobody waiting: the idle connection is kept */
+    if (keepalive_idle_close_ms(&load, NULL, 500) != -1) fail("test_keepalive_yield - closed while unloaded");
+
+    /* Queued locally (accept modes) or in transit from the Master (direct receive) */
+    long ms = keepalive_idle_close_ms(&load, &load.queued, 2000);
+    if (ms < 0 || ms > 500) fail("test_keepalive_yield - queued");
+    ms = keepalive_idle_close_ms(&load, &load.pending, 2000);
+    if (ms < 0 || ms > 500) fail("test_keepalive_yield - pending");
+
+    local_load = NULL;
+    pass("test_keepalive_yield");
+}
+
+/* -------------------------
+   Test 19: Shared cache recovery after a worker dies
+   ------------------------- */
+static int test_process_alive(pid_t pid)
+{
+    if (pid == getpid()) return 1;
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0) return 0;
+    return info.si_pid != pid;
+}
+
+void test_cache_recover(void)
+{
+    alarm(30); /* A hang is the failure under test */
+    if (cache_init_shared(256 * 1024) != 0) fail("test_cache_recover - init");
+    char val[100];
+    memset(val, 'r', sizeof(val));
+    cache_put("/d/a", val, sizeof(val));
+
+    /* A worker exits holding an entry: its reference would never be dropped */
+    pid_t pid = fork();
+    if (pid == 0) _exit(cache_acquire("/d/a") ? 0 : 1);
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fail("test_cache_recover - child acquire");
+
+    /* Poisoned, but not reset while a live thread holds an entry */
+    const cache_node_t *held = cache_acquire("/d/a");
+    if (!held) fail("test_cache_recover - acquire");
+    if (cache_recover_shared(test_process_alive) != 0) fail("test_cache_recover - reset while held");
+    if (cache_acquire("/d/a") != NULL) fail("test_cache_recover - poisoned hit");
+    if (cache_put("/d/b", val, sizeof(val)) == 0) fail("test_cache_recover - poisoned put");
+    if (memcmp(held->data, val, sizeof(val)) != 0) fail("test_cache_recover - held entry");
+    cache_release(held);
+    if (cache_recover_shared(test_process_alive) != 1) fail("test_cache_recover - reset");
+    if (cache_acquire("/d/a") != NULL) fail("test_cache_recover - entries kept");
+    if (cache_recover_shared(test_process_alive) != 0) fail("test_cache_recover - second reset");
+
+    /* Workers killed at arbitrary points, possibly holding a lock */
+    char key[32];
+    for (int round = 0; round < 10; round++) {
+        pid = fork();
+        if (pid == 0) {
+            for (unsigned i = 0;; i++) {
+                snprintf(key, sizeof(key), "/d/%u", i % 500);
+                const cache_node_t *n = cache_acquire(key);
+                if (n) cache_release(n);
+                else cache_put(key, val, sizeof(val));
+            }
+        }
+        usleep(20000 + round * 3000);
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+
+        /* The survivor never blocks, and the cache is usable after recovery */
+        for (int i = 0; i < 2000; i++) {
+            snprintf(key, sizeof(key), "/d/%d", i % 500);
+            const cache_node_t *n = cache_acquire(key);
+            if (n) cache_release(n);
+            else cache_put(key, val, sizeof(val));
+        }
+        cache_recover_shared(test_process_alive);
+        if (cache_put("/d/check", val, sizeof(val)) != 0) fail("test_cache_recover - put after kill");
+        const cache_node_t *n = cache_acquire("/d/check");
+        if (!n) fail("test_cache_recover - hit after kill");
+        cache_release(n);
+    }
+
+    cache_destroy();
+    alarm(0);
+    pass("test_cache_recover");
+}
+
+/* -------------------------
+   Test 20: Binary log round trip (tools/logdecode)
+   ------------------------- */
+#define LOG_TEST_FILE "/tmp/binlog_test.log"
+#define LOG_TEST_RESET (LOG_MAX_PATH_IDS + 10)
+
+typedef struct {
+    int pid;
+    const char *path;
+    int status;
+} log_expect_t;
+
+/* Decodes 'files' with tools/logdecode and checks every request in order */
+static int check_decoded(const char *files, const log_expect_t *expect, int count)
+{
+    char cmd[256], line[512], path[256];
+    snprintf(cmd, sizeof(cmd), "./tools/logdecode -f json %s", files);
+    FILE *fp = popen(cmd, "r");
+    if (!fp) return -1;
+
+    int n = 0, ok = 1;
+    while (fgets(line, sizeof(line), fp)) {
+        int status, pid;
+        char *f = strstr(line, "\"path\":\"");
+        char *q = strstr(line, "\"pid\":");
+        if (!f || !q || sscanf(f, "\"path\":\"%255[^\"]\",\"status\":%d", path, &status) != 2 ||
+            sscanf(q, "\"pid\":%d", &pid) != 1 || n >= count ||
+            strcmp(path, expect[n].path) != 0 || status != expect[n].status || pid != expect[n].pid) {
+            ok = 0;
+            break;
+        }
+        n++;
+    }
+    while (fgets(line, sizeof(line), fp));
+    return (pclose(fp) == 0 && ok && n == count) ? 0 : -1;
+}
+
+void test_binary_log(void)
+{
+    if (access("./tools/logdecode", X_OK) != 0) fail("test_binary_log - tools/logdecode not built");
+    config.log_format = LOG_FORMAT_BINARY;
+    config.log_max_size = 0;
+    unlink(LOG_TEST_FILE);
+    unlink(LOG_TEST_FILE ".1");
+
+    /* Entries logged by earlier tests go to a scratch file first */
+    snprintf(config.log_file, sizeof(config.log_file), LOG_TEST_FILE ".scratch");
+    init_logger();
+    flush_logger();
+    unlink(config.log_file);
+    snprintf(config.log_file, sizeof(config.log_file), LOG_TEST_FILE);
+    logger_request_reopen();
+
+    /* Another worker: the same IDs name other paths */
+    pid_t child = fork();
+    if (child == 0) {
+        log_request("127.0.0.1", "GET", "/c", 403, 0, 1);
+        log_request("127.0.0.1", "GET", "/a", 200, 10, 1);
+        flush_logger();
+        _exit(0);
+    }
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fail("test_binary_log - child");
+
+    log_request("127.0.0.1", "GET", "/a", 200, 10, 1);
+    log_request("127.0.0.1", "GET", "/b", 404, 0, 1);
+    flush_logger();
+
+    /* Rotated between encoding and writing: /b is defined again ahead of the batch */
+    if (rename(LOG_TEST_FILE, LOG_TEST_FILE ".1") != 0) fail("test_binary_log - rename");
+    logger_request_reopen();
+    log_request("127.0.0.1", "GET", "/b", 304, 0, 1);
+    log_request("127.0.0.1", "HEAD", "/d", 200, 0, 1);
+    flush_logger();
+
+    /* Enough distinct paths to restart the ID table; /b then gets a reused ID */
+    char path[32];
+    for (int i = 0; i < LOG_TEST_RESET; i++) {
+        snprintf(path, sizeof(path), "/r/%d", i);
+        log_request("127.0.0.1", "GET", path, 200, 0, 1);
+        if (i % 256 == 255) flush_logger();
+    }
+    log_request("127.0.0.1", "GET", "/b", 500, 0, 1);
+    flush_logger();
+
+    int me = getpid();
+    log_expect_t *expect = malloc((LOG_TEST_RESET + 3) * sizeof(log_expect_t));
+    char (*names)[32] = malloc(LOG_TEST_RESET * 32);
+    if (!expect || !names) fail("test_binary_log - malloc");
+    log_expect_t first[] = {
+        { child, "/c", 403 }, { child, "/a", 200 }, { me, "/a", 200 }, { me, "/b", 404 },
+    };
+    if (check_decoded(LOG_TEST_FILE ".1", first, 4) != 0) fail("test_binary_log - rotated file");
+
+    int n = 0;
+    expect[n++] = (log_expect_t){ me, "/b", 304 };
+    expect[n++] = (log_expect_t){ me, "/d", 200 };
+    for (int i = 0; i < LOG_TEST_RESET; i++) {
+        snprintf(names[i], 32, "/r/%d", i);
+        expect[n++] = (log_expect_t){ me, names[i], 200 };
+    }
+    expect[n++] = (log_expect_t){ me, "/b", 500 };
+    if (check_decoded(LOG_TEST_FILE, expect, n) != 0) fail("test_binary_log - current file");
+
+    free(names);
+    free(expect);
+    unlink(LOG_TEST_FILE);
+    unlink(LOG_TEST_FILE ".1");
+    pass("test_binary_log");
+}
+
+/* -------------------------
+   Test 21: Log rotation and background compression
+   ------------------------- */
+#define ROT_TEST_FILE "/tmp/rotlog_test.log"
+#define ROT_TEST_LINES 100
+
+/* Lines in 'name' (plain or gzip), or -1 if one is not from batch 'round' */
+static int count_round_lines(const char *name, int round)
+{
+    gzFile gz = gzopen(name, "rb");
+    if (!gz) return -1;
+    char line[256], want[32];
+    snprintf(want, sizeof(want), " /rot/%d/", round);
+    int n = 0;
+    while (gzgets(gz, line, sizeof(line))) {
+        if (!strstr(line, want)) { n = -1; break; }
+        n++;
+    }
+    gzclose(gz);
+    return n;
+}
+
+/* Waits for the compressor to replace ".1" with ".1.gz" */
+static int wait_compressed(void)
+{
+    for (int i = 0; i < 500; i++) {
+        if (access(ROT_TEST_FILE ".1", F_OK) != 0 && access(ROT_TEST_FILE ".1.gz", F_OK) == 0) return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+void test_log_rotation(void)
+{
+    const char *names[] = { ROT_TEST_FILE, ROT_TEST_FILE ".1", ROT_TEST_FILE ".1.gz",
+                            ROT_TEST_FILE ".2", ROT_TEST_FILE ".2.gz", ROT_TEST_FILE ".3.gz" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) unlink(names[i]);
+
+    config.log_format = LOG_FORMAT_TEXT;
+    config.log_max_size = 4096; /* One batch of ROT_TEST_LINES lines is larger */
+    config.log_rotate_keep = 2;
+    config.log_compress = 1;
+    snprintf(config.log_file, sizeof(config.log_file), ROT_TEST_FILE);
+    init_logger();
+    logger_request_reopen();
+
+    char path[32];
+    for (int round = 1; round <= 4; round++) {
+        for (int i = 0; i < ROT_TEST_LINES; i++) {
+            snprintf(path, sizeof(path), "/rot/%d/%d", round, i);
+            log_request("127.0.0.1", "GET", path, 200, 0, 1);
+        }
+        flush_logger();
+
+        /* The writer reopened LOG_FILE, which holds only this batch */
+        if (count_round_lines(ROT_TEST_FILE, round) != ROT_TEST_LINES) fail("test_log_rotation - current file");
+        if (round == 1) {
+            if (access(ROT_TEST_FILE ".1", F_OK) == 0) fail("test_log_rotation - rotated early");
+            continue;
+        }
+        if (wait_compressed() != 0) fail("test_log_rotation - compression");
+        if (count_round_lines(ROT_TEST_FILE ".1.gz", round - 1) != ROT_TEST_LINES)
+            fail("test_log_rotation - .1.gz");
+    }
+
+    /* Older generations shifted up; only LOG_ROTATE_KEEP are kept */
+    if (count_round_lines(ROT_TEST_FILE ".2.gz", 2) != ROT_TEST_LINES) fail("test_log_rotation - .2.gz");
+    if (access(ROT_TEST_FILE ".2", F_OK) == 0 || access(ROT_TEST_FILE ".3.gz", F_OK) == 0)
+        fail("test_log_rotation - kept too many");
+
+    config.log_max_size = 0;
+    config.log_compress = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) unlink(names[i]);
+    pass("test_log_rotation");
+}
+
+/* -------------------------
+   Test 22: Request bodies end the connection
+   ------------------------- */
+/* Sends 'req' on a fresh connection and returns everything the server
+   sends back until it closes (or 2 s pass) */
+static void exchange(const char *req, char *out, size_t cap)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) fail("test_request_body - socketpair");
+    pthread_t t;
+    if (pthread_create(&t, NULL, keepalive_server, (void *)(intptr_t)sv[1]) != 0)
+        fail("test_request_body - create");
+    if (write(sv[0], req, strlen(req)) != (ssize_t)strlen(req)) fail("test_request_body - write");
+
+    size_t len = 0;
+    struct pollfd pfd = { .fd = sv[0], .events = POLLIN };
+    while (len < cap - 1 && poll(&pfd, 1, 2000) > 0) {
+        ssize_t n = read(sv[0], out + len, cap - 1 - len);
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    out[len] = '\0';
+    close(sv[0]);
+    pthread_join(t, NULL);
+}
+
+void test_request_body(void)
+{
+    config.keepalive_timeout = 1;
+    config.keepalive_max_requests = 100;
+    snprintf(config.document_root, sizeof(config.document_root), "/tmp/keepalive_test_no_root");
+    if (!stats) init_shared_stats();
+    local_load = NULL;
+
+    /* A request smuggled in a body is never answered */
+    char out[4096];
+    exchange("POST /index.html HTTP/1.1\r\nHost: x\r\nContent-Length: 33\r\n\r\n"
+             "GET /nonexist HTTP/1.1\r\nHost: x\r\n\r\n", out, sizeof(out));
+    if (!strstr(out, " 405 ") || !strstr(out, "Connection: close\r\n") || strstr(out, " 404 "))
+        fail("test_request_body - content-length");
+    exchange("POST / HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+             "0\r\n\r\nGET /nonexist HTTP/1.1\r\nHost: x\r\n\r\n", out, sizeof(out));
+    if (!strstr(out, " 405 ") || strstr(out, " 404 ")) fail("test_request_body - chunked");
+
+    /* Pipelining stops at a request with a body */
+    exchange("GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+             "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 35\r\n\r\n"
+             "GET /smuggled HTTP/1.1\r\nHost: x\r\n\r\n"
+             "GET /b HTTP/1.1\r\nHost: x\r\n\r\n", out, sizeof(out));
+    char *second = strstr(out, " 405 ");
+    if (!strstr(out, " 404 ") || !second || strstr(second, " 404 ")) fail("test_request_body - pipelined");
+
+    /* An empty body still allows keep-alive */
+    exchange("GET /a HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\n\r\n"
+             "GET /b HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n", out, sizeof(out));
+    second = strstr(out, " 404 ");
+    if (!second || !strstr(second + 1, " 404 ")) fail("test_request_body - empty body");
+
+    pass("test_request_body");
+}
+
 int main(void)
 {
     printf("Running concurrency tests...\n");
@@ -375,6 +1383,21 @@ int main(void)
     test_cache_integrity();
     test_cache_eviction();
     test_queue_shutdown();
+    test_ipc_conn_batch();
+    test_http_parser();
+    test_cache_refcount();
+    test_cache_shared();
+    test_cache_clock();
+    test_http_headers();
+    test_cache_invalidate();
+    test_meta_cache();
+    test_fd_cache();
+    test_latency_histogram();
+    test_keepalive_yield();
+    test_cache_recover();
+    test_binary_log();
+    test_log_rotation();
+    test_request_body();
     printf("All tests completed.\n");
     return 0;
 }
\ No newline at end of file
@@ -164,6 +164,9 @@ test_stats_accuracy() {
     for i in {1..50}; do curl -s -o /dev/null "$BASE_URL/index.html"; done
     for i in {1..50}; do curl -s -o /dev/null "$BASE_URL/badfile_$i.txt"; done
 
+    # The log writer appends its batch once per second (LOG_FLUSH_INTERVAL_MS)
+    sleep 2
+
     if [ -f access.log ]; then
         LOG_LINES=$(wc -l < access.log)
         
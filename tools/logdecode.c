@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "../src/log_format.h"
+
+/* Output formats (-f) */
+#define OUT_COMMON   0
+#define OUT_COMBINED 1
+#define OUT_JSON     2
+
+#define PATH_BUCKETS 4096
+
+/*
+ * Path Table
+ * Purpose: Maps (pid, path ID) to the path from the last PATH record seen
+ * for it. A later definition of the same pair replaces the earlier one.
+ */
+typedef struct path_def {
+    struct path_def *next;
+    uint32_t pid, id;
+    char *path;
+} path_def_t;
+
+static path_def_t *paths[PATH_BUCKETS];
+
+static unsigned bucket_of(uint32_t pid, uint32_t id)
+{
+    return (pid * 2654435761u ^ id) % PATH_BUCKETS;
+}
+
+static void define_path(uint32_t pid, uint32_t id, char *path)
+{
+    path_def_t **b = &paths[bucket_of(pid, id)];
+    for (path_def_t *d = *b; d; d = d->next) {
+        if (d->pid == pid && d->id == id) {
+            free(d->path);
+            d->path = path;
+            return;
+        }
+    }
+    path_def_t *d = malloc(sizeof(*d));
+    if (!d) { free(path); return; }
+    d->pid = pid;
+    d->id = id;
+    d->path = path;
+    d->next = *b;
+    *b = d;
+}
+
+static const char *lookup_path(uint32_t pid, uint32_t id)
+{
+    for (path_def_t *d = paths[bucket_of(pid, id)]; d; d = d->next) {
+        if (d->pid == pid && d->id == id) return d->path;
+    }
+    return "-";
+}
+
+/* Writes 's' as the body of a JSON string */
+static void json_string(const char *s)
+{
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+}
+
+static void print_request(const log_rec_request_t *r, uint32_t pid, int format)
+{
+    char addr[INET_ADDRSTRLEN] = "-";
+    if (r->addr) inet_ntop(AF_INET, &r->addr, addr, sizeof(addr));
+    const char *method = r->method < LOG_METHOD_COUNT ? log_method_names[r->method] : "-";
+    const char *path = lookup_path(pid, r->path_id);
+
+    time_t sec = (time_t)(r->time_ms / 1000);
+    struct tm tm_info;
+    char ts[64];
+
+    if (format == OUT_JSON) {
+        gmtime_r(&sec, &tm_info);
+        strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm_info);
+        printf("{\"time\":\"%s.%03uZ\",\"remote_addr\":\"%s\",\"method\":\"%s\",\"path\":\"",
+               ts, (unsigned)(r->time_ms % 1000), addr, method);
+        json_string(path);
+        printf("\",\"status\":%u,\"bytes\":%llu,\"latency_us\":%u,\"pid\":%u}\n",
+               r->status, (unsigned long long)r->bytes, r->latency_us, pid);
+        return;
+    }
+
+    localtime_r(&sec, &tm_info);
+    strftime(ts, sizeof(ts), "%d/%b/%Y:%H:%M:%S %z", &tm_info);
+    printf("%s - - [%s] \"%s %s HTTP/1.1\" %u %llu%s\n", addr, ts, method, path,
+           r->status, (unsigned long long)r->bytes, format == OUT_COMBINED ? " \"-\" \"-\"" : "");
+}
+
+/*
+ * Decode One File
+ * Purpose: Reads a binary access log record by record and prints each
+ * request in the chosen format.
+ * Return: 0 on success, -1 if the file is not a binary log or is
+ * truncated (records before the damage are still printed).
+ */
+static int decode(FILE *fp, const char *name, int format)
+{
+    char magic[LOG_BIN_MAGIC_LEN];
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, LOG_BIN_MAGIC, LOG_BIN_MAGIC_LEN) != 0) {
+        fprintf(stderr, "logdecode: %s: not a binary access log\n", name);
+        return -1;
+    }
+
+    uint32_t pid = 0;
+    int type;
+    while ((type = fgetc(fp)) != EOF) {
+        if (type == LOG_REC_SOURCE) {
+            log_rec_source_t src;
+            if (fread((char *)&src + 1, sizeof(src) - 1, 1, fp) != 1) break;
+            pid = src.pid;
+        } else if (type == LOG_REC_PATH) {
+            log_rec_path_t def;
+            if (fread((char *)&def + 1, sizeof(def) - 1, 1, fp) != 1) break;
+            char *path = malloc(def.len + 1);
+            if (!path || fread(path, 1, def.len, fp) != def.len) { free(path); break; }
+            path[def.len] = '\0';
+            define_path(pid, def.id, path);
+        } else if (type == LOG_REC_REQUEST) {
+            log_rec_request_t req;
+            if (fread((char *)&req + 1, sizeof(req) - 1, 1, fp) != 1) break;
+            print_request(&req, pid, format);
+        } else {
+            fprintf(stderr, "logdecode: %s: unknown record type %d at offset %ld\n",
+                    name, type, ftell(fp) - 1);
+            return -1;
+        }
+    }
+    if (!feof(fp)) {
+        fprintf(stderr, "logdecode: %s: truncated record\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: logdecode [-f common|combined|json] [file...]\n"
+                    "Decodes binary access logs (LOG_FORMAT=binary); reads stdin if no file is given.\n");
+}
+
+int main(int argc, char **argv)
+{
+    int format = OUT_COMMON;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            const char *f = argv[++i];
+            if (strcmp(f, "common") == 0) format = OUT_COMMON;
+            else if (strcmp(f, "combined") == 0) format = OUT_COMBINED;
+            else if (strcmp(f, "json") == 0) format = OUT_JSON;
+            else { usage(); return 2; }
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    int status = 0;
+    if (i == argc) return decode(stdin, "stdin", format) == 0 ? 0 : 1;
+    for (; i < argc; i++) {
+        FILE *fp = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "rb");
+        if (!fp) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        if (decode(fp, argv[i], format) != 0) status = 1;
+        if (fp != stdin) fclose(fp);
+    }
+    return status;
+}